@@ -0,0 +1,32 @@
+#pragma once
+
+#include "uefi.h"
+#include "tftp.h"
+
+// Named blobs loaded once at startup. Each entry is allocated to the exact
+// file size and the transfer writes straight into it, no staging copy.
+class AssetCache {
+    struct Asset {
+        const char* name;
+        char* data;
+        UINT64 size;
+    };
+    static constexpr std::size_t MAX_ASSETS = 8;
+
+    Asset assets[MAX_ASSETS] {};
+    std::size_t count = 0;
+
+    char* reserve(const char* name, UINT64 size);
+public:
+    AssetCache() = default;
+    AssetCache(const AssetCache&) = delete;
+    ~AssetCache();
+
+    // From the file system the image was started from.
+    EFI_STATUS load_file(const char* name);
+    // From the TFTP server `tftp` was opened against.
+    EFI_STATUS fetch_tftp(TftpClient& tftp, const char* name);
+
+    // nullptr if `name` was never loaded.
+    char* find(const char* name, UINT64* size = nullptr);
+};
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <atomic>
+#include <type_traits>
+
+#include "uefi.h"
+#include "clock.h"
+#include "log.h"
+#include "fs.h"
+
+// Deferred-format binary log. A BLOG() call site owns a static BinlogFormat
+// that gets an ID on first use; after that a record is the ID, the TSC and
+// up to BINLOG_ARGS raw 64-bit arguments stored into a ring, no formatting at
+// all, ~30 ns. tools/binlog_decode.py applies the printf-style formats on the
+// host.
+//
+//     BLOG(LogDebug, "frame %u: decode %u us", frames, us);
+//
+// Arguments are integers, enums, pointers or doubles (%f, %g); strings are
+// not copied, so %s is out. The level filter is the one of log.h.
+//
+// binlog_write_stream() serialises the ring: a header, one dictionary record
+// per format with its text, file and line, then the events. Formats are kept
+// apart from the ring, so they survive it wrapping.
+
+constexpr std::size_t BINLOG_ARGS = 6;
+constexpr UINT32 BINLOG_MAGIC = 0x474f4c42;   // "BLOG"
+constexpr UINT16 BINLOG_VERSION = 1;
+
+struct BinlogFormat {
+    const char* format;
+    const char* file;
+    UINT32 line;
+    UINT8 level;
+    UINT8 args = 0;
+    std::atomic<UINT16> id {0};
+    BinlogFormat* next = nullptr;
+
+    constexpr BinlogFormat(const char* format, const char* file, UINT32 line, LogLevel level)
+        : format(format), file(file), line(line), level(level) {}
+};
+
+// One cache line, guarded like a seqlock. A writer clears `header` before it
+// touches the payload and stores the final one last: the ID, the argument
+// count and the position + 1 in the top half. A reader that finds the same
+// valid header before and after copying the payload has a whole record. The
+// payload words are relaxed atomics, plain moves on x86, so the copy racing
+// a writer is not undefined. Two writers a full ring apart on one entry can
+// still mix; the ring is sized so that does not happen.
+struct BinlogEntry {
+    std::atomic<UINT64> header {0};
+    std::atomic<UINT64> tsc {0};
+    std::atomic<UINT64> args[BINLOG_ARGS] {};
+};
+
+struct BinlogState {
+    alignas(CACHE_LINE) std::atomic<UINT64> head {0};
+    BinlogEntry* entries = nullptr;
+    UINT64 mask = 0;
+    std::atomic<UINT16> next_id {0};
+    std::atomic<BinlogFormat*> formats {nullptr};
+};
+extern BinlogState binlog_state;
+
+// Allocates a ring of `entries`, rounded up to a power of two. Without it
+// BLOG() records nothing.
+EFI_STATUS binlog_init(std::size_t entries = 16 * 1024);
+inline bool binlog_ready() {
+    return binlog_state.entries != nullptr;
+}
+// Assigns the format its ID and adds it to the dictionary, once.
+UINT16 binlog_register(BinlogFormat& format, UINT8 args);
+// Records written so far, including the ones the ring has dropped since.
+inline UINT64 binlog_records() {
+    return binlog_state.head.load(std::memory_order_relaxed);
+}
+
+template<typename T>
+inline UINT64 binlog_arg(T value) {
+    static_assert(std::is_arithmetic<T>::value || std::is_enum<T>::value || std::is_pointer<T>::value,
+                  "binlog arguments are stored as 64-bit words");
+    if constexpr (std::is_floating_point<T>::value) {
+        double d = value;
+        UINT64 bits;
+        memcpy(&bits, &d, sizeof(bits));
+        return bits;
+    } else if constexpr (std::is_pointer<T>::value) {
+        return (UINT64)value;
+    } else {
+        return (UINT64)(INT64)value;
+    }
+}
+
+template<typename... Args>
+inline void binlog_write(BinlogFormat& format, Args... args) {
+    static_assert(sizeof...(Args) <= BINLOG_ARGS, "too many binlog arguments");
+    if (!binlog_ready())
+        return;
+    UINT64 id = format.id.load(std::memory_order_relaxed);
+    if (id == 0)
+        id = binlog_register(format, sizeof...(Args));
+    UINT64 pos = binlog_state.head.fetch_add(1, std::memory_order_relaxed);
+    BinlogEntry& entry = binlog_state.entries[pos & binlog_state.mask];
+    entry.header.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    entry.tsc.store(rdtsc(), std::memory_order_relaxed);
+    std::size_t i = 0;
+    (entry.args[i++].store(binlog_arg(args), std::memory_order_relaxed), ...);
+    (void)i;
+    entry.header.store(((pos + 1) << 32) | (sizeof...(Args) << 16) | id, std::memory_order_release);
+}
+
+#define BLOG(level, fmt, ...) do { \
+        static BinlogFormat binlog_format_(fmt, __FILE__, __LINE__, level); \
+        if (log_enabled(level)) \
+            binlog_write(binlog_format_ __VA_OPT__(,) __VA_ARGS__); \
+    } while (0)
+
+// Writes the header, the dictionary and every committed record still in the
+// ring, returns the records written.
+std::size_t binlog_write_stream(StreamSink sink, void* ctx);
+// Replaces `name` in `root` with the stream, see fwrite_stream().
+EFI_STATUS binlog_dump_file(EFI_FILE_PROTOCOL* root, const wchar_t* name, std::size_t* records = nullptr);
+// Sends the stream through the serial log as "blog <hex>" lines, which
+// binlog_decode.py picks out of a console capture. Slow, for the end of a
+// headless run.
+std::size_t binlog_dump_serial();
@@ -0,0 +1,7 @@
+#pragma once
+
+#include <cstddef>
+
+// For padding data shared between CPUs. Kept apart from uefi.h so headers
+// that only need this, such as queue.h, also build on the host.
+constexpr std::size_t CACHE_LINE = 64;
@@ -0,0 +1,102 @@
+#pragma once
+
+#include "uefi.h"
+
+// Time from the TSC, calibrated once by clock_init(). A read is one rdtsc
+// and a couple of multiplies, no firmware call, so it can be taken per
+// packet or per row. The TSC is assumed invariant, which any CPU of the
+// last decade and KVM on it provide; clock_invariant() tells.
+
+inline UINT64 rdtsc() {
+    return __builtin_ia32_rdtsc();
+}
+
+struct ClockCalibration {
+    UINT64 tsc_hz = 0;
+    UINT64 tsc_per_us = 1;
+    // cycles * mult >> 32, in ns and in us.
+    UINT64 ns_mult = 0;
+    UINT64 us_mult = 0;
+    // now_ns() and now_us() count from here.
+    UINT64 base_tsc = 0;
+    bool invariant = false;
+};
+extern ClockCalibration clock_calibration;
+
+// Measures the TSC against Stall(us), best of three, and starts the clock at
+// zero. Call once at startup before anything reads the time.
+void clock_init(UINT64 us = 10'000);
+
+inline UINT64 clock_scale(UINT64 cycles, UINT64 mult) {
+    // 64 x 32.32 fixed point without a 128-bit multiply.
+    return (cycles >> 32) * mult + (((cycles & 0xffffffff) * mult) >> 32);
+}
+inline UINT64 cycles_to_ns(UINT64 cycles) {
+    return clock_scale(cycles, clock_calibration.ns_mult);
+}
+inline UINT64 cycles_to_us(UINT64 cycles) {
+    return clock_scale(cycles, clock_calibration.us_mult);
+}
+inline UINT64 us_to_cycles(UINT64 us) {
+    return us * clock_calibration.tsc_per_us;
+}
+
+inline UINT64 now_ns() {
+    return cycles_to_ns(rdtsc() - clock_calibration.base_tsc);
+}
+inline UINT64 now_us() {
+    return cycles_to_us(rdtsc() - clock_calibration.base_tsc);
+}
+// Microseconds since an earlier rdtsc().
+inline UINT64 us_since(UINT64 start_tsc) {
+    return cycles_to_us(rdtsc() - start_tsc);
+}
+
+bool clock_invariant();
+
+class Stopwatch {
+    UINT64 start;
+public:
+    Stopwatch() : start(rdtsc()) {}
+    void restart() { start = rdtsc(); }
+    UINT64 started() { return start; }
+    UINT64 elapsed_cycles() { return rdtsc() - start; }
+    UINT64 elapsed_ns() { return cycles_to_ns(elapsed_cycles()); }
+    UINT64 elapsed_us() { return cycles_to_us(elapsed_cycles()); }
+};
+
+// Adds the time spent in its scope to `total_ns`, and counts the scope in
+// `count` if given.
+class ScopedTimer {
+    UINT64 start;
+    UINT64& total_ns;
+    UINT64* count;
+public:
+    explicit ScopedTimer(UINT64& total_ns, UINT64* count = nullptr) : start(rdtsc()), total_ns(total_ns), count(count) {}
+    ScopedTimer(const ScopedTimer&) = delete;
+    ~ScopedTimer() {
+        total_ns += cycles_to_ns(rdtsc() - start);
+        if (count)
+            *count += 1;
+    }
+};
+
+// A point in time to give up at, e.g.
+//     Deadline deadline = Deadline::after_us(500'000);
+//     while (!done && !deadline.expired()) ...
+class Deadline {
+    UINT64 at;
+    explicit Deadline(UINT64 at) : at(at) {}
+public:
+    static Deadline after_us(UINT64 us) { return Deadline(rdtsc() + us_to_cycles(us)); }
+    static Deadline after_ns(UINT64 ns) { return Deadline(rdtsc() + us_to_cycles(ns) / 1000); }
+    static Deadline never() { return Deadline(~(UINT64)0); }
+
+    bool expired() { return rdtsc() >= at; }
+    UINT64 remaining_us() {
+        UINT64 now = rdtsc();
+        return now >= at ? 0 : cycles_to_us(at - now);
+    }
+    // Pushes the deadline `us` further out from now.
+    void extend_us(UINT64 us) { at = rdtsc() + us_to_cycles(us); }
+};
@@ -0,0 +1,288 @@
+#pragma once
+
+#include <coroutine>
+
+#include "uefi.h"
+
+// Size-classed free lists for coroutine frames, carved from 64 KiB slabs so
+// a frame costs no AllocatePool call once the slabs are warm. Frames above
+// the largest class go to malloc. Zero-initialised, usable before main.
+class FramePool {
+    static constexpr std::size_t CLASSES = 6;     // 128 B .. 4 KiB
+    static constexpr std::size_t MIN_SIZE = 128;
+    static constexpr std::size_t SLAB_SIZE = 64 * 1024;
+
+    struct FreeFrame {
+        FreeFrame* next;
+    };
+
+    FreeFrame* free_lists[CLASSES] = {};
+    char* slab = nullptr;
+    std::size_t slab_left = 0;
+
+    std::size_t allocations_ = 0;
+    std::size_t slabs_ = 0;
+    std::size_t large_ = 0;
+    std::size_t live_ = 0;
+
+    static std::size_t class_of(std::size_t size);
+public:
+    void* allocate(std::size_t size);
+    void release(void* ptr, std::size_t size);
+
+    std::size_t allocations() { return allocations_; }
+    std::size_t slabs() { return slabs_; }
+    // Frames that did not fit a class.
+    std::size_t large() { return large_; }
+    std::size_t live() { return live_; }
+};
+extern FramePool coro_frames;
+
+// Awaiters park on an event here; the loop resumes them once it fires.
+struct EventWaiter {
+    EFI_EVENT event = nullptr;
+    std::coroutine_handle<> handle;
+    EventWaiter* next = nullptr;
+
+    // Registers with the current CoroLoop and returns true. Without one it
+    // blocks in wait_for() and returns false, so the caller resumes at once.
+    bool park(std::coroutine_handle<> handle);
+};
+
+// Drives coroutines started with spawn(). poll() never blocks and fits in a
+// render or scheduler tick; run() blocks in WaitForEvent until every spawned
+// coroutine has finished. One loop is current at a time, the newest.
+class CoroLoop {
+    static CoroLoop* active;
+
+    CoroLoop* outer;
+    EventWaiter* waiting = nullptr;
+    efi::vector<EFI_EVENT> events;
+    std::size_t live_ = 0;
+    std::size_t resumed_ = 0;
+public:
+    CoroLoop() : outer(active) { active = this; }
+    CoroLoop(const CoroLoop&) = delete;
+    ~CoroLoop() { active = outer; }
+
+    static CoroLoop* current() { return active; }
+
+    void add(EventWaiter& waiter);
+    // Resumes every coroutine whose event fired, returns how many.
+    std::size_t poll();
+    void run();
+
+    void started() { live_ += 1; }
+    void finished() { live_ -= 1; }
+    std::size_t live() { return live_; }
+    std::size_t resumed() { return resumed_; }
+};
+
+template<typename T> class Async;
+
+namespace detail {
+    struct AsyncPromiseBase {
+        std::coroutine_handle<> continuation;
+        CoroLoop* detached = nullptr;
+
+        static void* operator new(std::size_t size) noexcept {
+            return coro_frames.allocate(size);
+        }
+        static void operator delete(void* ptr, std::size_t size) {
+            coro_frames.release(ptr, size);
+        }
+
+        std::suspend_always initial_suspend() noexcept { return {}; }
+
+        // Hands control to whoever awaited this one, symmetric transfer keeps
+        // long await chains off the stack. Spawned coroutines free themselves.
+        struct FinalAwaiter {
+            bool await_ready() noexcept { return false; }
+            template<typename Promise>
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+                AsyncPromiseBase& promise = handle.promise();
+                if (promise.detached) {
+                    promise.detached->finished();
+                    handle.destroy();
+                    return std::noop_coroutine();
+                }
+                if (promise.continuation)
+                    return promise.continuation;
+                return std::noop_coroutine();
+            }
+            void await_resume() noexcept {}
+        };
+        FinalAwaiter final_suspend() noexcept { return {}; }
+        // Built with -fno-exceptions, nothing can arrive here.
+        void unhandled_exception() {}
+    };
+
+    template<typename T>
+    struct AsyncPromise : AsyncPromiseBase {
+        T value {};
+        Async<T> get_return_object();
+        static Async<T> get_return_object_on_allocation_failure();
+        void return_value(T v) { value = v; }
+        T result() { return value; }
+    };
+
+    template<>
+    struct AsyncPromise<void> : AsyncPromiseBase {
+        Async<void> get_return_object();
+        static Async<void> get_return_object_on_allocation_failure();
+        void return_void() {}
+        void result() {}
+    };
+}
+
+// Lazy coroutine returning T: the body starts when awaited or spawned. A
+// failed frame allocation gives an empty Async that yields T{} when awaited.
+template<typename T = void>
+class [[nodiscard]] Async {
+public:
+    typedef detail::AsyncPromise<T> promise_type;
+private:
+    std::coroutine_handle<promise_type> handle;
+    friend class CoroLoop;
+public:
+    explicit Async(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+    Async(Async&& other) : handle(other.handle) { other.handle = nullptr; }
+    Async(const Async&) = delete;
+    ~Async() {
+        if (handle)
+            handle.destroy();
+    }
+
+    bool valid() { return (bool)handle; }
+
+    bool await_ready() { return !handle || handle.done(); }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) {
+        handle.promise().continuation = awaiting;
+        return handle;
+    }
+    T await_resume() {
+        if (!handle)
+            return T();
+        return handle.promise().result();
+    }
+
+    // Starts the body on `loop` and lets it run on its own; the frame is
+    // freed when it finishes.
+    bool spawn(CoroLoop& loop) {
+        if (!handle)
+            return false;
+        std::coroutine_handle<promise_type> started = handle;
+        handle = nullptr;
+        started.promise().detached = &loop;
+        loop.started();
+        started.resume();
+        return true;
+    }
+};
+
+namespace detail {
+    template<typename T>
+    Async<T> AsyncPromise<T>::get_return_object() {
+        return Async<T>(std::coroutine_handle<AsyncPromise<T>>::from_promise(*this));
+    }
+    template<typename T>
+    Async<T> AsyncPromise<T>::get_return_object_on_allocation_failure() {
+        return Async<T>(nullptr);
+    }
+    inline Async<void> AsyncPromise<void>::get_return_object() {
+        return Async<void>(std::coroutine_handle<AsyncPromise<void>>::from_promise(*this));
+    }
+    inline Async<void> AsyncPromise<void>::get_return_object_on_allocation_failure() {
+        return Async<void>(nullptr);
+    }
+}
+
+// co_await wait_event(e): resumes once `e` is signaled, consuming the signal.
+class EventAwait {
+    EventWaiter waiter;
+public:
+    explicit EventAwait(EFI_EVENT event) { waiter.event = event; }
+    bool await_ready() { return check_event(waiter.event); }
+    bool await_suspend(std::coroutine_handle<> handle) { return waiter.park(handle); }
+    void await_resume() {}
+};
+inline EventAwait wait_event(EFI_EVENT event) {
+    return EventAwait(event);
+}
+
+// co_await delay(us): a one-shot timer event, closed on resume.
+class DelayAwait {
+    EventWaiter waiter;
+    std::size_t us;
+public:
+    explicit DelayAwait(std::size_t us) : us(us) {}
+    ~DelayAwait();
+    bool await_ready() { return us == 0; }
+    bool await_suspend(std::coroutine_handle<> handle);
+    void await_resume() {}
+};
+inline DelayAwait delay(std::size_t us) {
+    return DelayAwait(us);
+}
+
+// TCP4 operations as awaitables. The token lives in the awaiter, which sits
+// in the coroutine frame for as long as the operation is in flight.
+class AsyncTcp {
+    EFI_TCP4* tcp;
+public:
+    explicit AsyncTcp(EFI_TCP4* tcp) : tcp(tcp) {}
+
+    class ConnectAwait {
+        EFI_TCP4* tcp;
+        EFI_TCP4_CONNECTION_TOKEN token {};
+        EventWaiter waiter;
+        EFI_STATUS status = EFI_SUCCESS;
+    public:
+        explicit ConnectAwait(EFI_TCP4* tcp) : tcp(tcp) {}
+        bool await_ready() { return false; }
+        bool await_suspend(std::coroutine_handle<> handle);
+        EFI_STATUS await_resume();
+    };
+
+    // Resumes with the bytes moved, 0 on error or a closed connection.
+    class IoAwait {
+        EFI_TCP4* tcp;
+        bool transmit;
+        EFI_TCP4_IO_TOKEN token {};
+        union {
+            EFI_TCP4_TRANSMIT_DATA tx;
+            EFI_TCP4_RECEIVE_DATA rx;
+        };
+        EventWaiter waiter;
+        EFI_STATUS status = EFI_SUCCESS;
+    public:
+        IoAwait(EFI_TCP4* tcp, bool transmit, void* buffer, std::size_t n);
+        bool await_ready() { return false; }
+        bool await_suspend(std::coroutine_handle<> handle);
+        std::size_t await_resume();
+    };
+
+    ConnectAwait connect() { return ConnectAwait(tcp); }
+    IoAwait send(const void* buffer, std::size_t n) { return IoAwait(tcp, true, (void*)buffer, n); }
+    IoAwait recv(void* buffer, std::size_t n) { return IoAwait(tcp, false, buffer, n); }
+    Async<bool> send_all(const void* buffer, std::size_t n);
+    Async<bool> recv_all(void* buffer, std::size_t n);
+};
+
+// co_await read_file(file, buffer, n): ReadEx on file protocol revision 2,
+// otherwise a plain Read without suspending. Resumes with the bytes read.
+class FileReadAwait {
+    EFI_FILE_PROTOCOL* file;
+    EFI_FILE_IO_TOKEN token {};
+    EventWaiter waiter;
+    std::size_t got = 0;
+    bool failed = false;
+public:
+    FileReadAwait(EFI_FILE_PROTOCOL* file, void* buffer, std::size_t n);
+    bool await_ready() { return false; }
+    bool await_suspend(std::coroutine_handle<> handle);
+    std::size_t await_resume();
+};
+inline FileReadAwait read_file(EFI_FILE_PROTOCOL* file, void* buffer, std::size_t n) {
+    return FileReadAwait(file, buffer, n);
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "uefi.h"
+
+efi::vector<EFI_GRAPHICS_OUTPUT_PROTOCOL*> open_screens();
+
+class Screen {
+    EFI_GRAPHICS_OUTPUT_PROTOCOL* interface;
+public:
+    Screen(EFI_GRAPHICS_OUTPUT_PROTOCOL* interface) :interface(interface) {}
+    EFI_STATUS blt(
+                EFI_GRAPHICS_OUTPUT_BLT_PIXEL* buffer,
+                EFI_GRAPHICS_OUTPUT_BLT_OPERATION   BltOperation,
+                UINTN SourceX,
+                UINTN SourceY,
+                UINTN DestinationX,
+                UINTN DestinationY,
+                UINTN Width,
+                UINTN Height,
+                UINTN Delta
+            ) {
+        return uefi(interface->Blt, interface, buffer, BltOperation, SourceX, SourceY, DestinationX,  DestinationY, Width, Height, Delta);
+    }
+    EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE* get_mode() {
+        return interface->Mode;
+    }
+};
+
+// The app composes each frame in an 800x600 BLT buffer and blits it once.
+constexpr std::size_t CANVAS_WIDTH = 800;
+constexpr std::size_t CANVAS_HEIGHT = 600;
+
+// Fills the top left w x h pixels.
+void fill(EFI_GRAPHICS_OUTPUT_BLT_PIXEL* fb, std::size_t w, std::size_t h, EFI_GRAPHICS_OUTPUT_BLT_PIXEL color);
+// White 5x7 glyphs, x is the row and y the column; characters are 5 pixels apart.
+void putc(EFI_GRAPHICS_OUTPUT_BLT_PIXEL* fb, char c, std::size_t x, std::size_t y);
+void print(EFI_GRAPHICS_OUTPUT_BLT_PIXEL* fb, const char* text, std::size_t x, std::size_t y);
@@ -0,0 +1,105 @@
+#pragma once
+
+#include "uefi.h"
+
+class FiberRuntime;
+
+// One stackful coroutine. The stack comes from AllocatePages and is kept on
+// the runtime's free list after the fiber finishes, so spawning again costs
+// no firmware call.
+class Fiber {
+    friend class FiberRuntime;
+    friend void fiber_start(Fiber* fiber);
+
+    enum State : UINT8 { FiberReady = 1, FiberWaiting = 2, FiberDone = 3 };
+
+    void* sp = nullptr;
+    char* stack = nullptr;
+    FiberRuntime* runtime = nullptr;
+    void (*entry)(void*) = nullptr;
+    void* arg = nullptr;
+    EFI_EVENT waiting_on = nullptr;
+    Fiber* next = nullptr;
+    State state = FiberReady;
+};
+
+// Cooperative fibers run by run() on the caller's stack. A fiber gives up the
+// CPU only in yield() or wait(); while every fiber is waiting, run() blocks in
+// WaitForEvent on all of their events, so the firmware idles the CPU.
+// Must be driven at TPL_APPLICATION.
+class FiberRuntime {
+    static FiberRuntime* active;
+
+    std::size_t stack_size;
+    Fiber* ready_head = nullptr;
+    Fiber* ready_tail = nullptr;
+    Fiber* waiting = nullptr;
+    Fiber* free_list = nullptr;
+    Fiber* current_ = nullptr;
+    void* main_sp = nullptr;
+    efi::vector<EFI_EVENT> events;
+
+    std::size_t live_ = 0;
+    std::size_t spawned_ = 0;
+    std::size_t switches_ = 0;
+    std::size_t stacks_ = 0;
+
+    Fiber* allocate();
+    bool spawn(void (*entry)(void*), void* arg, std::size_t arg_size, Fiber* fiber);
+    void make_ready(Fiber* fiber);
+    void switch_to(Fiber* fiber);
+    void suspend();
+    void wake_signaled();
+    void finish(Fiber* fiber);
+    friend void fiber_start(Fiber* fiber);
+public:
+    // 16 KiB holds the network helpers and a few frames of caller code; a
+    // thousand fibers then cost 16 MiB. Rounded up to whole pages.
+    explicit FiberRuntime(std::size_t stack_size = 16 * 1024);
+    FiberRuntime(const FiberRuntime&) = delete;
+    ~FiberRuntime();
+
+    // Starts `fn` on a new fiber. The callable is moved onto the top of the
+    // fiber's stack, nothing is heap allocated.
+    template<typename Fn>
+    bool spawn(Fn fn) {
+        Fiber* fiber = allocate();
+        if (fiber == nullptr)
+            return false;
+        void* slot = fiber->stack + stack_size - ((sizeof(Fn) + 15) & ~(std::size_t)15);
+        new (slot) Fn(static_cast<Fn&&>(fn));
+        return spawn([](void* p) {
+            Fn* fn = (Fn*)p;
+            (*fn)();
+            fn->~Fn();
+        }, slot, sizeof(Fn), fiber);
+    }
+
+    // Runs fibers until all of them have returned.
+    void run();
+    // Back of the ready queue.
+    void yield();
+    // Parks the current fiber until `event` is signaled, consuming the signal
+    // like wait_for(). Outside a fiber it just waits.
+    EFI_STATUS wait(EFI_EVENT event);
+
+    // The runtime inside run(), nullptr elsewhere.
+    static FiberRuntime* current() { return active; }
+    bool in_fiber() { return current_ != nullptr; }
+
+    std::size_t live() { return live_; }
+    std::size_t spawned() { return spawned_; }
+    std::size_t switches() { return switches_; }
+    // Stacks allocated so far, live or on the free list.
+    std::size_t stacks() { return stacks_; }
+};
+
+// wait_for() and sleep() check for a running fiber and park only it, so the
+// blocking helpers built on them (connect, send, recv and close in net.h,
+// the sockets, RxPool) already suspend just the calling fiber. Elsewhere
+// they block as before.
+
+// A timer event instead of Stall, other fibers run meanwhile.
+EFI_STATUS fiber_sleep(std::size_t us);
+// ReadEx on file protocol revision 2, a plain Read before that.
+std::size_t fiber_read(EFI_FILE_PROTOCOL* file, void* buffer, std::size_t n);
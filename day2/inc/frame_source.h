@@ -0,0 +1,93 @@
+#pragma once
+
+#include "uefi.h"
+
+// nyan.bin layout: packed 24-bit RGB frames, one after another.
+constexpr std::size_t FRAME_WIDTH = 720;
+constexpr std::size_t FRAME_HEIGHT = 480;
+constexpr std::size_t FRAME_BYTES = FRAME_WIDTH * FRAME_HEIGHT * 3;
+constexpr std::size_t NYAN_FRAMES = 11;
+
+// Converts rows [first, end) of a packed RGB frame into BLT pixels, row r
+// going to out + r * stride. Rows share nothing, so ranges can run on
+// different CPUs.
+void convert_frame_rows(const char* rgb, EFI_GRAPHICS_OUTPUT_BLT_PIXEL* out, std::size_t stride,
+                        std::size_t first, std::size_t end);
+
+class FrameSource {
+public:
+    virtual ~FrameSource() = default;
+    // Frame to show next or nullptr if nothing has arrived yet.
+    // The pointer stays valid until the following call.
+    virtual const char* next_frame() = 0;
+};
+
+// Loops over frames already loaded into memory (nyan.bin). A null buffer,
+// the asset failed to load, never yields a frame.
+class FileFrameSource : public FrameSource {
+    const char* buffer;
+    std::size_t frames;
+    std::size_t frame = 0;
+public:
+    FileFrameSource(const char* buffer, std::size_t frames) : buffer(buffer), frames(frames) {}
+    const char* next_frame() override;
+};
+
+// Stream header sent by tools/frame_server.py right after the connection is accepted.
+struct FrameStreamHeader {
+    UINT32 magic;
+    UINT16 width;
+    UINT16 height;
+    UINT32 frame_bytes;
+    UINT32 frame_count;
+};
+constexpr UINT32 FRAME_STREAM_MAGIC = 0x4e41594e; // "NYAN"
+
+// Plays frames streamed over an already connected TCP4 socket.
+// Frames land directly in a ring of slots (the jitter buffer); a receive is
+// always kept posted into the next free slot so the stream is prefetched while
+// the current frame is on screen. Playback starts once `prebuffer` frames are
+// ready and falls back to buffering, holding the last frame, on underrun.
+class NetFrameSource : public FrameSource {
+    EFI_TCP4* tcp = nullptr;
+    char* slots = nullptr;
+    std::size_t slot_count;
+    std::size_t prebuffer;
+
+    std::size_t head = 0;
+    std::size_t ready = 0;
+    bool holding = false;
+    bool buffering = true;
+
+    EFI_TCP4_IO_TOKEN token;
+    EFI_TCP4_RECEIVE_DATA rx;
+    bool pending = false;
+    std::size_t filled = 0;
+    EFI_STATUS status_ = EFI_SUCCESS;
+
+    std::size_t received_ = 0;
+    std::size_t underruns_ = 0;
+
+    char* slot(std::size_t n) {
+        return slots + (n % slot_count) * FRAME_BYTES;
+    }
+    std::size_t free_slots() {
+        return slot_count - ready - (holding ? 1 : 0);
+    }
+    EFI_STATUS post_receive();
+public:
+    NetFrameSource(std::size_t slot_count, std::size_t prebuffer) : slot_count(slot_count), prebuffer(prebuffer) {}
+    NetFrameSource(const NetFrameSource&) = delete;
+    ~NetFrameSource();
+
+    // Reads and validates the stream header, then starts prefetching.
+    EFI_STATUS open(EFI_TCP4* tcp);
+    // Reaps a completed receive and posts the next one. Never blocks.
+    void pump();
+    const char* next_frame() override;
+
+    EFI_STATUS status() { return status_; }
+    std::size_t received() { return received_; }
+    std::size_t underruns() { return underruns_; }
+    std::size_t buffered() { return ready; }
+};
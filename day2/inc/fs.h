@@ -0,0 +1,63 @@
+#pragma once
+
+#include <type_traits>
+
+#include "uefi.h"
+#include "status.h"
+#include "text.h"
+
+struct FileStats {
+    std::size_t reads;
+    std::size_t read_bytes;
+    std::size_t writes;
+    std::size_t write_bytes;
+};
+extern FileStats file_stats;
+
+void fclose(EFI_FILE_PROTOCOL* file);
+Result<EFI_FILE_PROTOCOL*> fopen(EFI_FILE_PROTOCOL* root, const wchar_t* name, std::size_t mode, std::size_t attributes);
+// Root of the first volume that has `name`, EFI_NOT_FOUND if none does.
+Result<EFI_FILE_PROTOCOL*> open_fs_with_file(const wchar_t* name);
+// Bytes read or written; a failure loses the count of a partial transfer.
+Result<std::size_t> fread(EFI_FILE_PROTOCOL* file, char* buffer, std::size_t n);
+Result<std::size_t> fwrite(EFI_FILE_PROTOCOL* file, char* buffer, std::size_t n);
+// Allocated with malloc, the caller frees it.
+Result<EFI_FILE_INFO*> finfo(EFI_FILE_PROTOCOL* file);
+// Replaces `name` in `root` with an empty file open for writing.
+Result<EFI_FILE_PROTOCOL*> fcreate(EFI_FILE_PROTOCOL* root, const wchar_t* name);
+
+// Receives a stream in pieces; returns false to stop.
+typedef bool (*StreamSink)(void* ctx, const char* data, std::size_t n);
+// Produces a stream into `sink`, e.g. trace_write_json(); the result is
+// whatever the producer counts.
+typedef std::size_t (*StreamProducer)(StreamSink sink, void* ctx);
+
+// Batches a stream into a buffer on the stack and passes full ones to the
+// sink. Once the sink refuses a piece the rest is dropped.
+class SinkWriter {
+    StreamSink sink;
+    void* ctx;
+    char buffer[4096];
+    TextWriter out { buffer, sizeof(buffer) };
+    bool failed_ = false;
+public:
+    SinkWriter(StreamSink sink, void* ctx) : sink(sink), ctx(ctx) {}
+
+    // The buffer, flushed first unless `n` more bytes fit; for text.
+    TextWriter& reserve(std::size_t n);
+    // Raw bytes of any length.
+    void put(const void* data, std::size_t n);
+    template<typename T>
+    void put(T value) {
+        static_assert(std::is_arithmetic<T>::value, "pass pointers with a length");
+        put(&value, sizeof(value));
+    }
+    void flush();
+    bool failed() { return failed_; }
+};
+
+// Replaces `name` in `root` with what `produce` streams, its count goes to
+// `count`. EFI_VOLUME_FULL or the write status when the file stopped taking
+// the stream.
+EFI_STATUS fwrite_stream(EFI_FILE_PROTOCOL* root, const wchar_t* name, StreamProducer produce,
+                         std::size_t* count = nullptr);
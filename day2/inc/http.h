@@ -0,0 +1,104 @@
+#pragma once
+
+#include "tcp_server.h"
+#include "text.h"
+
+struct HttpRequest {
+    const char* method;
+    std::size_t method_length;
+    const char* path;
+    std::size_t path_length;
+    bool keep_alive;
+};
+
+class HttpResponse {
+    friend class HttpServer;
+
+    UINT16 status = 200;
+    const char* content_type = "text/plain; charset=utf-8";
+    TextWriter body_;
+    const void* attached = nullptr;
+    std::size_t attached_size = 0;
+public:
+    HttpResponse(char* buffer, std::size_t capacity) : body_(buffer, capacity) {}
+
+    void set_status(UINT16 status) { this->status = status; }
+    void set_content_type(const char* type) { content_type = type; }
+    // Goes out copied, ahead of any attached data.
+    TextWriter& body() { return body_; }
+    // Appends `size` bytes by reference. The route has to keep them unchanged
+    // until its release() is called.
+    void attach(const void* data, std::size_t size) {
+        attached = data;
+        attached_size = size;
+    }
+};
+
+class HttpRoute {
+public:
+    virtual void serve(const HttpRequest& request, HttpResponse& response) = 0;
+    // One response that used attach() has been fully transmitted.
+    virtual void release() {}
+};
+
+// HTTP/1.1 server over TcpServer with keep-alive and pipelining. Requests are
+// parsed straight out of a preallocated per-connection buffer and answered in
+// order; a connection that cannot take another response right now keeps its
+// remaining requests buffered until its transmit queue drains. GET and HEAD
+// only, request bodies are skipped.
+class HttpServer : public TcpHandler {
+public:
+    static constexpr std::size_t REQUEST_SIZE = 4096;
+    static constexpr std::size_t BODY_SIZE = 16 * 1024;
+    static constexpr std::size_t HEADER_SIZE = 256;
+    static constexpr std::size_t MAX_ROUTES = 8;
+private:
+    struct Connection {
+        char* buffer;
+        std::size_t length;
+        HttpRoute* holding;
+        std::size_t held;
+    };
+    struct Route {
+        const char* path;
+        HttpRoute* route;
+    };
+
+    TcpServer server;
+    efi::vector<Connection> connections;
+    char* request_space = nullptr;
+    char* scratch = nullptr;
+    Route routes[MAX_ROUTES];
+    std::size_t route_count = 0;
+
+    std::size_t requests_ = 0;
+    std::size_t pipelined_ = 0;
+    std::size_t errors_ = 0;
+
+    void process(TcpClient& client);
+    // Parses and answers one request from the front of the buffer. Returns the
+    // bytes it consumed, or 0 when it needs more data or transmit space.
+    std::size_t handle_one(TcpClient& client, Connection& connection);
+    void send_response(TcpClient& client, HttpResponse& response, bool keep_alive, bool head);
+    void fail(TcpClient& client, UINT16 status);
+    void drop_held(Connection& connection);
+public:
+    HttpServer(std::size_t max_clients);
+    HttpServer(const HttpServer&) = delete;
+    ~HttpServer();
+
+    bool route(const char* path, HttpRoute& route);
+    EFI_STATUS open(EFI_SERVICE_BINDING* service, UINT16 port);
+    // Call once per frame; never blocks.
+    void poll() { server.poll(); }
+
+    void on_accept(TcpClient& client) override;
+    void on_data(TcpClient& client, const char* data, std::size_t n) override;
+    void on_sent(TcpClient& client) override;
+    void on_close(TcpClient& client) override;
+
+    TcpServer& tcp() { return server; }
+    std::size_t requests() { return requests_; }
+    std::size_t pipelined() { return pipelined_; }
+    std::size_t errors() { return errors_; }
+};
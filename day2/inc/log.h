@@ -0,0 +1,89 @@
+#pragma once
+
+#include "uefi.h"
+#include "text.h"
+#include "clock.h"
+#include "queue.h"
+
+// Leveled logging to COM1. A log call formats into a fixed-size record and
+// pushes it onto a lock-free queue, a few hundred ns; log_drain(), run from a
+// scheduler task, writes the records out through the UART FIFO a batch at a
+// time and never waits for it. Print goes through the firmware console,
+// which redraws glyphs into the GOP on every call.
+//
+//     log_line(LogInfo).put("frames ").put(shown);
+//
+// Safe from TPL callbacks and APs. A full queue drops the record and counts
+// it, a long line is cut at LOG_TEXT characters.
+
+enum LogLevel : UINT8 {
+    LogDebug = 0,
+    LogInfo = 1,
+    LogWarn = 2,
+    LogError = 3,
+};
+
+constexpr std::size_t LOG_TEXT = 54;
+constexpr std::size_t LOG_RECORDS = 512;
+
+struct LogRecord {
+    UINT64 tsc;
+    UINT8 level;
+    UINT8 length;
+    char text[LOG_TEXT];
+};
+
+struct LogStats {
+    std::atomic<UINT64> records {0};
+    std::atomic<UINT64> truncated {0};
+    UINT64 written = 0;      // bytes sent to the UART
+};
+
+struct LogState {
+    std::atomic<UINT8> level {LogInfo};
+    MpscQueue<LogRecord, LOG_RECORDS> queue;
+    LogStats stats;
+};
+extern LogState log_state;
+
+// Programs COM1 for 115200 8N1 with the FIFO on, the settings OVMF uses for
+// its own serial console.
+void log_init(LogLevel level = LogInfo);
+void log_set_level(LogLevel level);
+inline bool log_enabled(LogLevel level) {
+    return level >= log_state.level.load(std::memory_order_relaxed);
+}
+const char* log_level_name(LogLevel level);
+
+// Formats into the record in place and queues it when destroyed, at the end
+// of the statement that created it.
+class LogLine {
+    LogRecord record;
+    TextWriter out;
+    bool enabled;
+public:
+    explicit LogLine(LogLevel level)
+        : out(record.text, log_enabled(level) ? LOG_TEXT : 0), enabled(log_enabled(level)) {
+        record.level = level;
+        record.tsc = enabled ? rdtsc() : 0;
+    }
+    LogLine(const LogLine&) = delete;
+    ~LogLine();
+
+    template<typename T>
+    TextWriter& put(T value) {
+        return out.put(value);
+    }
+};
+
+inline LogLine log_line(LogLevel level) {
+    return LogLine(level);
+}
+void log_text(LogLevel level, const char* text);
+
+// Sends queued records until the UART has no room left or `max_bytes` went
+// out, returns the bytes written. Call it periodically.
+std::size_t log_drain(std::size_t max_bytes = 4096);
+// Writes everything queued, waiting on the UART. Before exiting or resetting.
+// Both drain functions belong to one CPU, the queue has a single consumer.
+void log_flush();
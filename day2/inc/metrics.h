@@ -0,0 +1,44 @@
+#pragma once
+
+#include "text.h"
+#include "scheduler.h"
+#include "sync.h"
+
+// Fixed-bucket histogram in the Prometheus cumulative layout. Bounds are
+// upper limits in the unit the caller observes in, the last bucket is +Inf.
+class Histogram {
+public:
+    static constexpr std::size_t MAX_BUCKETS = 16;
+private:
+    UINT64 bounds[MAX_BUCKETS];
+    UINT64 counts[MAX_BUCKETS + 1] = {};
+    std::size_t bucket_count;
+    UINT64 sum_ = 0;
+    UINT64 count_ = 0;
+public:
+    Histogram(const UINT64* bounds, std::size_t n);
+
+    void observe(UINT64 value);
+    // `scale` divides bounds and sum on output, e.g. 1'000'000 to print us as seconds.
+    void write(TextWriter& out, const char* name, const char* help, UINT64 scale);
+
+    UINT64 sum() { return sum_; }
+    UINT64 count() { return count_; }
+};
+
+// Prometheus text exposition helpers.
+void write_metric(TextWriter& out, const char* name, const char* type, const char* help, UINT64 value);
+// Writes value / scale with up to six decimals.
+void write_scaled(TextWriter& out, UINT64 value, UINT64 scale);
+// Uptime, TSC rate, allocator, file and TCP totals.
+void write_system_metrics(TextWriter& out);
+// Per-task runs, deadline misses and CPU share, labelled task="name".
+void write_task_metrics(TextWriter& out, Scheduler& scheduler);
+// Acquisitions, contention and hold times of every track_lock()ed lock,
+// labelled lock="name".
+void write_lock_metrics(TextWriter& out);
+// Log records, drops and bytes sent to the serial port.
+void write_log_metrics(TextWriter& out);
+// Failures per report_error() call site, labelled site="file:line",
+// what="..." and status="EFI_...", the last status seen there.
+void write_error_metrics(TextWriter& out);
@@ -0,0 +1,247 @@
+#pragma once
+
+#include "uefi.h"
+#include "status.h"
+
+// Totals over the blocking send()/recv() path.
+struct TcpStats {
+    std::size_t sends;
+    std::size_t send_bytes;
+    std::size_t recvs;
+    std::size_t recv_bytes;
+    std::size_t errors;
+};
+extern TcpStats tcp_stats;
+
+efi::vector<EFI_SERVICE_BINDING*> get_tcp4_services();
+efi::vector<EFI_SERVICE_BINDING*> get_tcp6_services();
+EFI_STATUS socket_config(EFI_TCP4* tcp, EFI_TCP4_CONFIG_DATA& config);
+EFI_STATUS socket_config(EFI_TCP6* tcp, EFI_TCP6_CONFIG_DATA& config);
+EFI_STATUS connect(EFI_TCP4* tcp);
+EFI_STATUS connect(EFI_TCP6* tcp);
+// Spins up to `spin_budget` rounds of tcp->Poll plus CheckEvent before
+// falling back to WaitForEvent. Polling drives the driver directly, so a
+// completion is seen without waiting for the next firmware timer tick.
+EFI_STATUS await_completion(EFI_TCP4* tcp, EFI_EVENT event, std::size_t spin_budget);
+EFI_STATUS await_completion(EFI_TCP6* tcp, EFI_EVENT event, std::size_t spin_budget);
+// Bytes moved. recv() gives 0 with EFI_SUCCESS once the peer has closed.
+Result<std::size_t> send(EFI_TCP4* tcp, char* buffer, std::size_t n, std::size_t spin_budget = 0);
+Result<std::size_t> send(EFI_TCP6* tcp, char* buffer, std::size_t n, std::size_t spin_budget = 0);
+Result<std::size_t> recv(EFI_TCP4* tcp, char* buffer, std::size_t n, std::size_t spin_budget = 0);
+Result<std::size_t> recv(EFI_TCP6* tcp, char* buffer, std::size_t n, std::size_t spin_budget = 0);
+void close(EFI_TCP4* tcp);
+void close(EFI_TCP6* tcp);
+
+struct Endpoint {
+    EFI_IPv4_ADDRESS address;
+    UINT16 port;
+
+    bool operator==(const Endpoint& other) const {
+        for (std::size_t i=0; i < 4; ++i) {
+            if (address.Addr[i] != other.address.Addr[i])
+                return false;
+        }
+        return port == other.port;
+    }
+};
+
+// EDK2's TCP driver takes buffer sizes in [8 KiB, 2 MiB] and silently uses
+// its 2 MiB default for anything outside, so larger requests buy nothing.
+constexpr UINT32 TCP_MAX_BUFFER = 2 * 1024 * 1024;
+
+// Builds an EFI_TCP4_CONFIG_DATA field by field instead of a positional
+// aggregate. Defaults: default station address, ephemeral local port, active
+// open, TTL 255. Control options are only handed to the driver once one of the
+// option setters is used; the flags then start from the EDK2 defaults and
+// zero sizes/timeouts mean "driver default".
+class TcpConfig {
+    EFI_TCP4_CONFIG_DATA data {};
+    EFI_TCP4_OPTION option {};
+    bool has_option = false;
+
+    EFI_TCP4_OPTION& control() {
+        has_option = true;
+        return option;
+    }
+public:
+    TcpConfig() {
+        data.TimeToLive = 255;
+        data.AccessPoint.UseDefaultAddress = TRUE;
+        data.AccessPoint.ActiveFlag = TRUE;
+        option.EnableNagle = TRUE;
+        option.EnableTimeStamp = TRUE;
+        option.EnableWindowScaling = TRUE;
+    }
+
+    TcpConfig& station(const EFI_IPv4_ADDRESS& address, const EFI_IPv4_ADDRESS& netmask) {
+        data.AccessPoint.UseDefaultAddress = FALSE;
+        data.AccessPoint.StationAddress = address;
+        data.AccessPoint.SubnetMask = netmask;
+        return *this;
+    }
+    TcpConfig& local_port(UINT16 port) {
+        data.AccessPoint.StationPort = port;
+        return *this;
+    }
+    // Listen instead of connecting; with no remote() any peer is accepted.
+    TcpConfig& passive() {
+        data.AccessPoint.ActiveFlag = FALSE;
+        return *this;
+    }
+    TcpConfig& remote(const Endpoint& endpoint) {
+        data.AccessPoint.RemoteAddress = endpoint.address;
+        data.AccessPoint.RemotePort = endpoint.port;
+        return *this;
+    }
+    TcpConfig& type_of_service(UINT8 tos) {
+        data.TypeOfService = tos;
+        return *this;
+    }
+    TcpConfig& time_to_live(UINT8 ttl) {
+        data.TimeToLive = ttl;
+        return *this;
+    }
+
+    TcpConfig& receive_buffer(UINT32 bytes) {
+        control().ReceiveBufferSize = bytes;
+        return *this;
+    }
+    TcpConfig& send_buffer(UINT32 bytes) {
+        control().SendBufferSize = bytes;
+        return *this;
+    }
+    TcpConfig& connection_timeout(UINT32 seconds) {
+        control().ConnectionTimeout = seconds;
+        return *this;
+    }
+    TcpConfig& keep_alive(UINT32 probes, UINT32 idle_seconds, UINT32 interval_seconds) {
+        control().KeepAliveProbes = probes;
+        option.KeepAliveTime = idle_seconds;
+        option.KeepAliveInterval = interval_seconds;
+        return *this;
+    }
+    TcpConfig& nagle(bool enable) {
+        control().EnableNagle = enable;
+        return *this;
+    }
+    TcpConfig& window_scaling(bool enable) {
+        control().EnableWindowScaling = enable;
+        return *this;
+    }
+    TcpConfig& timestamps(bool enable) {
+        control().EnableTimeStamp = enable;
+        return *this;
+    }
+    TcpConfig& selective_ack(bool enable) {
+        control().EnableSelectiveAck = enable;
+        return *this;
+    }
+
+    // Large windows for asset and frame streaming: buffers at the firmware
+    // cap so window scaling can open the window beyond 64 KiB, Nagle left on
+    // to coalesce.
+    static TcpConfig bulk() {
+        TcpConfig config;
+        config.receive_buffer(TCP_MAX_BUFFER).send_buffer(TCP_MAX_BUFFER)
+            .window_scaling(true).timestamps(true).nagle(true);
+        return config;
+    }
+    // Small request/response traffic such as the control channel: Nagle off
+    // so short writes leave immediately, modest buffers.
+    static TcpConfig latency() {
+        TcpConfig config;
+        config.receive_buffer(64 * 1024).send_buffer(64 * 1024).nagle(false);
+        return config;
+    }
+
+    Endpoint remote() const {
+        return { data.AccessPoint.RemoteAddress, data.AccessPoint.RemotePort };
+    }
+
+    // The same settings for TCP6: TypeOfService becomes TrafficClass, TTL the
+    // hop limit, addresses are left to the caller. `control` backs ControlOption.
+    void to_tcp6(EFI_TCP6_CONFIG_DATA& config, EFI_TCP6_OPTION& control);
+
+    // Points ControlOption at this object, keep it alive until Configure returns.
+    EFI_TCP4_CONFIG_DATA& get() {
+        data.ControlOption = has_option ? &option : nullptr;
+        return data;
+    }
+};
+
+// Owns one TCP4 child: CreateChild, Configure and Connect on open(),
+// Close and DestroyChild on close() or destruction.
+class TcpConnection {
+    EFI_SERVICE_BINDING* service = nullptr;
+    EFI_HANDLE handle = nullptr;
+    EFI_TCP4* tcp_ = nullptr;
+    Endpoint remote_ {};
+    std::size_t spin_budget = 0;
+public:
+    TcpConnection() = default;
+    TcpConnection(const TcpConnection&) = delete;
+    TcpConnection& operator=(const TcpConnection&) = delete;
+    ~TcpConnection() {
+        close();
+    }
+
+    EFI_STATUS open(EFI_SERVICE_BINDING* service, TcpConfig& config);
+    void close();
+
+    // Latency mode: spin this many Poll rounds on each send/recv before
+    // blocking. 0 (the default) always blocks.
+    void busy_poll(std::size_t spins) {
+        spin_budget = spins;
+    }
+
+    Result<std::size_t> send(char* buffer, std::size_t n) {
+        return ::send(tcp_, buffer, n, spin_budget);
+    }
+    Result<std::size_t> recv(char* buffer, std::size_t n) {
+        return ::recv(tcp_, buffer, n, spin_budget);
+    }
+    // False on an error, reported through check(), or when the peer closed
+    // before `n` bytes.
+    bool send_all(const void* buffer, std::size_t n);
+    bool recv_all(void* buffer, std::size_t n);
+
+    // True while the driver reports the connection as established.
+    bool established();
+    bool is_open() { return tcp_ != nullptr; }
+    EFI_TCP4* tcp() { return tcp_; }
+    const Endpoint& remote() { return remote_; }
+};
+
+// Keeps established connections around after a transfer so the next one to
+// the same endpoint skips CreateChild and the handshake. Idle connections
+// are checked before reuse and the least recently used one is closed when
+// every entry is taken. Connections should be configured with keep_alive()
+// so a dead peer is noticed while they sit idle.
+class ConnectionPool {
+    struct Entry {
+        TcpConnection connection;
+        bool in_use = false;
+        std::size_t last_used = 0;
+    };
+
+    EFI_SERVICE_BINDING* service;
+    TcpConfig base;
+    efi::vector<Entry> entries;
+    std::size_t clock = 0;
+    std::size_t reused_ = 0;
+    std::size_t opened_ = 0;
+public:
+    ConnectionPool(EFI_SERVICE_BINDING* service, const TcpConfig& base, std::size_t capacity)
+        : service(service), base(base), entries(capacity) {}
+    ConnectionPool(const ConnectionPool&) = delete;
+
+    // An established connection to `remote`. EFI_OUT_OF_RESOURCES when every
+    // slot is in use, otherwise the status of the failed open.
+    Result<TcpConnection*> acquire(const Endpoint& remote);
+    // Hands a connection back. Pass reusable = false after a protocol error.
+    void release(TcpConnection* connection, bool reusable = true);
+    void close_all();
+
+    std::size_t reused() { return reused_; }
+    std::size_t opened() { return opened_; }
+};
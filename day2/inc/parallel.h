@@ -0,0 +1,78 @@
+#pragma once
+
+#include <atomic>
+
+#include "uefi.h"
+#include "mp_services.h"
+
+// Splits loops across the BSP and the application processors of the PI MP
+// Services protocol. Each AP is started once, non-blocking, through
+// StartupThisAP and then spins on a job counter: EDK2 only notices that an AP
+// finished on a 100 ms timer, far too slow to start APs per frame.
+// Bodies run on APs too, so they must not call boot services or Print.
+// Without the protocol or with a single CPU everything runs inline.
+class CpuPool {
+    typedef void (*RangeFn)(void* ctx, std::size_t begin, std::size_t end);
+
+    struct Worker {
+        CpuPool* pool;
+        UINTN processor;
+        EFI_EVENT stopped;
+        std::size_t chunks;
+    };
+
+    EFI_MP_SERVICES_PROTOCOL* mp = nullptr;
+    efi::vector<Worker> workers;
+    std::size_t running = 0;
+
+    // The current job, written by the BSP before `generation` moves on.
+    RangeFn fn = nullptr;
+    void* ctx = nullptr;
+    std::size_t count = 0;
+    std::size_t grain = 1;
+    // Separate lines, the APs hammer `next` while the BSP polls `pending`.
+    alignas(64) std::atomic<std::size_t> next {0};
+    alignas(64) std::atomic<std::size_t> pending {0};
+    alignas(64) std::atomic<UINT32> generation {0};
+    std::atomic<bool> quit {false};
+
+    std::size_t jobs_ = 0;
+    std::size_t inline_chunks_ = 0;
+
+    static void MSABI worker_main(void* arg);
+    std::size_t run_chunks();
+    void dispatch(std::size_t n, std::size_t grain, RangeFn fn, void* ctx);
+public:
+    CpuPool() = default;
+    CpuPool(const CpuPool&) = delete;
+    ~CpuPool() { close(); }
+
+    // Starts a worker on up to `max_aps` enabled APs.
+    EFI_STATUS open(std::size_t max_aps = ~(std::size_t)0);
+    // Stops the workers, they leave their spin loop and return to the firmware.
+    void close();
+
+    // CPUs taking part in parallel_for(), the BSP included.
+    std::size_t cpus() { return running + 1; }
+
+    // Calls fn(begin, end) on chunks of at most `grain` items covering [0, n)
+    // and returns once all of them are done. The BSP takes chunks as well.
+    template<typename Fn>
+    void parallel_for(std::size_t n, std::size_t grain, Fn fn) {
+        dispatch(n, grain, [](void* ctx, std::size_t begin, std::size_t end) {
+            (*(Fn*)ctx)(begin, end);
+        }, &fn);
+    }
+    // Runs fn(i) for every i in [0, n), one task per chunk.
+    template<typename Fn>
+    void run_tasks(std::size_t n, Fn fn) {
+        parallel_for(n, 1, [&](std::size_t begin, std::size_t) { fn(begin); });
+    }
+
+    std::size_t jobs() { return jobs_; }
+    // Chunks taken by the BSP and by each worker; workers whose AP failed to
+    // start stay listed with none.
+    std::size_t bsp_chunks() { return inline_chunks_; }
+    std::size_t worker_count() { return workers.size(); }
+    std::size_t worker_chunks(std::size_t i) { return workers[i].chunks; }
+};
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "uefi.h"
+#include "text.h"
+
+enum FrameStage : UINT8 {
+    StageDecode = 0,      // next_frame() and the RGB to BLT conversion
+    StageComposite = 1,   // text and the HUD drawn into the frame buffer
+    StageBlit = 2,        // frame buffer to the screen
+};
+constexpr std::size_t FRAME_STAGES = 3;
+
+const char* stage_name(FrameStage stage);
+
+// The last SIZE samples in microseconds. Summaries cover only that window,
+// so a hitch shows in p99 and ages out SIZE frames later.
+class SampleRing {
+public:
+    static constexpr std::size_t SIZE = 128;
+    struct Summary {
+        UINT32 min;
+        UINT32 avg;
+        UINT32 p99;
+        UINT32 max;
+        std::size_t count;
+    };
+private:
+    UINT32 samples[SIZE] = {};
+    std::size_t next = 0;
+    std::size_t count = 0;
+public:
+    void add(UINT32 us);
+    // Sorts a copy of the window, a few thousand cycles.
+    Summary summary();
+};
+
+// Per-stage frame timing. The render loop calls begin_frame() and then
+// end_stage() for each stage in order; a stage runs from the previous mark.
+class FrameProfiler {
+    SampleRing stages[FRAME_STAGES];
+    SampleRing intervals;
+    UINT64 frame_tsc = 0;
+    UINT64 stage_tsc = 0;
+    std::size_t frames_ = 0;
+public:
+    static constexpr std::size_t HUD_LINES = FRAME_STAGES + 1;
+
+    // The time since the previous begin_frame() feeds the FPS figure.
+    void begin_frame();
+    void end_stage(FrameStage stage);
+
+    SampleRing::Summary stage(FrameStage stage) { return stages[stage].summary(); }
+    // Over the window, in 1/100 frames per second.
+    UINT64 fps_x100();
+    std::size_t frames() { return frames_; }
+
+    // Line i of the HUD: FPS first, then min/avg/p99/max of each stage.
+    void hud_line(std::size_t i, TextWriter& out);
+};
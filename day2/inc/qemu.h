@@ -0,0 +1,16 @@
+#pragma once
+
+#include "uefi.h"
+
+// QEMU's isa-debug-exit device, added by the headless targets with
+// `-device isa-debug-exit,iobase=0xf4,iosize=0x04`. Writing `code` to the
+// port ends QEMU with exit status code * 2 + 1, so 1 means success and
+// tools/run_headless.py turns anything else back into `code`.
+constexpr UINT16 QEMU_DEBUG_EXIT_PORT = 0xf4;
+
+// 0 for success, otherwise the low bits of the EFI error, never 0.
+UINT32 qemu_exit_code(EFI_STATUS status);
+// Exits QEMU with qemu_exit_code(status). Without the device (real hardware,
+// the interactive targets) the write goes nowhere and the machine powers off
+// through ResetSystem instead.
+void qemu_exit(EFI_STATUS status);
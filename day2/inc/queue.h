@@ -0,0 +1,124 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <type_traits>
+
+#include "cache_line.h"
+
+// Bounded lock-free queues for handing data between TPL callbacks, APs and
+// the main loop. Nothing here calls the firmware or spins: a full push or an
+// empty pop just returns false. Capacities are powers of two, items are
+// copied in and out and must be trivially copyable. Both queues are
+// zero-initialised and can be globals. No firmware headers either, so
+// tools/queue_stress.cc runs them on the host.
+
+// One producer, one consumer. Each side keeps its own index and a cached copy
+// of the other one on its own cache line, so the shared line only moves when
+// the cached view runs out.
+template<typename T, std::size_t N>
+class SpscQueue {
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "capacity must be a power of two");
+    static_assert(std::is_trivially_copyable<T>::value, "items are copied with plain stores");
+
+    alignas(CACHE_LINE) std::atomic<std::size_t> head {0};
+    std::size_t cached_tail = 0;
+    alignas(CACHE_LINE) std::atomic<std::size_t> tail {0};
+    std::size_t cached_head = 0;
+    alignas(CACHE_LINE) T items[N] {};
+public:
+    // Producer side only.
+    bool push(const T& item) {
+        std::size_t t = tail.load(std::memory_order_relaxed);
+        if (t - cached_head == N) {
+            cached_head = head.load(std::memory_order_acquire);
+            if (t - cached_head == N)
+                return false;
+        }
+        items[t & (N - 1)] = item;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side only.
+    bool pop(T& item) {
+        std::size_t h = head.load(std::memory_order_relaxed);
+        if (h == cached_tail) {
+            cached_tail = tail.load(std::memory_order_acquire);
+            if (h == cached_tail)
+                return false;
+        }
+        item = items[h & (N - 1)];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Exact only when called from one of the two sides with the other idle.
+    std::size_t size() {
+        return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+    }
+    static constexpr std::size_t capacity() { return N; }
+};
+
+// Any number of producers, one consumer (Vyukov's bounded queue with a single
+// reader). Producers claim a position with a CAS on `tail`, then publish the
+// slot through its sequence number. A producer interrupted between the two
+// (by a TPL callback on the same CPU, say) holds back the consumer, which
+// sees an empty queue until the slot is published; nothing ever waits.
+template<typename T, std::size_t N>
+class MpscQueue {
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "capacity must be a power of two");
+    static_assert(std::is_trivially_copyable<T>::value, "items are copied with plain stores");
+
+    // `seq` is stored minus the slot index, so an all-zero slot is free for
+    // position `index`, the starting state.
+    struct Slot {
+        std::atomic<std::size_t> seq {0};
+        T item {};
+    };
+
+    alignas(CACHE_LINE) std::atomic<std::size_t> tail {0};
+    alignas(CACHE_LINE) std::size_t head = 0;
+    Slot slots[N];
+
+    std::atomic<std::size_t> full_ {0};
+public:
+    bool push(const T& item) {
+        std::size_t pos = tail.load(std::memory_order_relaxed);
+        while (true) {
+            std::size_t i = pos & (N - 1);
+            Slot& slot = slots[i];
+            std::size_t seq = slot.seq.load(std::memory_order_acquire) + i;
+            if (seq == pos) {
+                if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (seq < pos) {
+                // The consumer has not freed this slot since the last lap.
+                full_.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            } else {
+                pos = tail.load(std::memory_order_relaxed);
+            }
+        }
+        std::size_t i = pos & (N - 1);
+        slots[i].item = item;
+        slots[i].seq.store(pos + 1 - i, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side only.
+    bool pop(T& item) {
+        std::size_t i = head & (N - 1);
+        Slot& slot = slots[i];
+        if (slot.seq.load(std::memory_order_acquire) + i != head + 1)
+            return false;
+        item = slot.item;
+        slot.seq.store(head + N - i, std::memory_order_release);
+        head += 1;
+        return true;
+    }
+
+    // Pushes turned away because the queue was full.
+    std::size_t full() { return full_.load(std::memory_order_relaxed); }
+    static constexpr std::size_t capacity() { return N; }
+};
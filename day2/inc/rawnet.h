@@ -0,0 +1,95 @@
+#pragma once
+
+#include "uefi.h"
+
+// Minimal Ethernet/ARP/IPv4/UDP directly on top of EFI_SIMPLE_NETWORK_PROTOCOL,
+// skipping the firmware MNP/IP4/UDP4/TCP4 drivers. Everything is polled:
+// frames are built in place in a ring of preallocated transmit buffers and
+// received into a ring of preallocated receive buffers, no allocation and no
+// events on the data path.
+//
+// MNP still owns the SNP instance and polls it from its own timer, so it can
+// steal frames from us; bulk transfers work best when no firmware sockets
+// are open on the same NIC.
+
+constexpr std::size_t RAWNET_FRAME_SIZE = 1514;
+constexpr std::size_t RAWNET_ETH_HEADER = 14;
+constexpr std::size_t RAWNET_IP_HEADER = 20;
+constexpr std::size_t RAWNET_UDP_HEADER = 8;
+constexpr std::size_t RAWNET_UDP_PAYLOAD = RAWNET_FRAME_SIZE - RAWNET_ETH_HEADER - RAWNET_IP_HEADER - RAWNET_UDP_HEADER;
+
+efi::vector<EFI_SIMPLE_NETWORK*> get_snp_interfaces();
+
+struct RawDatagram {
+    EFI_IPv4_ADDRESS source;
+    UINT16 source_port;
+    UINT16 port;
+    const UINT8* data;
+    std::size_t size;
+};
+
+class RawNet {
+    struct Buffer {
+        UINT8 frame[RAWNET_FRAME_SIZE];
+        std::size_t length;
+    };
+
+    EFI_SIMPLE_NETWORK* snp = nullptr;
+    EFI_MAC_ADDRESS mac;
+    EFI_IPv4_ADDRESS ip;
+    EFI_IPv4_ADDRESS netmask;
+    EFI_IPv4_ADDRESS gateway;
+
+    // Transmit ring: a buffer belongs to the NIC from Transmit until GetStatus hands its address back.
+    Buffer* tx = nullptr;
+    std::size_t tx_count;
+    std::size_t tx_next = 0;
+    bool* tx_busy = nullptr;
+
+    // Receive ring: [rx_head, rx_head + rx_ready) hold UDP datagrams for us.
+    Buffer* rx = nullptr;
+    std::size_t rx_count;
+    std::size_t rx_head = 0;
+    std::size_t rx_ready = 0;
+
+    // Single entry ARP cache, enough for talking to one peer.
+    EFI_IPv4_ADDRESS arp_ip = { {0, 0, 0, 0} };
+    EFI_MAC_ADDRESS arp_mac;
+    bool arp_valid = false;
+
+    UINT16 ip_id = 0;
+
+    std::size_t tx_frames_ = 0;
+    std::size_t rx_frames_ = 0;
+    std::size_t rx_stalls_ = 0;
+
+    Buffer* tx_acquire();
+    EFI_STATUS transmit(Buffer* buffer);
+    void reclaim();
+    void handle_arp(const UINT8* frame, std::size_t length);
+    bool accept_udp(const UINT8* frame, std::size_t length);
+    EFI_STATUS send_arp(UINT16 op, const EFI_MAC_ADDRESS& target_mac, const EFI_IPv4_ADDRESS& target_ip);
+    const EFI_IPv4_ADDRESS& next_hop(const EFI_IPv4_ADDRESS& dst);
+public:
+    RawNet(std::size_t tx_count, std::size_t rx_count) : tx_count(tx_count), rx_count(rx_count) {}
+    RawNet(const RawNet&) = delete;
+    ~RawNet();
+
+    EFI_STATUS open(EFI_SIMPLE_NETWORK* snp, const EFI_IPv4_ADDRESS& ip, const EFI_IPv4_ADDRESS& netmask, const EFI_IPv4_ADDRESS& gateway);
+    // Resolves the MAC of `dst` (or of the gateway for off-link addresses), polling for up to `timeout_us`.
+    EFI_STATUS resolve(const EFI_IPv4_ADDRESS& dst, std::size_t timeout_us);
+    // Builds one UDP datagram in a transmit buffer and queues it. EFI_NOT_READY when the ring is full.
+    EFI_STATUS send_udp(const EFI_IPv4_ADDRESS& dst, UINT16 dst_port, UINT16 src_port, const void* data, std::size_t size);
+    // Recycles sent buffers, drains received frames and answers ARP. Call it often.
+    void poll();
+    // Oldest queued datagram, valid until release(). False when nothing is queued.
+    bool peek(RawDatagram& datagram);
+    void release();
+    // Polls until all transmit buffers are back.
+    void flush();
+
+    std::size_t tx_frames() { return tx_frames_; }
+    std::size_t rx_frames() { return rx_frames_; }
+    // Polls that found the receive ring full and left frames in the NIC.
+    std::size_t rx_stalls() { return rx_stalls_; }
+};
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "net.h"
+
+// A received chunk lent out by RxPool. `data` points into the pool and stays
+// valid until the buffer is handed back with release(id).
+struct RxBuffer {
+    const char* data;
+    std::size_t size;
+    std::size_t id;
+};
+
+// Pre-registered receive buffers for one TCP4 connection. All of them are
+// posted to the driver up front, so it fills pool memory directly, and
+// completed buffers are lent to the caller in stream order instead of being
+// copied into a caller buffer. Releasing a buffer reposts it right away;
+// buffers may be released in any order.
+class RxPool {
+    enum State {
+        Idle,
+        Posted,
+        Ready,
+        Lent,
+    };
+    struct Slot {
+        EFI_TCP4_IO_TOKEN token;
+        EFI_TCP4_RECEIVE_DATA rx;
+        char* data;
+        State state;
+    };
+
+    EFI_TCP4* tcp = nullptr;
+    Slot* slots = nullptr;
+    char* memory = nullptr;
+    std::size_t count;
+    std::size_t buffer_size;
+
+    // FIFOs of slot indices: posting order and completion order.
+    std::size_t* posted = nullptr;
+    std::size_t posted_head = 0;
+    std::size_t posted_count = 0;
+    std::size_t* ready = nullptr;
+    std::size_t ready_head = 0;
+    std::size_t ready_count = 0;
+
+    EFI_STATUS status_ = EFI_SUCCESS;
+    std::size_t lent_ = 0;
+    std::size_t bytes_ = 0;
+
+    EFI_STATUS post(std::size_t index);
+    void complete_head();
+public:
+    RxPool(std::size_t count, std::size_t buffer_size) : count(count), buffer_size(buffer_size) {}
+    RxPool(const RxPool&) = delete;
+    ~RxPool();
+
+    EFI_STATUS open(EFI_TCP4* tcp);
+    // Moves completed receives to the ready queue. Never blocks.
+    void pump();
+    // Next chunk of the stream, if one has arrived.
+    bool lend(RxBuffer& buffer);
+    // Like lend(), but waits for the next completion, spinning tcp->Poll up to
+    // `spin_budget` rounds first. False once the stream ended or failed.
+    bool wait(RxBuffer& buffer, std::size_t spin_budget = 0);
+    void release(std::size_t id);
+
+    // EFI_CONNECTION_FIN after the peer closed, any other error from the driver.
+    EFI_STATUS status() { return status_; }
+    std::size_t lent() { return lent_; }
+    std::size_t bytes() { return bytes_; }
+};
@@ -0,0 +1,127 @@
+#pragma once
+
+#include "uefi.h"
+#include "timer_arch.h"
+
+// A unit of cooperative work. run() is called once per release and must
+// return promptly; nothing preempts it. Lower priority values run first,
+// ties go to the earlier absolute deadline.
+class Task {
+    friend class Scheduler;
+
+    const char* name_;
+    UINT8 priority_;
+    UINT64 period_us_;
+    UINT64 deadline_us_;
+
+    UINT64 release = 0;
+    bool queued = false;
+
+    std::size_t runs_ = 0;
+    std::size_t misses_ = 0;
+    UINT64 cycles_ = 0;
+    UINT64 max_cycles_ = 0;
+public:
+    // period_us 0 runs once. deadline_us is relative to the release and
+    // defaults to the period.
+    Task(const char* name, UINT8 priority, UINT64 period_us, UINT64 deadline_us = 0)
+        : name_(name), priority_(priority), period_us_(period_us), deadline_us_(deadline_us ? deadline_us : period_us) {}
+    Task(const Task&) = delete;
+    virtual ~Task() = default;
+
+    virtual void run() = 0;
+
+    // May be called from run() to pick the next release, e.g. per note.
+    void set_period(UINT64 us) { period_us_ = us; }
+
+    const char* name() { return name_; }
+    UINT8 priority() { return priority_; }
+    UINT64 period_us() { return period_us_; }
+    std::size_t runs() { return runs_; }
+    // Runs that finished after release + deadline.
+    std::size_t misses() { return misses_; }
+    UINT64 cycles() { return cycles_; }
+    UINT64 max_cycles() { return max_cycles_; }
+};
+
+// Wraps a callable, e.g. FunctionTask render("render", 2, 50'000, [&] { ... });
+template<typename Fn>
+class FunctionTask : public Task {
+    Fn fn;
+public:
+    FunctionTask(const char* name, UINT8 priority, UINT64 period_us, Fn fn)
+        : Task(name, priority, period_us), fn(fn) {}
+    void run() override { fn(); }
+};
+
+// Binary min-heap of tasks over a fixed array, push and pop are O(log n).
+class TaskHeap {
+    typedef bool (*Before)(const Task* a, const Task* b);
+
+    efi::vector<Task*> items;
+    std::size_t size_ = 0;
+    Before before;
+public:
+    TaskHeap(std::size_t capacity, Before before) : items(capacity), before(before) {}
+
+    bool push(Task* task);
+    Task* pop();
+    Task* top() { return size_ ? items[0] : nullptr; }
+    bool empty() { return size_ == 0; }
+    std::size_t size() { return size_; }
+};
+
+// Runs tasks from the notify function of one periodic timer event at
+// TPL_CALLBACK. Each tick moves released tasks from the timer heap (ordered
+// by release) to the ready heap (ordered by priority, then deadline) and
+// runs the ready ones; a task that overran its period skips the releases it
+// missed. Tasks interrupt code running at TPL_APPLICATION, so anything that
+// code shares with a task has to be touched with the TPL raised.
+class Scheduler {
+    efi::vector<Task*> tasks;
+    std::size_t task_count_ = 0;
+    TaskHeap timers;
+    TaskHeap ready;
+
+    EFI_EVENT tick = nullptr;
+    EFI_EVENT stopped = nullptr;
+    EFI_TIMER_ARCH_PROTOCOL* timer_arch = nullptr;
+    UINT64 saved_period = 0;
+
+    UINT64 start_tsc = 0;
+    UINT64 busy_cycles_ = 0;
+    std::size_t dispatches_ = 0;
+
+    static bool released_before(const Task* a, const Task* b);
+    static bool runs_before(const Task* a, const Task* b);
+    static void MSABI on_tick(EFI_EVENT event, void* ctx);
+    void dispatch();
+    void schedule(Task& task, UINT64 now);
+public:
+    explicit Scheduler(std::size_t capacity);
+    Scheduler(const Scheduler&) = delete;
+    ~Scheduler();
+
+    // First release `delay_us` after start(), or after now when running.
+    // Safe to call from a task or from TPL_APPLICATION.
+    bool add(Task& task, UINT64 delay_us = 0);
+
+    // Starts the tick. A tick shorter than the platform timer period lowers
+    // that period through EFI_TIMER_ARCH_PROTOCOL when the firmware has it;
+    // stop() puts it back.
+    EFI_STATUS start(UINT64 tick_us);
+    // Blocks at TPL_APPLICATION, letting the firmware idle, until stop().
+    void run();
+    void stop();
+
+    UINT64 now_us();
+    // Cycles since start() and the part of them spent inside tasks.
+    UINT64 elapsed_cycles();
+    UINT64 busy_cycles() { return busy_cycles_; }
+    // Share of elapsed time spent in `task`, in 1/1000.
+    UINT64 share_permille(Task& task);
+
+    std::size_t task_count() { return task_count_; }
+    Task& task(std::size_t i) { return *tasks[i]; }
+    std::size_t dispatches() { return dispatches_; }
+};
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "net.h"
+#include "udp.h"
+
+enum SocketFamily {
+    SocketIPv4,
+    SocketIPv6,
+};
+
+struct SocketAddress {
+    SocketFamily family;
+    EFI_IPv4_ADDRESS v4;
+    EFI_IPv6_ADDRESS v6;
+    UINT16 port;
+
+    static SocketAddress ipv4(const EFI_IPv4_ADDRESS& address, UINT16 port) {
+        SocketAddress a {};
+        a.family = SocketIPv4;
+        a.v4 = address;
+        a.port = port;
+        return a;
+    }
+    static SocketAddress ipv6(const EFI_IPv6_ADDRESS& address, UINT16 port) {
+        SocketAddress a {};
+        a.family = SocketIPv6;
+        a.v6 = address;
+        a.port = port;
+        return a;
+    }
+};
+
+// Blocking TCP stream over either TCP4 or TCP6, chosen by the remote
+// address. Uses the first service binding of that family and the same
+// TcpConfig for both; see TcpConfig::to_tcp6() for how fields map.
+class StreamSocket {
+    SocketFamily family_ = SocketIPv4;
+    EFI_SERVICE_BINDING* service = nullptr;
+    EFI_HANDLE handle = nullptr;
+    EFI_TCP4* tcp4 = nullptr;
+    EFI_TCP6* tcp6 = nullptr;
+    std::size_t spin_budget = 0;
+public:
+    StreamSocket() = default;
+    StreamSocket(const StreamSocket&) = delete;
+    ~StreamSocket() {
+        close();
+    }
+
+    EFI_STATUS open(const SocketAddress& remote, TcpConfig& config);
+    void close();
+
+    void busy_poll(std::size_t spins) {
+        spin_budget = spins;
+    }
+    // As ::send() and ::recv(): 0 from recv() once the peer has closed.
+    Result<std::size_t> send(char* buffer, std::size_t n);
+    Result<std::size_t> recv(char* buffer, std::size_t n);
+    // False on an error, reported through check(), or an early close.
+    bool send_all(const void* buffer, std::size_t n);
+    bool recv_all(void* buffer, std::size_t n);
+
+    bool is_open() { return tcp4 != nullptr || tcp6 != nullptr; }
+    SocketFamily family() { return family_; }
+};
+
+// Connected UDP4 or UDP6 socket with blocking send and a receive that gives
+// up after a timeout. For many datagrams in flight use Udp4Socket.
+class DatagramSocket {
+    SocketFamily family_ = SocketIPv4;
+    EFI_SERVICE_BINDING* service = nullptr;
+    EFI_HANDLE handle = nullptr;
+    EFI_UDP4* udp4 = nullptr;
+    EFI_UDP6* udp6 = nullptr;
+public:
+    DatagramSocket() = default;
+    DatagramSocket(const DatagramSocket&) = delete;
+    ~DatagramSocket() {
+        close();
+    }
+
+    // `local_port` 0 picks an ephemeral port.
+    EFI_STATUS open(const SocketAddress& remote, UINT16 local_port);
+    void close();
+
+    bool send(const void* data, std::size_t size);
+    // Copies one datagram into `buffer`, truncating it to `n`. Returns 0 when
+    // nothing arrived within `timeout_us`.
+    std::size_t recv(void* buffer, std::size_t n, std::size_t timeout_us);
+
+    bool is_open() { return udp4 != nullptr || udp6 != nullptr; }
+    SocketFamily family() { return family_; }
+};
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <atomic>
+#include <source_location>
+
+#include "uefi.h"
+
+// EFI_STATUS names, Result<T> for wrappers that used to return nullptr or a
+// short count and drop the status, and per-call-site error counters.
+//
+//     auto file = fopen(root, name, EFI_FILE_MODE_READ, 0);
+//     if (!file)
+//         return report_error(file.status(), "open asset");
+//
+// report_error() is the failure path only: it counts the error against the
+// file and line of its caller, logs it to the serial log and prints it on
+// the console the first time that site fails. write_error_metrics() exposes
+// the counters.
+
+struct StatusName {
+    EFI_STATUS status;
+    const char* name;
+};
+
+#define STATUS_NAME(status) StatusName { status, #status }
+inline constexpr StatusName STATUS_NAMES[] = {
+    STATUS_NAME(EFI_SUCCESS),
+    STATUS_NAME(EFI_LOAD_ERROR),
+    STATUS_NAME(EFI_INVALID_PARAMETER),
+    STATUS_NAME(EFI_UNSUPPORTED),
+    STATUS_NAME(EFI_BAD_BUFFER_SIZE),
+    STATUS_NAME(EFI_BUFFER_TOO_SMALL),
+    STATUS_NAME(EFI_NOT_READY),
+    STATUS_NAME(EFI_DEVICE_ERROR),
+    STATUS_NAME(EFI_WRITE_PROTECTED),
+    STATUS_NAME(EFI_OUT_OF_RESOURCES),
+    STATUS_NAME(EFI_VOLUME_CORRUPTED),
+    STATUS_NAME(EFI_VOLUME_FULL),
+    STATUS_NAME(EFI_NO_MEDIA),
+    STATUS_NAME(EFI_MEDIA_CHANGED),
+    STATUS_NAME(EFI_NOT_FOUND),
+    STATUS_NAME(EFI_ACCESS_DENIED),
+    STATUS_NAME(EFI_NO_RESPONSE),
+    STATUS_NAME(EFI_NO_MAPPING),
+    STATUS_NAME(EFI_TIMEOUT),
+    STATUS_NAME(EFI_NOT_STARTED),
+    STATUS_NAME(EFI_ALREADY_STARTED),
+    STATUS_NAME(EFI_ABORTED),
+    STATUS_NAME(EFI_ICMP_ERROR),
+    STATUS_NAME(EFI_TFTP_ERROR),
+    STATUS_NAME(EFI_PROTOCOL_ERROR),
+    STATUS_NAME(EFI_INCOMPATIBLE_VERSION),
+    STATUS_NAME(EFI_SECURITY_VIOLATION),
+    STATUS_NAME(EFI_CRC_ERROR),
+    STATUS_NAME(EFI_END_OF_MEDIA),
+    STATUS_NAME(EFI_END_OF_FILE),
+    STATUS_NAME(EFI_INVALID_LANGUAGE),
+    STATUS_NAME(EFI_COMPROMISED_DATA),
+    STATUS_NAME(EFI_WARN_UNKNOWN_GLYPH),
+    STATUS_NAME(EFI_WARN_DELETE_FAILURE),
+    STATUS_NAME(EFI_WARN_WRITE_FAILURE),
+    STATUS_NAME(EFI_WARN_BUFFER_TOO_SMALL),
+};
+#undef STATUS_NAME
+
+// The table above indexed by code, errors and warnings apart, built at
+// compile time so a lookup is one load.
+constexpr std::size_t STATUS_CODES = 64;
+constexpr EFI_STATUS STATUS_ERROR_BIT = EFIERR(0);
+struct StatusIndex {
+    const char* errors[STATUS_CODES] = {};
+    const char* warnings[STATUS_CODES] = {};
+};
+
+constexpr StatusIndex make_status_index() {
+    StatusIndex index;
+    for (const StatusName& entry : STATUS_NAMES) {
+        UINT64 code = entry.status & ~STATUS_ERROR_BIT;
+        if (EFI_ERROR(entry.status))
+            index.errors[code] = entry.name;
+        else
+            index.warnings[code] = entry.name;
+    }
+    return index;
+}
+inline constexpr StatusIndex STATUS_INDEX = make_status_index();
+
+constexpr const char* status_name(EFI_STATUS status) {
+    UINT64 code = status & ~STATUS_ERROR_BIT;
+    const char* name = nullptr;
+    if (code < STATUS_CODES)
+        name = EFI_ERROR(status) ? STATUS_INDEX.errors[code] : STATUS_INDEX.warnings[code];
+    return name ? name : "EFI_UNKNOWN_STATUS";
+}
+static_assert(status_name(EFI_NOT_FOUND)[4] == 'N' && status_name(EFI_SUCCESS)[4] == 'S');
+
+// Tag for a failed Result, `return fail(status);`.
+struct Failure {
+    EFI_STATUS status;
+};
+constexpr Failure fail(EFI_STATUS status) {
+    return { status };
+}
+
+// A value or the status that kept the wrapper from producing one. Small
+// enough to come back in registers, so the happy path costs what returning
+// the bare value did.
+template<typename T>
+class [[nodiscard]] Result {
+    T value_ {};
+    EFI_STATUS status_ = EFI_SUCCESS;
+public:
+    constexpr Result(T value) : value_(value) {}
+    constexpr Result(Failure failure) : status_(failure.status) {}
+
+    constexpr bool ok() const { return !EFI_ERROR(status_); }
+    constexpr explicit operator bool() const { return ok(); }
+    constexpr EFI_STATUS status() const { return status_; }
+    // T{} after a failure.
+    constexpr T value() const { return value_; }
+    constexpr T value_or(T fallback) const { return ok() ? value_ : fallback; }
+    constexpr T operator*() const { return value_; }
+    constexpr T operator->() const { return value_; }
+};
+
+// One source line that has reported errors. The table of them is fixed;
+// once it is full, new lines only add to error_sites_overflowed().
+struct ErrorSite {
+    std::atomic<const char*> file {nullptr};
+    UINT32 line = 0;
+    const char* what = nullptr;
+    std::atomic<UINT64> count {0};
+    std::atomic<EFI_STATUS> last {EFI_SUCCESS};
+};
+constexpr std::size_t MAX_ERROR_SITES = 64;
+
+// Counts and logs a failed `status`, returns it for `return report_error(...)`.
+EFI_STATUS report_error(EFI_STATUS status, const char* what,
+                        std::source_location where = std::source_location::current());
+// report_error() when `status` is an error, otherwise nothing beyond the test.
+inline EFI_STATUS check(EFI_STATUS status, const char* what,
+                        std::source_location where = std::source_location::current()) {
+    if (__builtin_expect(EFI_ERROR(status), 0))
+        report_error(status, what, where);
+    return status;
+}
+
+// Sites that have failed so far, in the order they first did.
+std::size_t error_site_count();
+ErrorSite& error_site(std::size_t i);
+// Failures that found the table full.
+UINT64 error_sites_overflowed();
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <atomic>
+
+#include "uefi.h"
+
+// Counters for one lock or critical section, all in TSC cycles. Only the
+// holder writes them, so they need no atomics. Register with track_lock() to
+// have them on /metrics.
+struct LockStats {
+    const char* name;
+    UINT64 acquisitions = 0;
+    // Acquisitions that found the lock taken, and the cycles spent waiting.
+    UINT64 contended = 0;
+    UINT64 spin_cycles = 0;
+    UINT64 hold_cycles = 0;
+    UINT64 max_hold_cycles = 0;
+    LockStats* next = nullptr;
+
+    constexpr explicit LockStats(const char* name) : name(name) {}
+    void held(UINT64 cycles) {
+        hold_cycles += cycles;
+        if (cycles > max_hold_cycles)
+            max_hold_cycles = cycles;
+    }
+};
+
+// Adds `stats` to the list walked by write_lock_metrics(), once.
+void track_lock(LockStats& stats);
+LockStats* tracked_locks();
+
+// Keeps notify functions at or below `tpl` out for the guard's lifetime, the
+// way to share state between a callback and code running below it. Boot
+// services, so BSP only, and `tpl` must not be below the current level.
+class TplGuard {
+    EFI_TPL old;
+    LockStats* stats;
+    UINT64 entered = 0;
+public:
+    explicit TplGuard(EFI_TPL tpl = TPL_CALLBACK, LockStats* stats = nullptr);
+    TplGuard(const TplGuard&) = delete;
+    ~TplGuard();
+};
+
+// FIFO spinlock for data shared between CPUs: each locker takes a ticket and
+// spins until it is served. Makes no firmware calls, so APs may use it. On
+// the BSP, a lock also taken by notify functions must be taken inside a
+// TplGuard, or a callback spinning on it would never let the holder finish.
+// Stats are optional and cost two rdtsc per acquisition.
+class TicketLock {
+    alignas(CACHE_LINE) std::atomic<UINT32> next {0};
+    std::atomic<UINT32> serving {0};
+    LockStats* stats;
+    UINT64 acquired = 0;
+public:
+    constexpr explicit TicketLock(LockStats* stats = nullptr) : stats(stats) {}
+    TicketLock(const TicketLock&) = delete;
+
+    void lock();
+    bool try_lock();
+    void unlock();
+};
+
+template<typename Lock>
+class LockGuard {
+    Lock& lock;
+public:
+    explicit LockGuard(Lock& lock) : lock(lock) { lock.lock(); }
+    LockGuard(const LockGuard&) = delete;
+    ~LockGuard() { lock.unlock(); }
+};
+
+// TplGuard then lock, for BSP code sharing a TicketLock with callbacks and APs.
+class TplLockGuard {
+    TplGuard tpl;
+    LockGuard<TicketLock> guard;
+public:
+    explicit TplLockGuard(TicketLock& lock, EFI_TPL level = TPL_CALLBACK) : tpl(level), guard(lock) {}
+};
@@ -0,0 +1,137 @@
+#pragma once
+
+#include "net.h"
+
+class TcpServer;
+
+// One accepted connection. Outgoing data is a queue of segments: send() copies
+// into the client's fixed transmit arena, send_ref() queues caller memory that
+// must stay valid until tx_idle(). Segments go out in order, one Transmit at a
+// time, without blocking the caller.
+class TcpClient {
+    friend class TcpServer;
+
+    struct Segment {
+        const char* data;
+        std::size_t size;
+    };
+    static constexpr std::size_t MAX_SEGMENTS = 16;
+
+    enum State {
+        Free,
+        Open,
+        Closing,
+    };
+
+    TcpServer* server = nullptr;
+    std::size_t id_ = 0;
+    State state = Free;
+    EFI_HANDLE handle = nullptr;
+    EFI_TCP4* tcp = nullptr;
+    bool close_requested = false;
+
+    char* rx_buffer = nullptr;
+    EFI_TCP4_IO_TOKEN rx_token {};
+    EFI_TCP4_RECEIVE_DATA rx {};
+    bool rx_pending = false;
+
+    char* arena = nullptr;
+    std::size_t arena_used = 0;
+    Segment segments[MAX_SEGMENTS];
+    std::size_t seg_head = 0;
+    std::size_t seg_count = 0;
+    EFI_TCP4_IO_TOKEN tx_token {};
+    EFI_TCP4_TRANSMIT_DATA tx {};
+    bool tx_pending = false;
+
+    EFI_TCP4_CLOSE_TOKEN close_token {};
+
+    void* context_ = nullptr;
+
+    EFI_STATUS post_receive();
+    EFI_STATUS post_transmit();
+public:
+    // Copies `n` bytes into the transmit arena. False when it does not fit.
+    bool send(const void* data, std::size_t n);
+    // Queues `n` bytes by reference. False when the segment queue is full.
+    bool send_ref(const void* data, std::size_t n);
+    // Gracefully closes once everything queued has been sent.
+    void close() { close_requested = true; }
+
+    std::size_t tx_space();
+    std::size_t tx_segments_free() { return MAX_SEGMENTS - seg_count; }
+    bool tx_idle() { return seg_count == 0 && !tx_pending; }
+    bool is_open() { return state == Open && !close_requested; }
+    std::size_t id() { return id_; }
+    // Free slot for the handler's per-connection state.
+    void* context() { return context_; }
+    void set_context(void* context) { context_ = context; }
+};
+
+class TcpHandler {
+public:
+    virtual void on_accept(TcpClient&) {}
+    // `data` is only valid during the call; the next receive reuses the buffer.
+    virtual void on_data(TcpClient& client, const char* data, std::size_t n) = 0;
+    // A queued segment has been transmitted; check tx_idle() for the whole queue.
+    virtual void on_sent(TcpClient&) {}
+    // Called once the driver has let go of the connection, before its slot is reused.
+    virtual void on_close(TcpClient&) {}
+};
+
+// Passive TCP4 endpoint. `backlog` Accept tokens stay posted on the listening
+// child so that many handshakes can complete between two poll() calls, and up
+// to `max_clients` accepted connections are served side by side. Everything
+// runs from poll(), which only checks events and posts tokens and never waits,
+// so it can be called once per frame from the render loop.
+class TcpServer {
+    struct ListenSlot {
+        EFI_TCP4_LISTEN_TOKEN token {};
+        bool pending = false;
+    };
+
+    EFI_SERVICE_BINDING* service = nullptr;
+    EFI_HANDLE handle = nullptr;
+    EFI_TCP4* tcp = nullptr;
+    TcpHandler& handler;
+
+    efi::vector<ListenSlot> listeners;
+    efi::vector<TcpClient> clients;
+    std::size_t rx_size;
+    std::size_t tx_size;
+
+    std::size_t accepted_ = 0;
+    std::size_t rejected_ = 0;
+    std::size_t active_ = 0;
+    std::size_t bytes_in_ = 0;
+    std::size_t bytes_out_ = 0;
+
+    EFI_STATUS post_accept(ListenSlot& slot);
+    void accept(EFI_HANDLE child);
+    void service_client(TcpClient& client);
+    void begin_close(TcpClient& client, bool abort);
+    void release(TcpClient& client);
+    void shutdown();
+
+    friend class TcpClient;
+public:
+    TcpServer(TcpHandler& handler, std::size_t backlog, std::size_t max_clients,
+            std::size_t rx_size = 4096, std::size_t tx_size = 16 * 1024)
+        : handler(handler), listeners(backlog), clients(max_clients), rx_size(rx_size), tx_size(tx_size) {}
+    TcpServer(const TcpServer&) = delete;
+    ~TcpServer() {
+        shutdown();
+    }
+
+    // `config` needs passive() and a local_port().
+    EFI_STATUS open(EFI_SERVICE_BINDING* service, TcpConfig& config);
+    // Reaps completed accepts, receives, transmits and closes. Never blocks.
+    void poll();
+
+    bool is_open() { return tcp != nullptr; }
+    std::size_t accepted() { return accepted_; }
+    std::size_t rejected() { return rejected_; }
+    std::size_t active() { return active_; }
+    std::size_t bytes_in() { return bytes_in_; }
+    std::size_t bytes_out() { return bytes_out_; }
+};
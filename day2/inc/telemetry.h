@@ -0,0 +1,75 @@
+#pragma once
+
+#include "udp.h"
+#include "clock.h"
+
+#include <cstddef>
+
+// Wire format, little endian, decoded by tools/telemetry_recv.py:
+// every datagram is a TelemetryPacketHeader followed by `count` records.
+struct TelemetryPacketHeader {
+    UINT32 magic;
+    UINT32 sequence;
+    UINT16 count;
+    UINT16 record_size;
+    // Keeps the records that follow 8-byte aligned; zero.
+    UINT32 reserved;
+};
+
+struct TelemetryRecord {
+    UINT64 tsc;
+    UINT32 value;
+    UINT16 id;
+    UINT16 kind;
+};
+
+static_assert(sizeof(TelemetryPacketHeader) == 16, "telemetry header layout");
+static_assert(sizeof(TelemetryRecord) == 16, "telemetry record layout");
+
+constexpr UINT32 TELEMETRY_MAGIC = 0x4d4c4554; // "TELM"
+constexpr std::size_t TELEMETRY_RECORDS_PER_PACKET = (UDP4_MAX_PAYLOAD - sizeof(TelemetryPacketHeader)) / sizeof(TelemetryRecord);
+
+struct TelemetryPacket {
+    TelemetryPacketHeader header;
+    TelemetryRecord records[TELEMETRY_RECORDS_PER_PACKET];
+};
+// flush() sends the header and records as one run of bytes.
+static_assert(offsetof(TelemetryPacket, records) == sizeof(TelemetryPacketHeader), "telemetry packet padding");
+
+enum TelemetryKind : UINT16 {
+    TelemetrySample = 1,  // one measurement, e.g. a frame time
+    TelemetryCounter = 2, // running total
+    TelemetryGauge = 3,   // current level
+};
+
+enum TelemetryId : UINT16 {
+    TelemetryFrameCycles = 1,
+    TelemetryFramesShown = 2,
+    TelemetryStreamBuffered = 3,
+    TelemetryStreamUnderruns = 4,
+};
+
+// Packs records into datagrams and hands full ones to the socket, so the cost
+// of a record is a few stores and the network sees one send per ~90 records.
+class Telemetry {
+    Udp4Socket& socket;
+    TelemetryPacket packet;
+    UINT32 sequence = 0;
+public:
+    Telemetry(Udp4Socket& socket) : socket(socket) {
+        packet.header.count = 0;
+    }
+
+    void record(TelemetryId id, TelemetryKind kind, UINT32 value) {
+        TelemetryRecord& r = packet.records[packet.header.count++];
+        r.tsc = rdtsc();
+        r.value = value;
+        r.id = id;
+        r.kind = kind;
+        if (packet.header.count == TELEMETRY_RECORDS_PER_PACKET)
+            flush();
+    }
+
+    // Sends whatever is batched, even a partial packet.
+    void flush();
+};
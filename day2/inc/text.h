@@ -0,0 +1,32 @@
+#pragma once
+
+#include "uefi.h"
+
+// Appends ASCII text to a caller-owned buffer without allocating. Output that
+// does not fit is dropped and remembered in overflowed().
+class TextWriter {
+    char* buffer;
+    std::size_t capacity;
+    std::size_t size_ = 0;
+    bool overflowed_ = false;
+public:
+    TextWriter(char* buffer, std::size_t capacity) : buffer(buffer), capacity(capacity) {}
+
+    TextWriter& put(const char* text, std::size_t n);
+    TextWriter& put(const char* text);
+    TextWriter& put(char c) {
+        return put(&c, 1);
+    }
+    TextWriter& put(UINT64 value);
+
+    void clear() {
+        size_ = 0;
+        overflowed_ = false;
+    }
+    const char* data() { return buffer; }
+    std::size_t size() { return size_; }
+    bool overflowed() { return overflowed_; }
+};
+
+// Length-aware comparison against a NUL terminated literal.
+bool text_equals(const char* text, std::size_t n, const char* literal);
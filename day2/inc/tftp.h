@@ -0,0 +1,44 @@
+#pragma once
+
+#include "uefi.h"
+
+// Largest TFTP block that still fits one 1500 byte Ethernet frame:
+// 1500 - 20 (IPv4) - 8 (UDP) - 4 (TFTP header).
+constexpr UINTN TFTP_MTU_BLOCK_SIZE = 1468;
+
+efi::vector<EFI_PXE_BASE_CODE_PROTOCOL*> get_pxe_interfaces();
+
+// TFTP reads through EFI_PXE_BASE_CODE_PROTOCOL.Mtftp. The block size is
+// negotiated with the blksize option and the file size with tsize, so a
+// read lands in a buffer allocated to the exact size. Windowsize (RFC 7440)
+// cannot be asked for through this protocol; newer OVMF builds set it with
+// PcdPxeTftpWindowSize.
+class TftpClient {
+    EFI_PXE_BASE_CODE_PROTOCOL* pxe = nullptr;
+    EFI_IP_ADDRESS server {};
+    UINTN block_size_ = TFTP_MTU_BLOCK_SIZE;
+    bool started = false;
+
+    std::size_t files_ = 0;
+    UINT64 bytes_ = 0;
+
+    EFI_STATUS mtftp(EFI_PXE_BASE_CODE_TFTP_OPCODE op, void* buffer, UINT64& size, const char* name);
+public:
+    TftpClient() = default;
+    TftpClient(const TftpClient&) = delete;
+    ~TftpClient();
+
+    // Starts the PXE base code with a static address, no DHCP round trip.
+    EFI_STATUS open(EFI_PXE_BASE_CODE_PROTOCOL* pxe, const EFI_IPv4_ADDRESS& station, const EFI_IPv4_ADDRESS& netmask,
+            const EFI_IPv4_ADDRESS& server, UINTN block_size = TFTP_MTU_BLOCK_SIZE);
+    EFI_STATUS size(const char* name, UINT64& size);
+    // Reads the whole file into `buffer`; `size` is its capacity on input and
+    // the file size on return.
+    EFI_STATUS read(const char* name, void* buffer, UINT64& size);
+
+    bool is_open() { return pxe != nullptr; }
+    // The block size in use, lowered to 512 if the server refused blksize.
+    UINTN block_size() { return block_size_; }
+    std::size_t files() { return files_; }
+    UINT64 bytes() { return bytes_; }
+};
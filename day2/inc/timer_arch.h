@@ -0,0 +1,53 @@
+#pragma once
+
+#include "uefi.h"
+
+// EFI_TIMER_ARCH_PROTOCOL from the PI specification (Volume 2, DXE
+// Architectural Protocols), not part of gnu-efi. It owns the platform tick
+// that every UEFI timer event is rounded to, 10 ms on OVMF by default.
+
+#define EFI_TIMER_ARCH_PROTOCOL_GUID \
+    { 0x26baccb3, 0x6f42, 0x11d4, {0xbc, 0xe7, 0x00, 0x80, 0xc7, 0x3c, 0x88, 0x81} }
+
+typedef struct _EFI_TIMER_ARCH_PROTOCOL EFI_TIMER_ARCH_PROTOCOL;
+
+typedef
+VOID
+(EFIAPI *EFI_TIMER_NOTIFY) (
+    IN UINT64 Time
+    );
+
+typedef
+EFI_STATUS
+(EFIAPI *EFI_TIMER_REGISTER_HANDLER) (
+    IN EFI_TIMER_ARCH_PROTOCOL *This,
+    IN EFI_TIMER_NOTIFY        NotifyFunction
+    );
+
+// TimerPeriod in 100 ns units, 0 disables the tick.
+typedef
+EFI_STATUS
+(EFIAPI *EFI_TIMER_SET_TIMER_PERIOD) (
+    IN EFI_TIMER_ARCH_PROTOCOL *This,
+    IN UINT64                  TimerPeriod
+    );
+
+typedef
+EFI_STATUS
+(EFIAPI *EFI_TIMER_GET_TIMER_PERIOD) (
+    IN EFI_TIMER_ARCH_PROTOCOL *This,
+    OUT UINT64                 *TimerPeriod
+    );
+
+typedef
+EFI_STATUS
+(EFIAPI *EFI_TIMER_GENERATE_SOFT_INTERRUPT) (
+    IN EFI_TIMER_ARCH_PROTOCOL *This
+    );
+
+struct _EFI_TIMER_ARCH_PROTOCOL {
+    EFI_TIMER_REGISTER_HANDLER        RegisterHandler;
+    EFI_TIMER_SET_TIMER_PERIOD        SetTimerPeriod;
+    EFI_TIMER_GET_TIMER_PERIOD        GetTimerPeriod;
+    EFI_TIMER_GENERATE_SOFT_INTERRUPT GenerateSoftInterrupt;
+};
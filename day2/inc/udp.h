@@ -0,0 +1,64 @@
+#pragma once
+
+#include "uefi.h"
+#include <atomic>
+
+// Largest payload that fits a 1500 byte Ethernet frame without IP fragmentation.
+constexpr std::size_t UDP4_MAX_PAYLOAD = 1472;
+
+efi::vector<EFI_SERVICE_BINDING*> get_udp4_services();
+efi::vector<EFI_SERVICE_BINDING*> get_udp6_services();
+
+struct Datagram {
+    const void* data;
+    std::size_t size;
+};
+
+// UDP4 child with a fixed pool of transmit slots. Each slot owns its token and
+// payload buffer, so a send copies the datagram and returns right away; the
+// slot is handed back from the completion callback at TPL_CALLBACK. Several
+// datagrams are in flight at once instead of one round trip per send.
+class Udp4Socket {
+    struct TxSlot {
+        EFI_UDP4_COMPLETION_TOKEN token;
+        EFI_UDP4_TRANSMIT_DATA data;
+        Udp4Socket* owner;
+        std::atomic<bool> busy;
+        char payload[UDP4_MAX_PAYLOAD];
+    };
+
+    EFI_SERVICE_BINDING* service = nullptr;
+    EFI_HANDLE handle = nullptr;
+    EFI_UDP4* udp = nullptr;
+    TxSlot* slots = nullptr;
+    std::size_t slot_count;
+    std::size_t next = 0;
+
+    std::atomic<std::size_t> in_flight_ {0};
+    std::atomic<std::size_t> sent_ {0};
+    std::atomic<std::size_t> errors_ {0};
+    std::size_t dropped_ = 0;
+
+    static void MSABI tx_complete(EFI_EVENT event, void* ctx);
+    TxSlot* acquire();
+public:
+    Udp4Socket(std::size_t slot_count) : slot_count(slot_count) {}
+    Udp4Socket(const Udp4Socket&) = delete;
+    ~Udp4Socket();
+
+    EFI_STATUS open(EFI_SERVICE_BINDING* service, EFI_UDP4_CONFIG_DATA& config);
+    // Queues one datagram to the configured remote. False if every slot is busy.
+    bool send(const void* data, std::size_t size);
+    // Queues as many datagrams as there are free slots, returns how many went out.
+    std::size_t send_batch(const Datagram* datagrams, std::size_t n);
+    // Gives the driver a chance to move queued packets without waiting for its timer.
+    void poll();
+    // Waits until every queued datagram has completed.
+    void flush();
+
+    bool is_open() { return udp != nullptr; }
+    std::size_t in_flight() { return in_flight_; }
+    std::size_t sent() { return sent_; }
+    std::size_t errors() { return errors_; }
+    std::size_t dropped() { return dropped_; }
+};
@@ -0,0 +1,134 @@
+#pragma once
+
+extern "C" {
+
+	#include <efi.h>
+	#include <efilib.h>
+
+}
+
+#include <functional>
+#include <vector>
+#include <cstring>
+#include <string>
+
+#include "cache_line.h"
+
+extern EFI_SYSTEM_TABLE* st;
+extern EFI_BOOT_SERVICES* bs;
+
+template<typename RetVal, typename ... Args>
+auto uefi(RetVal (*ptr)(Args...), Args... args) {
+    typedef RetVal (*FuncPtr)(Args...);
+    typedef __attribute__((ms_abi)) FuncPtr MSFuncPtr;
+    MSFuncPtr mptr = reinterpret_cast<MSFuncPtr>(ptr);
+    return std::invoke(mptr, args...);
+}
+
+extern "C" {
+    void * malloc(std::size_t n);
+    void free(void* ptr);
+}
+
+// Running totals kept by malloc/free. Pool allocations carry no size, so only
+// requested bytes are known, not what is still live.
+struct AllocStats {
+    std::size_t allocations;
+    std::size_t frees;
+    std::size_t failures;
+    std::size_t bytes_requested;
+};
+extern AllocStats alloc_stats;
+
+namespace efi {
+    template<typename T>
+    struct Allocator {
+        typedef T value_type;
+
+        T* allocate(std::size_t n) {
+            return reinterpret_cast<T*>(malloc(n * sizeof(T)));
+        }
+
+        void deallocate(T* ptr, std::size_t) {
+            free(ptr);
+        }
+    };
+
+
+    template<typename T>
+    using vector = std::vector<T, Allocator<T>>;
+    template<typename CharT>
+    using basic_string = std::basic_string<CharT, std::char_traits<CharT>, Allocator<CharT>>;
+}
+
+// EFIAPI is empty in this build, but the firmware still calls notify functions
+// with the MS ABI. Callbacks that look at their arguments have to be declared MSABI.
+#define MSABI __attribute__((ms_abi))
+typedef void (MSABI *NotifyFn)(EFI_EVENT event, void* ctx);
+
+EFI_STATUS create_event(UINT32 type, EFI_TPL tpl, EFI_EVENT_NOTIFY func, void* ctx, EFI_EVENT* event);
+EFI_STATUS create_notify_event(UINT32 type, EFI_TPL tpl, NotifyFn func, void* ctx, EFI_EVENT* event);
+EFI_STATUS close_event(EFI_EVENT event);
+EFI_STATUS wait_for(EFI_EVENT event);
+bool check_event(EFI_EVENT event);
+EFI_STATUS set_timer(EFI_EVENT event, EFI_TIMER_DELAY type, std::size_t time);
+EFI_STATUS sleep(std::size_t us);
+// In C++20 the host's <atomic> drags in <unistd.h> and its sleep(unsigned),
+// which makes sleep(50'000) ambiguous without an exact int overload.
+inline EFI_STATUS sleep(int us) {
+    return sleep((std::size_t)us);
+}
+
+// Shell arguments of `image`: whether `option` is among them, and the number
+// following it (`-frames 300`), or `fallback` when absent.
+bool has_option(EFI_HANDLE image, const wchar_t* option);
+UINTN option_number(EFI_HANDLE image, const wchar_t* option, UINTN fallback);
+
+template<typename Interface>
+EFI_STATUS handle_protocol(EFI_HANDLE handle, EFI_GUID* guid, Interface*& interface) {
+    return uefi(bs->HandleProtocol, handle, guid, (void**)&interface);
+}
+
+class Handles {
+    EFI_HANDLE* handles;
+    UINTN size_;
+    EFI_GUID guid_;
+public:
+    Handles(const Handles& ) = delete;
+    Handles(const EFI_GUID& guid) : guid_(guid) {
+        EFI_STATUS status = uefi(bs->LocateHandleBuffer, ByProtocol, &guid_, (void*)0, &size_, &handles);
+        if (EFI_ERROR(status)) {
+            size_ = 0;
+            handles = nullptr;
+        }
+    }
+    ~Handles() {
+        FreePool(handles);
+    }
+
+    std::size_t size() {
+        return size_;
+    }
+
+    EFI_HANDLE operator[](std::size_t n) {
+        return handles[n];
+    }
+
+    template<typename Interface>
+    efi::vector<Interface*> collect_interfaces() {
+        efi::vector<Interface*> interfaces;
+        for (std::size_t i=0; i < size_; ++i) {
+            Interface* interface;
+            EFI_STATUS status = handle_protocol(handles[i], &guid_, interface);
+            if (status == EFI_SUCCESS) {
+                interfaces.push_back(interface);
+            }
+        }
+        return interfaces;
+    }
+};
+
+inline void bp() {
+    bool wait = 1;
+    while (wait);
+}
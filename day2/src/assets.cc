@@ -0,0 +1,87 @@
+#include "assets.h"
+#include "fs.h"
+#include "text.h"
+
+AssetCache::~AssetCache() {
+    for (std::size_t i=0; i < count; ++i)
+        free(assets[i].data);
+}
+
+char* AssetCache::reserve(const char* name, UINT64 size) {
+    if (count == MAX_ASSETS)
+        return nullptr;
+    char* data = (char*)malloc(size);
+    if (data == nullptr)
+        return nullptr;
+    assets[count] = { name, data, size };
+    return data;
+}
+
+EFI_STATUS AssetCache::load_file(const char* name) {
+    wchar_t path[64];
+    std::size_t n = 0;
+    for (; name[n] && n + 1 < sizeof(path) / sizeof(path[0]); ++n)
+        path[n] = name[n];
+    path[n] = L'\0';
+
+    auto fs = open_fs_with_file(path);
+    if (!fs)
+        return fs.status();
+    auto opened = fopen(*fs, path, EFI_FILE_MODE_READ, EFI_FILE_READ_ONLY);
+    fclose(*fs);
+    if (!opened)
+        return opened.status();
+    EFI_FILE_PROTOCOL* file = *opened;
+    auto info = finfo(file);
+    if (!info) {
+        fclose(file);
+        return info.status();
+    }
+    UINT64 size = info->FileSize;
+    free(*info);
+    char* data = reserve(name, size);
+    if (data == nullptr) {
+        fclose(file);
+        return EFI_OUT_OF_RESOURCES;
+    }
+    auto got = fread(file, data, size);
+    fclose(file);
+    if (!got || *got != size) {
+        free(data);
+        return got ? EFI_END_OF_FILE : got.status();
+    }
+    count += 1;
+    return EFI_SUCCESS;
+}
+
+EFI_STATUS AssetCache::fetch_tftp(TftpClient& tftp, const char* name) {
+    UINT64 size = 0;
+    EFI_STATUS status = tftp.size(name, size);
+    if (EFI_ERROR(status))
+        return status;
+    char* data = reserve(name, size);
+    if (data == nullptr)
+        return EFI_OUT_OF_RESOURCES;
+    status = tftp.read(name, data, size);
+    if (EFI_ERROR(status)) {
+        free(data);
+        return status;
+    }
+    assets[count].size = size;
+    count += 1;
+    return EFI_SUCCESS;
+}
+
+char* AssetCache::find(const char* name, UINT64* size) {
+    for (std::size_t i=0; i < count; ++i) {
+        std::size_t n = 0;
+        while (assets[i].name[n])
+            ++n;
+        if (text_equals(assets[i].name, n, name)) {
+            if (size != nullptr)
+                *size = assets[i].size;
+            return assets[i].data;
+        }
+    }
+    return nullptr;
+}
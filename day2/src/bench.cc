@@ -0,0 +1,459 @@
+#include "uefi.h"
+#include "draw.h"
+#include "fs.h"
+#include "net.h"
+#include "socket.h"
+#include "clock.h"
+#include "text.h"
+#include "metrics.h"
+#include "qemu.h"
+#include "binlog.h"
+
+// Microbenchmarks for the pieces the app is built from: the allocator,
+// drawing into the canvas, blitting, file reads, the MS ABI thunk around
+// firmware calls, BLOG() records and, with `-net`, a TCP round trip to
+// tools/net_bench_server.py. Each bench runs WARMUP_REPS untimed and
+// BENCH_REPS timed repetitions of `ops` operations; the summaries go to the
+// console and to bench.csv and bench.json next to BENCH.efi.
+//
+// `make run-bench` boots the bench image headless and copies the results out.
+// `-exit` ends QEMU through isa-debug-exit with the status when done,
+// `-shutdown` just powers the machine off.
+
+EFI_STATUS bench_main(EFI_HANDLE, EFI_SYSTEM_TABLE*);
+
+extern "C" {
+
+	EFI_STATUS
+	EFIAPI
+	efi_main (EFI_HANDLE ImageHandle, EFI_SYSTEM_TABLE *SystemTable) {
+        InitializeLib(ImageHandle, SystemTable);
+        SystemTable->BootServices->SetWatchdogTimer(0, 0, 0, nullptr);
+        return bench_main(ImageHandle, SystemTable);
+	}
+
+}
+
+static const std::size_t WARMUP_REPS = 3;
+static const std::size_t BENCH_REPS = 21;
+
+static const EFI_IPv4_ADDRESS SERVER_IP = { {192, 168, 100, 1} };
+static const UINT16 SERVER_TCP_PORT = 4445;
+static const UINT32 BENCH_MAGIC = 0x4e45424e; // "NBEN"
+static const UINT32 BenchPing = 4;
+
+// Same wire format as netbench, see tools/net_bench_server.py.
+struct BenchCommand {
+    UINT32 magic;
+    UINT32 op;
+    UINT64 size;
+};
+
+struct Bench {
+    const char* name;
+    std::size_t ops;                    // per repetition
+    std::size_t bytes;                  // per operation, 0 when it does not apply
+    bool (*setup)(Bench& bench);        // false skips the bench
+    bool (*run)(std::size_t ops);       // false fails it, the timings are dropped
+    void (*teardown)();
+};
+
+struct BenchResult {
+    const char* name;
+    bool skipped;
+    bool failed;
+    std::size_t ops;
+    std::size_t bytes;
+    // Nanoseconds per repetition.
+    UINT64 min;
+    UINT64 median;
+    UINT64 mean;
+    UINT64 max;
+};
+
+static EFI_FILE_PROTOCOL* esp = nullptr;
+static bool with_net = false;
+static EFI_GRAPHICS_OUTPUT_BLT_PIXEL* canvas = nullptr;
+static EFI_GRAPHICS_OUTPUT_PROTOCOL* screen = nullptr;
+static EFI_FILE_PROTOCOL* read_file = nullptr;
+static char* read_buffer = nullptr;
+static StreamSocket* stream = nullptr;
+
+// Keeps the compiler from dropping work whose result is unused.
+static volatile UINT64 sink;
+
+static bool no_setup(Bench&) {
+    return true;
+}
+
+static void no_teardown() {
+}
+
+static bool run_alloc_small(std::size_t ops) {
+    for (std::size_t i = 0; i < ops; ++i) {
+        void* p = malloc(64);
+        sink = (UINT64)p;
+        free(p);
+    }
+    return true;
+}
+
+static bool run_alloc_page(std::size_t ops) {
+    for (std::size_t i = 0; i < ops; ++i) {
+        void* p = malloc(4096);
+        sink = (UINT64)p;
+        free(p);
+    }
+    return true;
+}
+
+static bool setup_canvas(Bench&) {
+    canvas = (EFI_GRAPHICS_OUTPUT_BLT_PIXEL*)malloc(CANVAS_WIDTH * CANVAS_HEIGHT * sizeof(EFI_GRAPHICS_OUTPUT_BLT_PIXEL));
+    return canvas != nullptr;
+}
+
+static void free_canvas() {
+    free(canvas);
+    canvas = nullptr;
+}
+
+static bool run_fill(std::size_t ops) {
+    for (std::size_t i = 0; i < ops; ++i)
+        fill(canvas, CANVAS_WIDTH, CANVAS_HEIGHT, {(UINT8)i, 0x20, 0x40, 0});
+    return true;
+}
+
+static bool run_text(std::size_t ops) {
+    for (std::size_t i = 0; i < ops; ++i)
+        print(canvas, "fps 59.9  frames 123456", 4 + (i % 50) * 10, 4);
+    return true;
+}
+
+static bool setup_blit(Bench& bench) {
+    auto screens = open_screens();
+    if (screens.empty() || !setup_canvas(bench))
+        return false;
+    screen = screens[0];
+    return true;
+}
+
+static bool run_blit(std::size_t ops) {
+    Screen out(screen);
+    auto* mode = out.get_mode()->Info;
+    UINTN w = mode->HorizontalResolution < CANVAS_WIDTH ? mode->HorizontalResolution : CANVAS_WIDTH;
+    UINTN h = mode->VerticalResolution < CANVAS_HEIGHT ? mode->VerticalResolution : CANVAS_HEIGHT;
+    for (std::size_t i = 0; i < ops; ++i) {
+        if (EFI_ERROR(out.blt(canvas, EfiBltBufferToVideo, 0, 0, 0, 0, w, h, CANVAS_WIDTH * sizeof(EFI_GRAPHICS_OUTPUT_BLT_PIXEL))))
+            return false;
+    }
+    return true;
+}
+
+static void end_blit() {
+    free_canvas();
+    screen = nullptr;
+}
+
+// Whole-file reads of nyan.bin, or of BENCH.efi when the image has no assets.
+static bool setup_file(Bench& bench) {
+    if (esp == nullptr)
+        return false;
+    auto file = fopen(esp, L"nyan.bin", EFI_FILE_MODE_READ, 0);
+    if (!file)
+        file = fopen(esp, L"BENCH.efi", EFI_FILE_MODE_READ, 0);
+    if (!file)
+        return false;
+    read_file = *file;
+    auto info = finfo(read_file);
+    bench.bytes = info ? info->FileSize : 0;
+    free(info.value());
+    read_buffer = bench.bytes ? (char*)malloc(bench.bytes) : nullptr;
+    if (read_buffer == nullptr) {
+        fclose(read_file);
+        read_file = nullptr;
+        return false;
+    }
+    return true;
+}
+
+static bool run_file(std::size_t ops) {
+    for (std::size_t i = 0; i < ops; ++i) {
+        uefi(read_file->SetPosition, read_file, (UINT64)0);
+        for (std::size_t n = 1; n;) {
+            auto got = fread(read_file, read_buffer, 64 * 1024);
+            if (!got)
+                return false;
+            n = *got;
+        }
+    }
+    return true;
+}
+
+static void end_file() {
+    fclose(read_file);
+    free(read_buffer);
+    read_file = nullptr;
+    read_buffer = nullptr;
+}
+
+static UINTN direct_noop(UINTN x) {
+    return x + 1;
+}
+
+static UINTN MSABI msabi_noop(UINTN x) {
+    return x + 1;
+}
+
+// Both go through a volatile pointer, so neither call is inlined.
+static bool run_call_direct(std::size_t ops) {
+    UINTN (* volatile direct_fn)(UINTN) = direct_noop;
+    UINTN x = 0;
+    for (std::size_t i = 0; i < ops; ++i)
+        x = direct_fn(x);
+    sink = x;
+    return true;
+}
+
+// The ms_abi call spills the registers SysV treats as caller-saved and
+// Microsoft as callee-saved; this is what every uefi() call pays on top.
+static bool run_call_thunk(std::size_t ops) {
+    UINTN (* volatile msabi_fn)(UINTN) = reinterpret_cast<UINTN (*)(UINTN)>(&msabi_noop);
+    UINTN x = 0;
+    for (std::size_t i = 0; i < ops; ++i)
+        x = uefi(msabi_fn, x);
+    sink = x;
+    return true;
+}
+
+// The cheapest real boot service round trip.
+static bool run_tpl(std::size_t ops) {
+    for (std::size_t i = 0; i < ops; ++i) {
+        EFI_TPL old = uefi(bs->RaiseTPL, (EFI_TPL)TPL_CALLBACK);
+        uefi(bs->RestoreTPL, old);
+    }
+    return true;
+}
+
+static bool setup_binlog(Bench&) {
+    return !EFI_ERROR(binlog_init(64 * 1024));
+}
+
+static bool run_binlog(std::size_t ops) {
+    for (std::size_t i = 0; i < ops; ++i)
+        BLOG(LogInfo, "bench record %u of %u", i, ops);
+    return true;
+}
+
+static bool setup_tcp(Bench&) {
+    if (!with_net)
+        return false;
+    stream = new StreamSocket();
+    TcpConfig config = TcpConfig::latency();
+    if (EFI_ERROR(stream->open(SocketAddress::ipv4(SERVER_IP, SERVER_TCP_PORT), config))) {
+        delete stream;
+        stream = nullptr;
+        return false;
+    }
+    return true;
+}
+
+// A dropped connection fails the bench rather than timing a short repetition.
+static bool run_tcp(std::size_t ops) {
+    for (std::size_t i = 0; i < ops; ++i) {
+        BenchCommand ping { BENCH_MAGIC, BenchPing, i };
+        BenchCommand pong {};
+        if (!stream->send_all(&ping, sizeof(ping)) || !stream->recv_all(&pong, sizeof(pong)))
+            return false;
+    }
+    return true;
+}
+
+static void end_tcp() {
+    delete stream;
+    stream = nullptr;
+}
+
+static Bench benches[] = {
+    { "alloc_64", 10'000, 64, no_setup, run_alloc_small, no_teardown },
+    { "alloc_4k", 10'000, 4096, no_setup, run_alloc_page, no_teardown },
+    { "fill_canvas", 10, CANVAS_WIDTH * CANVAS_HEIGHT * 4, setup_canvas, run_fill, free_canvas },
+    { "text_line", 1'000, 0, setup_canvas, run_text, free_canvas },
+    { "blit_canvas", 10, CANVAS_WIDTH * CANVAS_HEIGHT * 4, setup_blit, run_blit, end_blit },
+    { "file_read", 4, 0, setup_file, run_file, end_file },
+    { "call_direct", 100'000, 0, no_setup, run_call_direct, no_teardown },
+    { "call_uefi_thunk", 100'000, 0, no_setup, run_call_thunk, no_teardown },
+    { "boot_service_tpl", 10'000, 0, no_setup, run_tpl, no_teardown },
+    { "binlog_record", 100'000, sizeof(BinlogEntry), setup_binlog, run_binlog, no_teardown },
+    { "tcp_round_trip", 100, sizeof(BenchCommand), setup_tcp, run_tcp, end_tcp },
+};
+static constexpr std::size_t BENCH_COUNT = sizeof(benches) / sizeof(benches[0]);
+
+static BenchResult run_bench(Bench& bench) {
+    BenchResult result = {};
+    result.name = bench.name;
+    if (!bench.setup(bench)) {
+        result.skipped = true;
+        return result;
+    }
+    result.ops = bench.ops;
+    result.bytes = bench.bytes;
+
+    for (std::size_t i = 0; i < WARMUP_REPS && !result.failed; ++i)
+        result.failed = !bench.run(bench.ops);
+    // Insertion sort as the samples come in, for the median.
+    UINT64 samples[BENCH_REPS];
+    UINT64 total = 0;
+    for (std::size_t i = 0; i < BENCH_REPS && !result.failed; ++i) {
+        UINT64 start = rdtsc();
+        bool ok = bench.run(bench.ops);
+        UINT64 ns = cycles_to_ns(rdtsc() - start);
+        if (!ok) {
+            result.failed = true;
+            break;
+        }
+        total += ns;
+        std::size_t j = i;
+        for (; j > 0 && samples[j - 1] > ns; --j)
+            samples[j] = samples[j - 1];
+        samples[j] = ns;
+    }
+    bench.teardown();
+    if (result.failed)
+        return result;
+
+    result.min = samples[0];
+    result.median = samples[BENCH_REPS / 2];
+    result.mean = total / BENCH_REPS;
+    result.max = samples[BENCH_REPS - 1];
+    return result;
+}
+
+static void print_result(const BenchResult& r) {
+    if (r.skipped || r.failed) {
+        Print((CHAR16*)L"%-18a %a\n", r.name, r.failed ? "failed" : "skipped");
+        return;
+    }
+    UINT64 median = r.median * 100 / r.ops;
+    UINT64 min = r.min * 100 / r.ops;
+    UINT64 max = r.max * 100 / r.ops;
+    Print((CHAR16*)L"%-18a median %ld.%02ld ns/op, min %ld.%02ld, max %ld.%02ld",
+            r.name, (INT64)(median / 100), (INT64)(median % 100), (INT64)(min / 100), (INT64)(min % 100),
+            (INT64)(max / 100), (INT64)(max % 100));
+    if (r.bytes && r.median) {
+        UINT64 mib_s = (UINT64)r.bytes * r.ops * 1'000'000'000 / r.median >> 20;
+        Print((CHAR16*)L", %ld MiB/s", (INT64)mib_s);
+    }
+    Print((CHAR16*)L"\n");
+}
+
+static const char* result_status(const BenchResult& r) {
+    return r.failed ? "failed" : r.skipped ? "skipped" : "ok";
+}
+
+// Values per operation in ns, skipped and failed benches have an empty row.
+static void write_csv(TextWriter& out, const BenchResult* results, std::size_t n) {
+    out.put("name,status,ops,bytes_per_op,min_ns,median_ns,mean_ns,max_ns\n");
+    for (std::size_t i = 0; i < n; ++i) {
+        const BenchResult& r = results[i];
+        out.put(r.name).put(',').put(result_status(r)).put(',');
+        if (r.skipped || r.failed) {
+            out.put(",,,,,\n");
+            continue;
+        }
+        out.put((UINT64)r.ops).put(',').put((UINT64)r.bytes).put(',');
+        write_scaled(out, r.min, r.ops);
+        out.put(',');
+        write_scaled(out, r.median, r.ops);
+        out.put(',');
+        write_scaled(out, r.mean, r.ops);
+        out.put(',');
+        write_scaled(out, r.max, r.ops);
+        out.put('\n');
+    }
+}
+
+static void write_json(TextWriter& out, const BenchResult* results, std::size_t n) {
+    out.put("{\"tsc_hz\":").put(clock_calibration.tsc_hz);
+    out.put(",\"warmup_reps\":").put((UINT64)WARMUP_REPS).put(",\"reps\":").put((UINT64)BENCH_REPS);
+    out.put(",\"results\":[\n");
+    for (std::size_t i = 0; i < n; ++i) {
+        const BenchResult& r = results[i];
+        out.put(i ? ",\n" : "").put("{\"name\":\"").put(r.name).put('"');
+        out.put(",\"status\":\"").put(result_status(r)).put('"');
+        if (r.skipped || r.failed) {
+            out.put('}');
+            continue;
+        }
+        out.put(",\"ops\":").put((UINT64)r.ops).put(",\"bytes_per_op\":").put((UINT64)r.bytes);
+        out.put(",\"min_ns\":");
+        write_scaled(out, r.min, r.ops);
+        out.put(",\"median_ns\":");
+        write_scaled(out, r.median, r.ops);
+        out.put(",\"mean_ns\":");
+        write_scaled(out, r.mean, r.ops);
+        out.put(",\"max_ns\":");
+        write_scaled(out, r.max, r.ops);
+        out.put('}');
+    }
+    out.put("\n]}\n");
+}
+
+static EFI_STATUS write_file(const wchar_t* name, TextWriter& out) {
+    if (out.overflowed())
+        return EFI_BUFFER_TOO_SMALL;
+    auto file = fcreate(esp, name);
+    if (!file)
+        return file.status();
+    auto written = fwrite(*file, (char*)out.data(), out.size());
+    fclose(*file);
+    if (!written)
+        return written.status();
+    return *written == out.size() ? EFI_SUCCESS : EFI_VOLUME_FULL;
+}
+
+EFI_STATUS bench_main(EFI_HANDLE ImageHandle, EFI_SYSTEM_TABLE* SystemTable) {
+    st = SystemTable;
+    bs = SystemTable->BootServices;
+
+    clock_init(100'000);
+    with_net = has_option(ImageHandle, L"-net");
+    esp = open_fs_with_file(L"BENCH.efi").value();
+    Print((CHAR16*)L"bench: %ld benches, %ld+%ld reps, tsc %ld MHz\n", (INT64)BENCH_COUNT, (INT64)WARMUP_REPS,
+            (INT64)BENCH_REPS, (INT64)clock_calibration.tsc_per_us);
+
+    BenchResult results[BENCH_COUNT];
+    std::size_t failed = 0;
+    for (std::size_t i = 0; i < BENCH_COUNT; ++i) {
+        results[i] = run_bench(benches[i]);
+        print_result(results[i]);
+        failed += results[i].failed;
+    }
+
+    EFI_STATUS status = EFI_NOT_FOUND;
+    if (esp) {
+        static char buffer[8192];
+        TextWriter out(buffer, sizeof(buffer));
+        write_csv(out, results, BENCH_COUNT);
+        status = write_file(L"bench.csv", out);
+        if (!EFI_ERROR(status)) {
+            out.clear();
+            write_json(out, results, BENCH_COUNT);
+            status = write_file(L"bench.json", out);
+        }
+    }
+    if (EFI_ERROR(status))
+        Print((CHAR16*)L"bench: writing results failed %r\n", status);
+    else
+        Print((CHAR16*)L"bench: results in bench.csv and bench.json\n");
+    // A failed bench still writes its row, but the run does not pass.
+    if (failed && !EFI_ERROR(status)) {
+        Print((CHAR16*)L"bench: %ld benches failed\n", (INT64)failed);
+        status = EFI_ABORTED;
+    }
+
+    if (has_option(ImageHandle, L"-exit"))
+        qemu_exit(status);
+    if (has_option(ImageHandle, L"-shutdown"))
+        uefi(st->RuntimeServices->ResetSystem, EfiResetShutdown, status, (UINTN)0, (CHAR16*)nullptr);
+    return status;
+}
@@ -0,0 +1,137 @@
+#include "binlog.h"
+#include "fs.h"
+#include "text.h"
+
+BinlogState binlog_state;
+
+EFI_STATUS binlog_init(std::size_t entries) {
+    if (binlog_state.entries)
+        return EFI_SUCCESS;
+    std::size_t size = 1;
+    while (size < entries)
+        size <<= 1;
+    BinlogEntry* ring = (BinlogEntry*)malloc(size * sizeof(BinlogEntry));
+    if (ring == nullptr)
+        return EFI_OUT_OF_RESOURCES;
+    memset((void*)ring, 0, size * sizeof(BinlogEntry));
+    binlog_state.mask = size - 1;
+    std::atomic_thread_fence(std::memory_order_release);
+    binlog_state.entries = ring;
+    return EFI_SUCCESS;
+}
+
+UINT16 binlog_register(BinlogFormat& format, UINT8 args) {
+    // Two CPUs may get here for the same call site; the first CAS wins and
+    // the other ID is never seen.
+    UINT16 id = binlog_state.next_id.fetch_add(1, std::memory_order_relaxed) + 1;
+    format.args = args;
+    UINT16 expected = 0;
+    if (!format.id.compare_exchange_strong(expected, id, std::memory_order_acq_rel))
+        return expected;
+    BinlogFormat* head = binlog_state.formats.load(std::memory_order_relaxed);
+    do {
+        format.next = head;
+    } while (!binlog_state.formats.compare_exchange_weak(head, &format, std::memory_order_release,
+                                                         std::memory_order_relaxed));
+    return id;
+}
+
+namespace {
+    std::size_t length(const char* text) {
+        std::size_t n = 0;
+        while (text[n])
+            ++n;
+        return n;
+    }
+}
+
+// Stream layout, all little-endian:
+//   header      u32 magic "BLOG", u16 version, u16 max args, u64 TSC Hz, u64 base TSC
+//   'D' format  u8 level, u8 args, u16 id, u32 line, u16 format length, u16 file length, format, file
+//   'E' event   u8 args, u16 id, u64 TSC, u64 x args
+//   'L' lost    u64 records overwritten or torn before they were read
+std::size_t binlog_write_stream(StreamSink sink, void* ctx) {
+    SinkWriter out(sink, ctx);
+    out.put(BINLOG_MAGIC);
+    out.put(BINLOG_VERSION);
+    out.put((UINT16)BINLOG_ARGS);
+    out.put(clock_calibration.tsc_hz);
+    out.put(clock_calibration.base_tsc);
+
+    for (BinlogFormat* f = binlog_state.formats.load(std::memory_order_acquire); f; f = f->next) {
+        UINT16 format_length = (UINT16)length(f->format);
+        UINT16 file_length = (UINT16)length(f->file);
+        out.put('D');
+        out.put(f->level);
+        out.put(f->args);
+        out.put(f->id.load(std::memory_order_relaxed));
+        out.put(f->line);
+        out.put(format_length);
+        out.put(file_length);
+        out.put(f->format, format_length);
+        out.put(f->file, file_length);
+    }
+
+    std::size_t written = 0;
+    UINT64 lost = 0;
+    if (binlog_ready()) {
+        UINT64 head = binlog_state.head.load(std::memory_order_acquire);
+        UINT64 size = binlog_state.mask + 1;
+        UINT64 start = head > size ? head - size : 0;
+        lost = start;
+        for (UINT64 pos = start; pos < head && !out.failed(); ++pos) {
+            BinlogEntry& entry = binlog_state.entries[pos & binlog_state.mask];
+            UINT64 header = entry.header.load(std::memory_order_acquire);
+            UINT64 tsc = entry.tsc.load(std::memory_order_relaxed);
+            UINT64 args[BINLOG_ARGS];
+            for (std::size_t i = 0; i < BINLOG_ARGS; ++i)
+                args[i] = entry.args[i].load(std::memory_order_relaxed);
+            // Pairs with the writer's release fence: if any word above came
+            // from a newer record, the header below is its cleared or final one.
+            std::atomic_thread_fence(std::memory_order_acquire);
+            // Overwritten while copying, or not committed yet.
+            if ((header >> 32) != ((pos + 1) & 0xffffffff)
+                    || entry.header.load(std::memory_order_relaxed) != header) {
+                lost += 1;
+                continue;
+            }
+            UINT8 count = (UINT8)(header >> 16);
+            out.put('E');
+            out.put(count);
+            out.put((UINT16)header);
+            out.put(tsc);
+            out.put(args, count * sizeof(UINT64));
+            written += 1;
+        }
+    }
+    if (lost) {
+        out.put('L');
+        out.put(lost);
+    }
+    out.flush();
+    return written;
+}
+
+EFI_STATUS binlog_dump_file(EFI_FILE_PROTOCOL* root, const wchar_t* name, std::size_t* records) {
+    return fwrite_stream(root, name, binlog_write_stream, records);
+}
+
+std::size_t binlog_dump_serial() {
+    log_flush();
+    log_text(LogInfo, "blog begin");
+    std::size_t written = binlog_write_stream([](void*, const char* data, std::size_t n) {
+        static const char HEX[] = "0123456789abcdef";
+        // 24 bytes a line keeps "blog " and the hex within LOG_TEXT.
+        for (std::size_t i = 0; i < n; i += 24) {
+            LogLine line(LogInfo);
+            line.put("blog ");
+            for (std::size_t j = i; j < n && j < i + 24; ++j)
+                line.put(HEX[(UINT8)data[j] >> 4]).put(HEX[data[j] & 0xf]);
+        }
+        log_flush();
+        return true;
+    }, nullptr);
+    log_text(LogInfo, "blog end");
+    log_flush();
+    return written;
+}
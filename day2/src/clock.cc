@@ -0,0 +1,36 @@
+#include <cpuid.h>
+
+#include "clock.h"
+
+ClockCalibration clock_calibration;
+
+bool clock_invariant() {
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx))
+        return false;
+    return edx & (1u << 8);
+}
+
+void clock_init(UINT64 us) {
+    if (us == 0)
+        us = 1;
+    // Stall overshoots a little and a timer interrupt may land inside one
+    // run; the shortest of three is closest to the truth.
+    UINT64 best = ~(UINT64)0;
+    for (int i = 0; i < 3; ++i) {
+        UINT64 start = rdtsc();
+        uefi(bs->Stall, (UINTN)us);
+        UINT64 cycles = rdtsc() - start;
+        if (cycles < best)
+            best = cycles;
+    }
+    ClockCalibration& c = clock_calibration;
+    c.tsc_hz = best * 1'000'000 / us;
+    if (c.tsc_hz < 1'000'000)
+        c.tsc_hz = 1'000'000;
+    c.tsc_per_us = c.tsc_hz / 1'000'000;
+    c.ns_mult = (1'000'000'000ull << 32) / c.tsc_hz;
+    c.us_mult = (1'000'000ull << 32) / c.tsc_hz;
+    c.invariant = clock_invariant();
+    c.base_tsc = rdtsc();
+}
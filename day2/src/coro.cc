@@ -0,0 +1,261 @@
+#include "coro.h"
+#include "fs.h"
+#include "net.h"
+
+FramePool coro_frames;
+CoroLoop* CoroLoop::active = nullptr;
+
+std::size_t FramePool::class_of(std::size_t size) {
+    std::size_t i = 0;
+    for (std::size_t bound = MIN_SIZE; bound < size; bound <<= 1)
+        ++i;
+    return i;
+}
+
+void* FramePool::allocate(std::size_t size) {
+    std::size_t i = class_of(size);
+    if (i >= CLASSES) {
+        void* ptr = malloc(size);
+        if (ptr != nullptr) {
+            large_ += 1;
+            live_ += 1;
+        }
+        return ptr;
+    }
+    allocations_ += 1;
+    live_ += 1;
+    if (free_lists[i] != nullptr) {
+        FreeFrame* frame = free_lists[i];
+        free_lists[i] = frame->next;
+        return frame;
+    }
+    std::size_t bytes = MIN_SIZE << i;
+    if (slab_left < bytes) {
+        // The tail of the old slab is dropped, at most one frame's worth.
+        slab = (char*)malloc(SLAB_SIZE);
+        if (slab == nullptr) {
+            slab_left = 0;
+            live_ -= 1;
+            return nullptr;
+        }
+        slab_left = SLAB_SIZE;
+        slabs_ += 1;
+    }
+    void* ptr = slab;
+    slab += bytes;
+    slab_left -= bytes;
+    return ptr;
+}
+
+void FramePool::release(void* ptr, std::size_t size) {
+    live_ -= 1;
+    std::size_t i = class_of(size);
+    if (i >= CLASSES) {
+        free(ptr);
+        return;
+    }
+    FreeFrame* frame = (FreeFrame*)ptr;
+    frame->next = free_lists[i];
+    free_lists[i] = frame;
+}
+
+bool EventWaiter::park(std::coroutine_handle<> handle) {
+    CoroLoop* loop = CoroLoop::current();
+    if (loop == nullptr) {
+        wait_for(event);
+        return false;
+    }
+    this->handle = handle;
+    loop->add(*this);
+    return true;
+}
+
+void CoroLoop::add(EventWaiter& waiter) {
+    waiter.next = waiting;
+    waiting = &waiter;
+}
+
+std::size_t CoroLoop::poll() {
+    // Resumed coroutines may park again, so split the list first and only
+    // then resume.
+    EventWaiter* list = waiting;
+    EventWaiter* fired = nullptr;
+    waiting = nullptr;
+    while (list) {
+        EventWaiter* waiter = list;
+        list = waiter->next;
+        if (check_event(waiter->event)) {
+            waiter->next = fired;
+            fired = waiter;
+        } else {
+            waiter->next = waiting;
+            waiting = waiter;
+        }
+    }
+    std::size_t n = 0;
+    while (fired) {
+        EventWaiter* waiter = fired;
+        fired = waiter->next;
+        waiter->handle.resume();
+        n += 1;
+    }
+    resumed_ += n;
+    return n;
+}
+
+void CoroLoop::run() {
+    while (live_ > 0) {
+        if (poll() > 0 || waiting == nullptr)
+            continue;
+        // Nothing fired: idle until one does. WaitForEvent consumes that
+        // signal, so resume its waiter directly.
+        events.clear();
+        for (EventWaiter* waiter = waiting; waiter; waiter = waiter->next)
+            events.push_back(waiter->event);
+        UINTN index = 0;
+        if (EFI_ERROR(uefi(bs->WaitForEvent, (UINTN)events.size(), events.data(), &index)))
+            continue;
+        EventWaiter** link = &waiting;
+        for (; index > 0; --index)
+            link = &(*link)->next;
+        EventWaiter* waiter = *link;
+        *link = waiter->next;
+        resumed_ += 1;
+        waiter->handle.resume();
+    }
+}
+
+DelayAwait::~DelayAwait() {
+    if (waiter.event)
+        close_event(waiter.event);
+}
+
+bool DelayAwait::await_suspend(std::coroutine_handle<> handle) {
+    if (EFI_ERROR(create_event(EVT_TIMER, 0, nullptr, nullptr, &waiter.event))) {
+        waiter.event = nullptr;
+        return false;
+    }
+    set_timer(waiter.event, TimerRelative, us * 10);
+    return waiter.park(handle);
+}
+
+bool AsyncTcp::ConnectAwait::await_suspend(std::coroutine_handle<> handle) {
+    status = create_event(0, 0, nullptr, nullptr, &token.CompletionToken.Event);
+    if (EFI_ERROR(status))
+        return false;
+    status = uefi(tcp->Connect, tcp, &token);
+    if (EFI_ERROR(status))
+        return false;
+    waiter.event = token.CompletionToken.Event;
+    return waiter.park(handle);
+}
+
+EFI_STATUS AsyncTcp::ConnectAwait::await_resume() {
+    if (token.CompletionToken.Event)
+        close_event(token.CompletionToken.Event);
+    return EFI_ERROR(status) ? status : token.CompletionToken.Status;
+}
+
+AsyncTcp::IoAwait::IoAwait(EFI_TCP4* tcp, bool transmit, void* buffer, std::size_t n) : tcp(tcp), transmit(transmit) {
+    if (transmit) {
+        tx = {};
+        tx.Push = TRUE;
+        tx.DataLength = n;
+        tx.FragmentCount = 1;
+        tx.FragmentTable[0].FragmentLength = n;
+        tx.FragmentTable[0].FragmentBuffer = buffer;
+        token.Packet.TxData = &tx;
+    } else {
+        rx = {};
+        rx.DataLength = n;
+        rx.FragmentCount = 1;
+        rx.FragmentTable[0].FragmentLength = n;
+        rx.FragmentTable[0].FragmentBuffer = buffer;
+        token.Packet.RxData = &rx;
+    }
+}
+
+bool AsyncTcp::IoAwait::await_suspend(std::coroutine_handle<> handle) {
+    status = create_event(0, 0, nullptr, nullptr, &token.CompletionToken.Event);
+    if (EFI_ERROR(status))
+        return false;
+    status = transmit ? uefi(tcp->Transmit, tcp, &token) : uefi(tcp->Receive, tcp, &token);
+    if (EFI_ERROR(status))
+        return false;
+    waiter.event = token.CompletionToken.Event;
+    return waiter.park(handle);
+}
+
+std::size_t AsyncTcp::IoAwait::await_resume() {
+    if (token.CompletionToken.Event)
+        close_event(token.CompletionToken.Event);
+    if (EFI_ERROR(status) || EFI_ERROR(token.CompletionToken.Status)) {
+        tcp_stats.errors += 1;
+        return 0;
+    }
+    if (transmit) {
+        tcp_stats.sends += 1;
+        tcp_stats.send_bytes += tx.DataLength;
+        return tx.DataLength;
+    }
+    tcp_stats.recvs += 1;
+    tcp_stats.recv_bytes += rx.DataLength;
+    return rx.DataLength;
+}
+
+Async<bool> AsyncTcp::send_all(const void* buffer, std::size_t n) {
+    const char* ptr = (const char*)buffer;
+    while (n) {
+        std::size_t sent = co_await send(ptr, n);
+        if (sent == 0)
+            co_return false;
+        ptr += sent;
+        n -= sent;
+    }
+    co_return true;
+}
+
+Async<bool> AsyncTcp::recv_all(void* buffer, std::size_t n) {
+    char* ptr = (char*)buffer;
+    while (n) {
+        std::size_t got = co_await recv(ptr, n);
+        if (got == 0)
+            co_return false;
+        ptr += got;
+        n -= got;
+    }
+    co_return true;
+}
+
+FileReadAwait::FileReadAwait(EFI_FILE_PROTOCOL* file, void* buffer, std::size_t n) : file(file) {
+    token.BufferSize = n;
+    token.Buffer = buffer;
+}
+
+bool FileReadAwait::await_suspend(std::coroutine_handle<> handle) {
+    if (file->Revision < EFI_FILE_PROTOCOL_REVISION2
+            || EFI_ERROR(create_event(0, 0, nullptr, nullptr, &token.Event))) {
+        token.Event = nullptr;
+        auto read = fread(file, (char*)token.Buffer, token.BufferSize);
+        got = read.value();
+        failed = !read;
+        return false;
+    }
+    if (EFI_ERROR(uefi(file->ReadEx, file, &token))) {
+        failed = true;
+        return false;
+    }
+    waiter.event = token.Event;
+    return waiter.park(handle);
+}
+
+std::size_t FileReadAwait::await_resume() {
+    if (token.Event == nullptr)
+        return got;
+    close_event(token.Event);
+    if (failed || EFI_ERROR(token.Status))
+        return 0;
+    file_stats.reads += 1;
+    file_stats.read_bytes += token.BufferSize;
+    return token.BufferSize;
+}
@@ -0,0 +1,247 @@
+#include "fiber.h"
+#include "fs.h"
+
+// Saves the callee-saved registers of the System V ABI plus MXCSR and the
+// x87 control word on the current stack, stores the stack pointer in *save
+// and resumes the context whose stack pointer is `load`.
+extern "C" __attribute__((visibility("hidden"))) void fiber_switch(void** save, void* load);
+// First return address of a new fiber: r12 holds the Fiber, r13 fiber_start.
+extern "C" __attribute__((visibility("hidden"))) char fiber_trampoline[];
+
+asm(R"(
+    .text
+    .globl fiber_switch
+    .hidden fiber_switch
+fiber_switch:
+    pushq %rbp
+    pushq %rbx
+    pushq %r12
+    pushq %r13
+    pushq %r14
+    pushq %r15
+    subq $8, %rsp
+    stmxcsr (%rsp)
+    fnstcw 4(%rsp)
+    movq %rsp, (%rdi)
+    movq %rsi, %rsp
+    ldmxcsr (%rsp)
+    fldcw 4(%rsp)
+    addq $8, %rsp
+    popq %r15
+    popq %r14
+    popq %r13
+    popq %r12
+    popq %rbx
+    popq %rbp
+    ret
+
+    .globl fiber_trampoline
+    .hidden fiber_trampoline
+fiber_trampoline:
+    movq %r12, %rdi
+    callq *%r13
+    ud2
+)");
+
+// Written just above the Fiber at the bottom of each stack, checked on
+// every switch back to catch a fiber that ran off the end of its stack.
+static constexpr UINT64 STACK_CANARY = 0x46494245525354ACull;
+
+static UINT64* canary(Fiber* fiber) {
+    return (UINT64*)((char*)fiber + ((sizeof(Fiber) + 15) & ~(std::size_t)15));
+}
+
+FiberRuntime* FiberRuntime::active = nullptr;
+
+void fiber_start(Fiber* fiber) {
+    fiber->entry(fiber->arg);
+    fiber->runtime->finish(fiber);
+}
+
+FiberRuntime::FiberRuntime(std::size_t stack_size)
+    : stack_size((stack_size + EFI_PAGE_SIZE - 1) & ~(std::size_t)(EFI_PAGE_SIZE - 1)) {}
+
+FiberRuntime::~FiberRuntime() {
+    while (free_list) {
+        Fiber* fiber = free_list;
+        free_list = fiber->next;
+        uefi(bs->FreePages, (EFI_PHYSICAL_ADDRESS)fiber->stack, (UINTN)(stack_size / EFI_PAGE_SIZE));
+    }
+}
+
+Fiber* FiberRuntime::allocate() {
+    if (free_list) {
+        Fiber* fiber = free_list;
+        free_list = fiber->next;
+        return fiber;
+    }
+    EFI_PHYSICAL_ADDRESS address = 0;
+    EFI_STATUS status = uefi(bs->AllocatePages, AllocateAnyPages, EfiLoaderData, (UINTN)(stack_size / EFI_PAGE_SIZE), &address);
+    if (EFI_ERROR(status))
+        return nullptr;
+    stacks_ += 1;
+    // The Fiber itself sits at the bottom of its own stack.
+    Fiber* fiber = new ((void*)address) Fiber();
+    fiber->stack = (char*)address;
+    fiber->runtime = this;
+    return fiber;
+}
+
+bool FiberRuntime::spawn(void (*entry)(void*), void* arg, std::size_t arg_size, Fiber* fiber) {
+    fiber->entry = entry;
+    fiber->arg = arg;
+    fiber->waiting_on = nullptr;
+    fiber->next = nullptr;
+    *canary(fiber) = STACK_CANARY;
+
+    // Initial frame as fiber_switch leaves it: control words, r15..r12, rbx,
+    // rbp, return address. The trampoline then starts with rsp 16 byte aligned.
+    char* top = fiber->stack + stack_size - ((arg_size + 15) & ~(std::size_t)15);
+    UINT64* frame = (UINT64*)(top - 80);
+    frame[0] = 0x1F80 | ((UINT64)0x037F << 32);
+    frame[1] = 0;
+    frame[2] = 0;
+    frame[3] = (UINT64)&fiber_start;
+    frame[4] = (UINT64)fiber;
+    frame[5] = 0;
+    frame[6] = 0;
+    frame[7] = (UINT64)fiber_trampoline;
+    fiber->sp = frame;
+
+    live_ += 1;
+    spawned_ += 1;
+    make_ready(fiber);
+    return true;
+}
+
+void FiberRuntime::make_ready(Fiber* fiber) {
+    fiber->state = Fiber::FiberReady;
+    fiber->next = nullptr;
+    if (ready_tail)
+        ready_tail->next = fiber;
+    else
+        ready_head = fiber;
+    ready_tail = fiber;
+}
+
+void FiberRuntime::switch_to(Fiber* fiber) {
+    current_ = fiber;
+    switches_ += 1;
+    fiber_switch(&main_sp, fiber->sp);
+    current_ = nullptr;
+    if (*canary(fiber) != STACK_CANARY) {
+        Print((CHAR16*)L"fiber stack overflow, raise the stack size\n");
+        *canary(fiber) = STACK_CANARY;
+    }
+}
+
+void FiberRuntime::suspend() {
+    fiber_switch(&current_->sp, main_sp);
+}
+
+void FiberRuntime::finish(Fiber* fiber) {
+    live_ -= 1;
+    fiber->state = Fiber::FiberDone;
+    fiber->next = free_list;
+    free_list = fiber;
+    // Never resumed, the stack is reused by the next spawn.
+    void* discard;
+    fiber_switch(&discard, main_sp);
+}
+
+void FiberRuntime::yield() {
+    if (current_ == nullptr)
+        return;
+    make_ready(current_);
+    suspend();
+}
+
+EFI_STATUS FiberRuntime::wait(EFI_EVENT event) {
+    if (current_ == nullptr) {
+        UINTN index;
+        return uefi(bs->WaitForEvent, 1UL, &event, &index);
+    }
+    Fiber* fiber = current_;
+    fiber->state = Fiber::FiberWaiting;
+    fiber->waiting_on = event;
+    fiber->next = waiting;
+    waiting = fiber;
+    suspend();
+    return EFI_SUCCESS;
+}
+
+void FiberRuntime::wake_signaled() {
+    Fiber** link = &waiting;
+    while (*link) {
+        Fiber* fiber = *link;
+        if (check_event(fiber->waiting_on)) {
+            *link = fiber->next;
+            make_ready(fiber);
+        } else {
+            link = &fiber->next;
+        }
+    }
+}
+
+void FiberRuntime::run() {
+    FiberRuntime* outer = active;
+    active = this;
+    while (live_ > 0) {
+        while (ready_head) {
+            Fiber* fiber = ready_head;
+            ready_head = fiber->next;
+            if (ready_head == nullptr)
+                ready_tail = nullptr;
+            switch_to(fiber);
+        }
+        wake_signaled();
+        if (ready_head || waiting == nullptr)
+            continue;
+
+        // Everyone is parked: let the firmware idle until one event fires.
+        events.clear();
+        for (Fiber* fiber = waiting; fiber; fiber = fiber->next)
+            events.push_back(fiber->waiting_on);
+        UINTN index = 0;
+        if (EFI_ERROR(uefi(bs->WaitForEvent, (UINTN)events.size(), events.data(), &index)))
+            continue;
+        Fiber** link = &waiting;
+        for (; index > 0; --index)
+            link = &(*link)->next;
+        Fiber* fiber = *link;
+        *link = fiber->next;
+        make_ready(fiber);
+    }
+    active = outer;
+}
+
+EFI_STATUS fiber_sleep(std::size_t us) {
+    EFI_EVENT timer;
+    EFI_STATUS status = create_event(EVT_TIMER, 0, nullptr, nullptr, &timer);
+    if (EFI_ERROR(status))
+        return status;
+    status = set_timer(timer, TimerRelative, us * 10);
+    if (!EFI_ERROR(status))
+        status = wait_for(timer);
+    close_event(timer);
+    return status;
+}
+
+std::size_t fiber_read(EFI_FILE_PROTOCOL* file, void* buffer, std::size_t n) {
+    if (file->Revision < EFI_FILE_PROTOCOL_REVISION2)
+        return fread(file, (char*)buffer, n).value();
+    EFI_FILE_IO_TOKEN token {};
+    if (EFI_ERROR(create_event(0, 0, nullptr, nullptr, &token.Event)))
+        return fread(file, (char*)buffer, n).value();
+    token.BufferSize = n;
+    token.Buffer = buffer;
+    EFI_STATUS status = uefi(file->ReadEx, file, &token);
+    if (!EFI_ERROR(status))
+        status = wait_for(token.Event);
+    close_event(token.Event);
+    if (EFI_ERROR(status) || EFI_ERROR(token.Status))
+        return 0;
+    file_stats.reads += 1;
+    file_stats.read_bytes += token.BufferSize;
+    return token.BufferSize;
+}
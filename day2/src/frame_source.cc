@@ -0,0 +1,124 @@
+#include "frame_source.h"
+#include "net.h"
+
+void convert_frame_rows(const char* rgb, EFI_GRAPHICS_OUTPUT_BLT_PIXEL* out, std::size_t stride,
+                        std::size_t first, std::size_t end) {
+    for (std::size_t j = first; j < end; ++j) {
+        const char* src = rgb + j * FRAME_WIDTH * 3;
+        EFI_GRAPHICS_OUTPUT_BLT_PIXEL* dst = out + j * stride;
+        for (std::size_t i = 0; i < FRAME_WIDTH; ++i) {
+            dst[i].Red = src[i * 3 + 0];
+            dst[i].Green = src[i * 3 + 1];
+            dst[i].Blue = src[i * 3 + 2];
+        }
+    }
+}
+
+const char* FileFrameSource::next_frame() {
+    // No asset loaded: nothing to show, not frames read from address 0 on.
+    if (buffer == nullptr)
+        return nullptr;
+    const char* ptr = buffer + frame * FRAME_BYTES;
+    frame += 1;
+    frame %= frames;
+    return ptr;
+}
+
+NetFrameSource::~NetFrameSource() {
+    if (pending) {
+        uefi(tcp->Cancel, tcp, &token.CompletionToken);
+        wait_for(token.CompletionToken.Event);
+    }
+    if (tcp)
+        close_event(token.CompletionToken.Event);
+    free(slots);
+}
+
+EFI_STATUS NetFrameSource::open(EFI_TCP4* tcp) {
+    FrameStreamHeader header;
+    std::size_t got = 0;
+    while (got < sizeof(header)) {
+        auto n = recv(tcp, (char*)&header + got, sizeof(header) - got);
+        if (!n)
+            return n.status();
+        if (*n == 0)
+            return EFI_CONNECTION_FIN;
+        got += *n;
+    }
+    if (header.magic != FRAME_STREAM_MAGIC || header.width != FRAME_WIDTH
+            || header.height != FRAME_HEIGHT || header.frame_bytes != FRAME_BYTES)
+        return EFI_INCOMPATIBLE_VERSION;
+
+    slots = (char*)malloc(slot_count * FRAME_BYTES);
+    if (slots == nullptr)
+        return EFI_OUT_OF_RESOURCES;
+    EFI_STATUS status = create_event(0, 0, nullptr, nullptr, &token.CompletionToken.Event);
+    if (EFI_ERROR(status))
+        return status;
+    this->tcp = tcp;
+    pump();
+    return status_;
+}
+
+EFI_STATUS NetFrameSource::post_receive() {
+    std::size_t tail = head + ready + (holding ? 1 : 0);
+    token.Packet.RxData = &rx;
+    rx.UrgentFlag = FALSE;
+    rx.DataLength = FRAME_BYTES - filled;
+    rx.FragmentCount = 1;
+    rx.FragmentTable[0].FragmentLength = FRAME_BYTES - filled;
+    rx.FragmentTable[0].FragmentBuffer = (void*)(slot(tail) + filled);
+    return uefi(tcp->Receive, tcp, &token);
+}
+
+void NetFrameSource::pump() {
+    if (tcp == nullptr || EFI_ERROR(status_))
+        return;
+    while (true) {
+        if (pending) {
+            if (!check_event(token.CompletionToken.Event))
+                return;
+            pending = false;
+            if (EFI_ERROR(token.CompletionToken.Status)) {
+                status_ = token.CompletionToken.Status;
+                return;
+            }
+            filled += rx.DataLength;
+            if (filled == FRAME_BYTES) {
+                filled = 0;
+                ready += 1;
+                received_ += 1;
+            }
+        }
+        if (free_slots() == 0)
+            return;
+        EFI_STATUS status = post_receive();
+        if (EFI_ERROR(status)) {
+            status_ = status;
+            return;
+        }
+        pending = true;
+    }
+}
+
+const char* NetFrameSource::next_frame() {
+    pump();
+    const char* current = holding ? slot(head) : nullptr;
+    if (buffering) {
+        if (ready < prebuffer)
+            return current;
+        buffering = false;
+    }
+    if (ready == 0) {
+        buffering = true;
+        underruns_ += 1;
+        return current;
+    }
+    if (holding)
+        head = (head + 1) % slot_count;
+    holding = true;
+    ready -= 1;
+    // The slot shown until now is free again, keep the stream moving.
+    pump();
+    return slot(head);
+}
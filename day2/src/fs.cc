@@ -0,0 +1,128 @@
+#include "fs.h"
+
+FileStats file_stats;
+
+void fclose(EFI_FILE_PROTOCOL* file) {
+    uefi(file->Close, file);
+}
+
+Result<EFI_FILE_PROTOCOL*> fopen(EFI_FILE_PROTOCOL* root, const wchar_t* name, std::size_t mode, std::size_t attributes) {
+    EFI_FILE_PROTOCOL* file;
+    EFI_STATUS status = uefi(root->Open, root, &file, (CHAR16*)name, mode, attributes);
+    if (EFI_ERROR(status))
+        return fail(status);
+    return file;
+}
+
+Result<EFI_FILE_PROTOCOL*> open_fs_with_file(const wchar_t* name) {
+    auto handles = Handles(EFI_SIMPLE_FILE_SYSTEM_PROTOCOL_GUID).collect_interfaces<EFI_SIMPLE_FILE_SYSTEM_PROTOCOL>();
+    for (auto disk : handles) {
+        EFI_FILE_PROTOCOL* root;
+        EFI_STATUS status = uefi(disk->OpenVolume, disk, &root);
+        if (EFI_ERROR(status))
+            continue;
+        auto file = fopen(root, name, EFI_FILE_MODE_READ, EFI_FILE_READ_ONLY | EFI_FILE_HIDDEN | EFI_FILE_SYSTEM);
+        if (!file) {
+            fclose(root);
+            continue;
+        }
+        fclose(*file);
+        return root;
+    }
+    return fail(EFI_NOT_FOUND);
+}
+
+Result<std::size_t> fread(EFI_FILE_PROTOCOL* file, char* buffer, std::size_t n) {
+    EFI_STATUS status = uefi(file->Read, file, &n, (void*)buffer);
+    file_stats.reads += 1;
+    if (EFI_ERROR(status))
+        return fail(status);
+    file_stats.read_bytes += n;
+    return n;
+}
+
+Result<std::size_t> fwrite(EFI_FILE_PROTOCOL* file, char* buffer, std::size_t n) {
+    EFI_STATUS status = uefi(file->Write, file, &n, (void*)buffer);
+    file_stats.writes += 1;
+    if (EFI_ERROR(status))
+        return fail(status);
+    file_stats.write_bytes += n;
+    return n;
+}
+
+Result<EFI_FILE_INFO*> finfo(EFI_FILE_PROTOCOL* file) {
+    EFI_GUID guid = gEfiFileInfoGuid;
+    UINTN size = 0;
+    EFI_STATUS status = uefi(file->GetInfo, file, &guid, &size, (void*)nullptr);
+    if (status != EFI_BUFFER_TOO_SMALL)
+        return fail(EFI_ERROR(status) ? status : EFI_PROTOCOL_ERROR);
+    EFI_FILE_INFO* buffer = (EFI_FILE_INFO*)malloc(size);
+    if (buffer == nullptr)
+        return fail(EFI_OUT_OF_RESOURCES);
+    status = uefi(file->GetInfo, file, &guid, &size, (void*)buffer);
+    if (EFI_ERROR(status)) {
+        free(buffer);
+        return fail(status);
+    }
+    return buffer;
+}
+
+Result<EFI_FILE_PROTOCOL*> fcreate(EFI_FILE_PROTOCOL* root, const wchar_t* name) {
+    // No truncate in the file protocol: delete, then create afresh.
+    auto old = fopen(root, name, EFI_FILE_MODE_READ | EFI_FILE_MODE_WRITE, 0);
+    if (old)
+        uefi(old->Delete, *old);
+    return fopen(root, name, EFI_FILE_MODE_READ | EFI_FILE_MODE_WRITE | EFI_FILE_MODE_CREATE, 0);
+}
+
+TextWriter& SinkWriter::reserve(std::size_t n) {
+    if (out.size() + n > sizeof(buffer))
+        flush();
+    return out;
+}
+
+void SinkWriter::put(const void* data, std::size_t n) {
+    const char* bytes = (const char*)data;
+    while (n && !failed_) {
+        if (out.size() == sizeof(buffer))
+            flush();
+        std::size_t room = sizeof(buffer) - out.size();
+        std::size_t chunk = room < n ? room : n;
+        out.put(bytes, chunk);
+        bytes += chunk;
+        n -= chunk;
+    }
+}
+
+void SinkWriter::flush() {
+    if (!failed_ && out.size() && !sink(ctx, out.data(), out.size()))
+        failed_ = true;
+    out.clear();
+}
+
+namespace {
+    struct FileSink {
+        EFI_FILE_PROTOCOL* file;
+        EFI_STATUS status;
+    };
+}
+
+EFI_STATUS fwrite_stream(EFI_FILE_PROTOCOL* root, const wchar_t* name, StreamProducer produce, std::size_t* count) {
+    auto file = fcreate(root, name);
+    if (!file)
+        return file.status();
+    FileSink out { *file, EFI_SUCCESS };
+    std::size_t produced = produce([](void* ctx, const char* data, std::size_t n) {
+        FileSink* out = (FileSink*)ctx;
+        auto written = fwrite(out->file, (char*)data, n);
+        if (!written)
+            out->status = written.status();
+        else if (*written != n)
+            out->status = EFI_VOLUME_FULL;
+        return !EFI_ERROR(out->status);
+    }, &out);
+    fclose(*file);
+    if (count)
+        *count = produced;
+    return out.status;
+}
@@ -0,0 +1,267 @@
+#include "http.h"
+
+static const char* reason(UINT16 status) {
+    switch (status) {
+        case 200: return "OK";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 413: return "Payload Too Large";
+        case 431: return "Request Header Fields Too Large";
+        case 503: return "Service Unavailable";
+        default: return "Error";
+    }
+}
+
+static char lower(char c) {
+    return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c;
+}
+
+// Case-insensitive match of a header name against a lowercase literal.
+static bool name_equals(const char* text, std::size_t n, const char* literal) {
+    for (std::size_t i=0; i < n; ++i) {
+        if (literal[i] != lower(text[i]))
+            return false;
+    }
+    return literal[n] == '\0';
+}
+
+static bool contains_token(const char* text, std::size_t n, const char* token) {
+    for (std::size_t i=0; i < n; ++i) {
+        std::size_t j = 0;
+        while (token[j] && i + j < n && lower(text[i + j]) == token[j])
+            ++j;
+        if (token[j] == '\0')
+            return true;
+    }
+    return false;
+}
+
+// Offset of the first "\r\n\r\n", or n when there is none.
+static std::size_t find_header_end(const char* text, std::size_t n) {
+    for (std::size_t i=0; i + 3 < n; ++i) {
+        if (text[i] == '\r' && text[i + 1] == '\n' && text[i + 2] == '\r' && text[i + 3] == '\n')
+            return i;
+    }
+    return n;
+}
+
+static std::size_t find(const char* text, std::size_t n, char c) {
+    for (std::size_t i=0; i < n; ++i) {
+        if (text[i] == c)
+            return i;
+    }
+    return n;
+}
+
+HttpServer::HttpServer(std::size_t max_clients)
+    : server(*this, max_clients, max_clients, 4096, 4 * (BODY_SIZE + HEADER_SIZE)), connections(max_clients) {}
+
+HttpServer::~HttpServer() {
+    free(request_space);
+    free(scratch);
+}
+
+bool HttpServer::route(const char* path, HttpRoute& route) {
+    if (route_count == MAX_ROUTES)
+        return false;
+    routes[route_count++] = { path, &route };
+    return true;
+}
+
+EFI_STATUS HttpServer::open(EFI_SERVICE_BINDING* service, UINT16 port) {
+    request_space = (char*)malloc(connections.size() * REQUEST_SIZE);
+    scratch = (char*)malloc(BODY_SIZE);
+    if (request_space == nullptr || scratch == nullptr)
+        return EFI_OUT_OF_RESOURCES;
+    for (std::size_t i=0; i < connections.size(); ++i)
+        connections[i] = { request_space + i * REQUEST_SIZE, 0, nullptr, 0 };
+    TcpConfig config = TcpConfig::latency();
+    config.passive().local_port(port);
+    return server.open(service, config);
+}
+
+void HttpServer::on_accept(TcpClient& client) {
+    Connection& connection = connections[client.id()];
+    connection.length = 0;
+    connection.holding = nullptr;
+    connection.held = 0;
+}
+
+void HttpServer::on_data(TcpClient& client, const char* data, std::size_t n) {
+    Connection& connection = connections[client.id()];
+    std::size_t room = REQUEST_SIZE - connection.length;
+    if (n > room) {
+        // Make room by answering what is already buffered first.
+        process(client);
+        room = REQUEST_SIZE - connection.length;
+        if (n > room) {
+            fail(client, 503);
+            return;
+        }
+    }
+    memcpy(connection.buffer + connection.length, data, n);
+    connection.length += n;
+    process(client);
+}
+
+void HttpServer::on_sent(TcpClient& client) {
+    Connection& connection = connections[client.id()];
+    if (client.tx_idle())
+        drop_held(connection);
+    process(client);
+}
+
+void HttpServer::on_close(TcpClient& client) {
+    Connection& connection = connections[client.id()];
+    drop_held(connection);
+    connection.length = 0;
+}
+
+void HttpServer::drop_held(Connection& connection) {
+    for (; connection.held > 0; --connection.held)
+        connection.holding->release();
+    connection.holding = nullptr;
+}
+
+void HttpServer::process(TcpClient& client) {
+    Connection& connection = connections[client.id()];
+    std::size_t answered = 0;
+    while (connection.length > 0 && client.is_open()) {
+        std::size_t used = handle_one(client, connection);
+        if (used == 0)
+            return;
+        // Shift the pipelined remainder to the front, regions may overlap.
+        for (std::size_t i=used; i < connection.length; ++i)
+            connection.buffer[i - used] = connection.buffer[i];
+        connection.length -= used;
+        if (answered++ > 0)
+            pipelined_ += 1;
+    }
+}
+
+std::size_t HttpServer::handle_one(TcpClient& client, Connection& connection) {
+    const char* text = connection.buffer;
+    std::size_t end = find_header_end(text, connection.length);
+    if (end == connection.length) {
+        if (connection.length == REQUEST_SIZE)
+            fail(client, 431);
+        return 0;
+    }
+
+    // Request line: METHOD SP target SP version
+    std::size_t line_end = find(text, end, '\r');
+    HttpRequest request;
+    request.method = text;
+    request.method_length = find(text, line_end, ' ');
+    if (request.method_length == line_end) {
+        fail(client, 400);
+        return 0;
+    }
+    request.path = text + request.method_length + 1;
+    std::size_t rest = line_end - request.method_length - 1;
+    std::size_t target_length = find(request.path, rest, ' ');
+    if (target_length == rest || target_length == 0) {
+        fail(client, 400);
+        return 0;
+    }
+    request.path_length = find(request.path, target_length, '?');
+    const char* version = request.path + target_length + 1;
+    std::size_t version_length = rest - target_length - 1;
+    request.keep_alive = text_equals(version, version_length, "HTTP/1.1");
+
+    std::size_t content_length = 0;
+    std::size_t pos = line_end + 2;
+    while (pos < end) {
+        std::size_t n = find(text + pos, end - pos, '\r');
+        const char* line = text + pos;
+        std::size_t colon = find(line, n, ':');
+        if (colon < n) {
+            const char* value = line + colon + 1;
+            std::size_t value_length = n - colon - 1;
+            if (name_equals(line, colon, "connection")) {
+                if (contains_token(value, value_length, "close"))
+                    request.keep_alive = false;
+                else if (contains_token(value, value_length, "keep-alive"))
+                    request.keep_alive = true;
+            } else if (name_equals(line, colon, "content-length")) {
+                for (std::size_t i=0; i < value_length; ++i) {
+                    if (value[i] >= '0' && value[i] <= '9')
+                        content_length = content_length * 10 + (value[i] - '0');
+                }
+            }
+        }
+        pos += n + 2;
+    }
+
+    std::size_t total = end + 4 + content_length;
+    if (total > REQUEST_SIZE) {
+        fail(client, 413);
+        return 0;
+    }
+    if (total > connection.length)
+        return 0;
+    // Answer only once the whole response is sure to fit the transmit queue,
+    // otherwise wait for on_sent().
+    if (client.tx_space() < HEADER_SIZE + BODY_SIZE || client.tx_segments_free() < 3)
+        return 0;
+
+    bool get = text_equals(request.method, request.method_length, "GET");
+    bool head = text_equals(request.method, request.method_length, "HEAD");
+    HttpResponse response(scratch, BODY_SIZE);
+    HttpRoute* route = nullptr;
+    for (std::size_t i=0; i < route_count; ++i) {
+        if (text_equals(request.path, request.path_length, routes[i].path)) {
+            route = routes[i].route;
+            break;
+        }
+    }
+    if (!get && !head) {
+        response.set_status(405);
+        response.body().put("method not allowed\n");
+    } else if (route == nullptr) {
+        response.set_status(404);
+        response.body().put("not found\n");
+    } else {
+        // A response holding attached data from another route waits its turn.
+        if (connection.held > 0 && connection.holding != route)
+            return 0;
+        route->serve(request, response);
+        if (response.attached != nullptr) {
+            connection.holding = route;
+            connection.held += 1;
+        }
+    }
+    requests_ += 1;
+    send_response(client, response, request.keep_alive, head);
+    return total;
+}
+
+void HttpServer::send_response(TcpClient& client, HttpResponse& response, bool keep_alive, bool head) {
+    if (response.status >= 400)
+        errors_ += 1;
+    char header[HEADER_SIZE];
+    TextWriter out(header, sizeof(header));
+    out.put("HTTP/1.1 ").put((UINT64)response.status).put(' ').put(reason(response.status)).put("\r\n");
+    out.put("Content-Type: ").put(response.content_type).put("\r\n");
+    out.put("Content-Length: ").put((UINT64)(response.body_.size() + response.attached_size)).put("\r\n");
+    out.put(keep_alive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n");
+    client.send(out.data(), out.size());
+    if (!head) {
+        if (response.body_.size())
+            client.send(response.body_.data(), response.body_.size());
+        if (response.attached != nullptr)
+            client.send_ref(response.attached, response.attached_size);
+    }
+    if (!keep_alive)
+        client.close();
+}
+
+void HttpServer::fail(TcpClient& client, UINT16 status) {
+    char buffer[64];
+    HttpResponse response(buffer, sizeof(buffer));
+    response.set_status(status);
+    response.body().put(reason(status)).put('\n');
+    connections[client.id()].length = 0;
+    send_response(client, response, false, false);
+}
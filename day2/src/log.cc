@@ -0,0 +1,122 @@
+#include "log.h"
+#include "port_io.h"
+
+LogState log_state;
+
+static constexpr UINT16 COM1 = 0x3f8;
+static constexpr UINT16 UART_DATA = COM1 + 0;
+static constexpr UINT16 UART_IER = COM1 + 1;
+static constexpr UINT16 UART_FCR = COM1 + 2;
+static constexpr UINT16 UART_LCR = COM1 + 3;
+static constexpr UINT16 UART_MCR = COM1 + 4;
+static constexpr UINT16 UART_LSR = COM1 + 5;
+static constexpr UINT8 LSR_THR_EMPTY = 0x20;
+// A 16550 takes this many bytes each time the transmit FIFO runs empty.
+static constexpr std::size_t UART_FIFO = 16;
+
+// The line being sent, kept between log_drain() calls when the UART fills up.
+static char pending[LOG_TEXT + 32];
+static std::size_t pending_size = 0;
+static std::size_t pending_sent = 0;
+static bool uart_present = false;
+
+void log_init(LogLevel level) {
+    log_set_level(level);
+    // No UART decodes the port, reads float high.
+    uart_present = inb(UART_LSR) != 0xff;
+    if (!uart_present)
+        return;
+    outb(UART_IER, 0x00);        // polled, no interrupts
+    outb(UART_LCR, 0x80);        // divisor latch
+    outb(UART_DATA, 0x01);       // 115200 baud
+    outb(UART_IER, 0x00);
+    outb(UART_LCR, 0x03);        // 8N1
+    outb(UART_FCR, 0xc7);        // FIFO on and cleared
+    outb(UART_MCR, 0x03);        // DTR, RTS, OUT2 off keeps the IRQ line quiet
+}
+
+void log_set_level(LogLevel level) {
+    log_state.level.store(level, std::memory_order_relaxed);
+}
+
+const char* log_level_name(LogLevel level) {
+    switch (level) {
+        case LogDebug: return "debug";
+        case LogInfo: return "info";
+        case LogWarn: return "warn";
+        case LogError: return "error";
+    }
+    return "?";
+}
+
+LogLine::~LogLine() {
+    if (!enabled)
+        return;
+    record.length = (UINT8)out.size();
+    log_state.stats.records.fetch_add(1, std::memory_order_relaxed);
+    if (out.overflowed())
+        log_state.stats.truncated.fetch_add(1, std::memory_order_relaxed);
+    log_state.queue.push(record);
+}
+
+void log_text(LogLevel level, const char* text) {
+    log_line(level).put(text);
+}
+
+// "[   12.345678] W text\r\n", seconds since clock_init().
+static void format_record(const LogRecord& record) {
+    static const char LEVELS[] = "DIWE";
+    TextWriter out(pending, sizeof(pending));
+    UINT64 us = record.tsc > clock_calibration.base_tsc ? cycles_to_us(record.tsc - clock_calibration.base_tsc) : 0;
+    out.put('[');
+    for (UINT64 width = 1'000'000'000; width > 1'000'000 && us < width; width /= 10)
+        out.put(' ');
+    out.put(us / 1'000'000).put('.');
+    for (UINT64 digit = 100'000; digit > 0; digit /= 10)
+        out.put((char)('0' + us / digit % 10));
+    out.put("] ").put(LEVELS[record.level & 3]).put(' ');
+    out.put(record.text, record.length).put("\r\n");
+    pending_size = out.size();
+    pending_sent = 0;
+}
+
+// Fills the transmit FIFO if it is empty, returns the bytes written.
+static std::size_t send_batch() {
+    if (!(inb(UART_LSR) & LSR_THR_EMPTY))
+        return 0;
+    std::size_t n = pending_size - pending_sent;
+    if (n > UART_FIFO)
+        n = UART_FIFO;
+    for (std::size_t i = 0; i < n; ++i)
+        outb(UART_DATA, (UINT8)pending[pending_sent + i]);
+    pending_sent += n;
+    return n;
+}
+
+std::size_t log_drain(std::size_t max_bytes) {
+    std::size_t written = 0;
+    while (written < max_bytes) {
+        if (pending_sent == pending_size) {
+            LogRecord record;
+            if (!log_state.queue.pop(record))
+                break;
+            format_record(record);
+        }
+        if (!uart_present) {
+            pending_sent = pending_size;
+            continue;
+        }
+        std::size_t n = send_batch();
+        if (n == 0)
+            break;
+        written += n;
+    }
+    log_state.stats.written += written;
+    return written;
+}
+
+void log_flush() {
+    // Nothing written with a line still pending means the FIFO is busy.
+    while (log_drain() || pending_sent != pending_size)
+        __builtin_ia32_pause();
+}
@@ -1,14 +1,26 @@
-extern "C" {
-
-	#include <efi.h>
-	#include <efilib.h>
-
-}
-
-#include <functional>
+#include "uefi.h"
+#include "fs.h"
+#include "assets.h"
+#include "net.h"
+#include "tcp_server.h"
+#include "http.h"
+#include "metrics.h"
+#include "text.h"
+#include "frame_source.h"
+#include "telemetry.h"
+#include "scheduler.h"
+#include "parallel.h"
+#include "sync.h"
+#include "clock.h"
+#include "profiler.h"
+#include "trace.h"
+#include "draw.h"
+#include "port_io.h"
+#include "qemu.h"
+#include "log.h"
+#include "binlog.h"
+#include "status.h"
 #include "pitches.h"
-#include <vector>
-#include <cstring>
 EFI_STATUS cxx_main(EFI_HANDLE, EFI_SYSTEM_TABLE*);
 
 extern "C" {
@@ -23,283 +35,6 @@ extern "C" {
 
 }
 
-static EFI_SYSTEM_TABLE* st;
-static EFI_BOOT_SERVICES* bs;
-
-template<typename RetVal, typename ... Args>
-auto uefi(RetVal (*ptr)(Args...), Args... args) {
-    typedef RetVal (*FuncPtr)(Args...);
-    typedef __attribute__((ms_abi)) FuncPtr MSFuncPtr;
-    MSFuncPtr mptr = reinterpret_cast<MSFuncPtr>(ptr);
-    return std::invoke(mptr, args...);
-}
-
-
-extern "C" {
-    void * malloc(std::size_t n) {
-        return AllocatePool(n);
-    }
-
-    void free(void* ptr) {
-        FreePool(ptr);
-    }
-}
-
-namespace efi {
-    template<typename T>
-    struct Allocator {
-        typedef T value_type;
-
-        T* allocate(std::size_t n) {
-            return reinterpret_cast<T*>(malloc(n * sizeof(T)));
-        }
-
-        void deallocate(T* ptr, std::size_t) {
-            free(ptr);
-        }
-    };
-
-
-    template<typename T>
-    using vector = std::vector<T, Allocator<T>>;
-    template<typename CharT>
-    using basic_string = std::basic_string<CharT, std::char_traits<CharT>, Allocator<CharT>>;
-}
-
-EFI_STATUS create_event(UINT32 type, EFI_TPL tpl, EFI_EVENT_NOTIFY func, void* ctx, EFI_EVENT* event) {
-    return uefi(bs->CreateEvent, type, tpl, func, ctx, event);
-}
-
-EFI_STATUS close_event(EFI_EVENT event) {
-    return uefi(bs->CloseEvent, event);
-}
-
-EFI_STATUS wait_for(EFI_EVENT event) {
-    UINTN tmp;
-    return uefi(bs->WaitForEvent, 1UL, &event, &tmp);
-}
-
-template<typename Interface>
-EFI_STATUS handle_protocol(EFI_HANDLE handle, EFI_GUID* guid, Interface*& interface) {
-    return uefi(bs->HandleProtocol, handle, guid, (void**)&interface);
-}
-
-class Handles {
-    EFI_HANDLE* handles;
-    UINTN size_;
-    EFI_GUID guid_;
-public:
-    Handles(const Handles& ) = delete;
-    Handles(const EFI_GUID& guid) : guid_(guid) {
-        EFI_STATUS status = uefi(bs->LocateHandleBuffer, ByProtocol, &guid_, (void*)0, &size_, &handles);
-        if (!EFIERR(status)) {
-            size_ = 0;
-            handles = nullptr;
-        }
-    }
-    ~Handles() {
-        free(handles);
-    }
-    
-    std::size_t size() {
-        return size_;
-    } 
-
-    EFI_HANDLE operator[](std::size_t n) {
-        return handles[n];
-    }
-
-    template<typename Interface>
-    efi::vector<Interface*> collect_interfaces() {
-        efi::vector<Interface*> interfaces;
-        for (std::size_t i=0; i < size_; ++i) {
-            Interface* interface;
-            EFI_STATUS status = handle_protocol(handles[i], &guid_, interface);
-            if (status == EFI_SUCCESS) {
-                interfaces.push_back(interface);
-            }
-        } 
-        return interfaces;
-    }
-};
-
-void fclose(EFI_FILE_PROTOCOL* file) {
-    uefi(file->Close, file);
-}
-
-EFI_FILE_PROTOCOL* fopen(EFI_FILE_PROTOCOL* root, const wchar_t* name, std::size_t mode, std::size_t attributes) {
-    EFI_FILE_PROTOCOL* file;
-    EFI_STATUS status = uefi(root->Open, root, &file, (CHAR16*)name, mode, attributes);
-    return !EFIERR(status) ? nullptr : file;
-}
-
-EFI_FILE_PROTOCOL* open_fs_with_file(const wchar_t* name) {
-    auto handles = Handles(EFI_SIMPLE_FILE_SYSTEM_PROTOCOL_GUID).collect_interfaces<EFI_SIMPLE_FILE_SYSTEM_PROTOCOL>();
-    for (auto disk : handles) {
-        EFI_FILE_PROTOCOL* root;
-        EFI_STATUS status = uefi(disk->OpenVolume, disk, &root); 
-        if (!EFIERR(status))
-            continue;
-        auto file = fopen(root, name, EFI_FILE_MODE_READ, EFI_FILE_READ_ONLY | EFI_FILE_HIDDEN | EFI_FILE_SYSTEM);
-        if (!file)
-            continue;
-        fclose(file);
-        return root;
-    }
-    return nullptr;
-}
-
-std::size_t fread(EFI_FILE_PROTOCOL* file, char* buffer, std::size_t n) {
-    uefi(file->Read, file, &n, (void*)buffer);
-    return n;
-}
-
-std::size_t fwrite(EFI_FILE_PROTOCOL* file, char* buffer, std::size_t n) {
-    uefi(file->Write, file, &n, (void*)buffer);
-    return n;
-}
-
-EFI_FILE_INFO* finfo(EFI_FILE_PROTOCOL* file) {
-    EFI_FILE_INFO* buffer = nullptr;
-    EFI_GUID guid = gEfiFileInfoGuid;
-    UINTN size = 0;
-    uefi(file->GetInfo, file, &guid, &size, (void*)buffer);
-    buffer = (EFI_FILE_INFO*)malloc(size);
-    uefi(file->GetInfo, file, &guid, &size, (void*)buffer);
-    return buffer;
-}
-
-inline void bp() {
-    bool wait = 1;
-    while (wait);
-}
-
-efi::vector<EFI_GRAPHICS_OUTPUT_PROTOCOL*> open_screens() {
-    return Handles(EFI_GRAPHICS_OUTPUT_PROTOCOL_GUID).collect_interfaces<EFI_GRAPHICS_OUTPUT_PROTOCOL>();
-}
-
-class Screen {
-    EFI_GRAPHICS_OUTPUT_PROTOCOL* interface;
-public:
-    Screen(EFI_GRAPHICS_OUTPUT_PROTOCOL* interface) :interface(interface) {}
-    EFI_STATUS blt(
-                EFI_GRAPHICS_OUTPUT_BLT_PIXEL* buffer,
-                EFI_GRAPHICS_OUTPUT_BLT_OPERATION   BltOperation,
-                UINTN SourceX,
-                UINTN SourceY,
-                UINTN DestinationX,
-                UINTN DestinationY,
-                UINTN Width,
-                UINTN Height,
-                UINTN Delta
-            ) {
-        return uefi(interface->Blt, interface, buffer, BltOperation, SourceX, SourceY, DestinationX,  DestinationY, Width, Height, Delta);
-    }
-    EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE* get_mode() {
-        return interface->Mode;
-    }
-};
-
-efi::vector<EFI_SERVICE_BINDING*> get_tcp4_services() {
-    return Handles(EFI_TCP4_SERVICE_BINDING_PROTOCOL).collect_interfaces<EFI_SERVICE_BINDING>();
-}
-
-EFI_TCP4* socket(EFI_SERVICE_BINDING* service) {
-    EFI_HANDLE handle;
-    EFI_STATUS status = uefi(service->CreateChild, service, &handle);
-    if (!EFIERR(status)) 
-        return nullptr;
-    EFI_GUID guid = EFI_TCP4_PROTOCOL;
-    EFI_TCP4* tcp;
-    status = handle_protocol(handle, &guid, tcp);
-    if (!EFIERR(status))
-        return nullptr;
-    return tcp;
-}
-
-void close(EFI_SERVICE_BINDING* service, EFI_TCP4* tcp) {
-    uefi(service->DestroyChild, service, (void*)tcp);
-}
-
-EFI_STATUS socket_config(EFI_TCP4* tcp, EFI_TCP4_CONFIG_DATA& config) {
-    return uefi(tcp->Configure, tcp, &config);
-}
-
-EFI_STATUS connect(EFI_TCP4* tcp) {
-    EFI_TCP4_CONNECTION_TOKEN token;
-    EFI_STATUS status = create_event(0, 0, nullptr, nullptr, &token.CompletionToken.Event);
-    if (!EFIERR(status))
-        return status;
-    status = uefi(tcp->Connect, tcp, &token);
-    if (!EFIERR(status)) {
-        close_event(token.CompletionToken.Event);
-        return status;
-    }
-    status = wait_for(token.CompletionToken.Event);
-    close_event(token.CompletionToken.Event);
-    if (!EFIERR(status)) {
-        return status;
-    }
-    return token.CompletionToken.Status;
-}
-
-std::size_t send(EFI_TCP4* tcp, char* buffer, std::size_t n) {
-    EFI_TCP4_IO_TOKEN token;
-    EFI_STATUS status = create_event(0, 0, nullptr, nullptr, &token.CompletionToken.Event);
-    if (EFI_ERROR(status))
-        return 0;
-    EFI_TCP4_TRANSMIT_DATA mTx;
-    token.Packet.TxData = &mTx;
-    mTx.Push = TRUE;
-    mTx.Urgent = FALSE;
-    mTx.DataLength = n;
-    mTx.FragmentCount = 1;
-    mTx.FragmentTable[0].FragmentLength = n;
-    mTx.FragmentTable[0].FragmentBuffer = (void*)buffer;
-    status = uefi(tcp->Transmit, tcp, &token);
-    if (EFI_ERROR(status)) {
-        close_event(token.CompletionToken.Event);
-        return 0;
-    }
-
-    status = wait_for(token.CompletionToken.Event);
-    close_event(token.CompletionToken.Event);
-    if (EFI_ERROR(status)) {
-        return 0;
-    }
-    return mTx.DataLength;
-}
-
-std::size_t recv(EFI_TCP4* tcp, char* buffer, std::size_t n) {
-    EFI_TCP4_IO_TOKEN token;
-    EFI_STATUS status = create_event(0, 0, nullptr, nullptr, &token.CompletionToken.Event);
-    EFI_TCP4_RECEIVE_DATA mRx;
-    token.Packet.RxData = &mRx;
-    mRx.UrgentFlag = FALSE;
-    mRx.DataLength = n;
-    mRx.FragmentCount = 1;
-    mRx.FragmentTable[0].FragmentLength = n;
-    mRx.FragmentTable[0].FragmentBuffer = (void*)buffer;
-    status = uefi(tcp->Receive, tcp, &token);
-    if (EFI_ERROR(status)) {
-        close_event(token.CompletionToken.Event);
-        return 0;
-    }
-    status = wait_for(token.CompletionToken.Event);
-    close_event(token.CompletionToken.Event);
-    if (EFI_ERROR(status)) {
-        return 0;
-    }
-    return mRx.DataLength;
-}
-
-void close(EFI_TCP4* tcp) {
-    EFI_TCP4_CLOSE_TOKEN token;
-    EFI_STATUS status = create_event(0, 0, nullptr, nullptr, &token.CompletionToken.Event);
-    status = uefi(tcp->Close, tcp, &token);
-    status = wait_for(token.CompletionToken.Event);
-}
-
 bool isKeyPressed(wchar_t ch) {
     EFI_INPUT_KEY key;
     EFI_STATUS status = uefi(st->ConIn->ReadKeyStroke, st->ConIn, &key);
@@ -310,27 +45,6 @@ bool isKeyPressed(wchar_t ch) {
     }
 }
 
-static inline void outb(uint16_t port, uint8_t val)
-{
-    asm volatile ( "outb %0, %1" : : "a"(val), "Nd"(port) );
-    /* There's an outb %al, $imm8  encoding, for compile-time constant port numbers that fit in 8b.  (N constraint).
-     * Wider immediate constants would be truncated at assemble-time (e.g. "i" constraint).
-     * The  outb  %al, %dx  encoding is the only option for all other cases.
-     * %1 expands to %dx because  port  is a uint16_t.  %w1 could be used if we had the port number a wider C type */
-}
-static inline uint8_t inb(uint16_t port)
-{
-    uint8_t ret;
-    asm volatile ( "inb %1, %0"
-                   : "=a"(ret)
-                   : "Nd"(port) );
-    return ret;
-}
-
-EFI_STATUS sleep(std::size_t us) {
-    return uefi(bs->Stall, us);
-}
-
  static void play_sound(uint32_t nFrequence) {
  	uint32_t Div;
  	uint8_t tmp;
@@ -363,105 +77,6 @@ EFI_STATUS sleep(std::size_t us) {
           //set_PIT_2(old_frequency);
  }
 
-static const char System5x7[]  = {
-    0x00, 0x00, 0x00, 0x00, 0x00,// (space)
-	0x00, 0x00, 0x5F, 0x00, 0x00,// !
-	0x00, 0x07, 0x00, 0x07, 0x00,// "
-	0x14, 0x7F, 0x14, 0x7F, 0x14,// #
-	0x24, 0x2A, 0x7F, 0x2A, 0x12,// $
-	0x23, 0x13, 0x08, 0x64, 0x62,// %
-	0x36, 0x49, 0x55, 0x22, 0x50,// &
-	0x00, 0x05, 0x03, 0x00, 0x00,// '
-	0x00, 0x1C, 0x22, 0x41, 0x00,// (
-	0x00, 0x41, 0x22, 0x1C, 0x00,// )
-	0x08, 0x2A, 0x1C, 0x2A, 0x08,// *
-	0x08, 0x08, 0x3E, 0x08, 0x08,// +
-	0x00, 0x50, 0x30, 0x00, 0x00,// ,
-	0x08, 0x08, 0x08, 0x08, 0x08,// -
-	0x00, 0x60, 0x60, 0x00, 0x00,// .
-	0x20, 0x10, 0x08, 0x04, 0x02,// /
-	0x3E, 0x51, 0x49, 0x45, 0x3E,// 0
-	0x00, 0x42, 0x7F, 0x40, 0x00,// 1
-	0x42, 0x61, 0x51, 0x49, 0x46,// 2
-	0x21, 0x41, 0x45, 0x4B, 0x31,// 3
-	0x18, 0x14, 0x12, 0x7F, 0x10,// 4
-	0x27, 0x45, 0x45, 0x45, 0x39,// 5
-	0x3C, 0x4A, 0x49, 0x49, 0x30,// 6
-	0x01, 0x71, 0x09, 0x05, 0x03,// 7
-	0x36, 0x49, 0x49, 0x49, 0x36,// 8
-	0x06, 0x49, 0x49, 0x29, 0x1E,// 9
-	0x00, 0x36, 0x36, 0x00, 0x00,// :
-	0x00, 0x56, 0x36, 0x00, 0x00,// ;
-	0x00, 0x08, 0x14, 0x22, 0x41,// <
-	0x14, 0x14, 0x14, 0x14, 0x14,// =
-	0x41, 0x22, 0x14, 0x08, 0x00,// >
-	0x02, 0x01, 0x51, 0x09, 0x06,// ?
-	0x32, 0x49, 0x79, 0x41, 0x3E,// @
-	0x7E, 0x11, 0x11, 0x11, 0x7E,// A
-	0x7F, 0x49, 0x49, 0x49, 0x36,// B
-	0x3E, 0x41, 0x41, 0x41, 0x22,// C
-	0x7F, 0x41, 0x41, 0x22, 0x1C,// D
-	0x7F, 0x49, 0x49, 0x49, 0x41,// E
-	0x7F, 0x09, 0x09, 0x01, 0x01,// F
-	0x3E, 0x41, 0x41, 0x51, 0x32,// G
-	0x7F, 0x08, 0x08, 0x08, 0x7F,// H
-	0x00, 0x41, 0x7F, 0x41, 0x00,// I
-	0x20, 0x40, 0x41, 0x3F, 0x01,// J
-	0x7F, 0x08, 0x14, 0x22, 0x41,// K
-	0x7F, 0x40, 0x40, 0x40, 0x40,// L
-	0x7F, 0x02, 0x04, 0x02, 0x7F,// M
-	0x7F, 0x04, 0x08, 0x10, 0x7F,// N
-	0x3E, 0x41, 0x41, 0x41, 0x3E,// O
-	0x7F, 0x09, 0x09, 0x09, 0x06,// P
-	0x3E, 0x41, 0x51, 0x21, 0x5E,// Q
-	0x7F, 0x09, 0x19, 0x29, 0x46,// R
-	0x46, 0x49, 0x49, 0x49, 0x31,// S
-	0x01, 0x01, 0x7F, 0x01, 0x01,// T
-	0x3F, 0x40, 0x40, 0x40, 0x3F,// U
-	0x1F, 0x20, 0x40, 0x20, 0x1F,// V
-	0x7F, 0x20, 0x18, 0x20, 0x7F,// W
-	0x63, 0x14, 0x08, 0x14, 0x63,// X
-	0x03, 0x04, 0x78, 0x04, 0x03,// Y
-	0x61, 0x51, 0x49, 0x45, 0x43,// Z
-	0x00, 0x00, 0x7F, 0x41, 0x41,// [
-	0x02, 0x04, 0x08, 0x10, 0x20,// "\"
-	0x41, 0x41, 0x7F, 0x00, 0x00,// ]
-	0x04, 0x02, 0x01, 0x02, 0x04,// ^
-	0x40, 0x40, 0x40, 0x40, 0x40,// _
-	0x00, 0x01, 0x02, 0x04, 0x00,// `
-	0x20, 0x54, 0x54, 0x54, 0x78,// a
-	0x7F, 0x48, 0x44, 0x44, 0x38,// b
-	0x38, 0x44, 0x44, 0x44, 0x20,// c
-	0x38, 0x44, 0x44, 0x48, 0x7F,// d
-	0x38, 0x54, 0x54, 0x54, 0x18,// e
-	0x08, 0x7E, 0x09, 0x01, 0x02,// f
-	0x08, 0x14, 0x54, 0x54, 0x3C,// g
-	0x7F, 0x08, 0x04, 0x04, 0x78,// h
-	0x00, 0x44, 0x7D, 0x40, 0x00,// i
-	0x20, 0x40, 0x44, 0x3D, 0x00,// j
-	0x00, 0x7F, 0x10, 0x28, 0x44,// k
-	0x00, 0x41, 0x7F, 0x40, 0x00,// l
-	0x7C, 0x04, 0x18, 0x04, 0x78,// m
-	0x7C, 0x08, 0x04, 0x04, 0x78,// n
-	0x38, 0x44, 0x44, 0x44, 0x38,// o
-	0x7C, 0x14, 0x14, 0x14, 0x08,// p
-	0x08, 0x14, 0x14, 0x18, 0x7C,// q
-	0x7C, 0x08, 0x04, 0x04, 0x08,// r
-	0x48, 0x54, 0x54, 0x54, 0x20,// s
-	0x04, 0x3F, 0x44, 0x40, 0x20,// t
-	0x3C, 0x40, 0x40, 0x20, 0x7C,// u
-	0x1C, 0x20, 0x40, 0x20, 0x1C,// v
-	0x3C, 0x40, 0x30, 0x40, 0x3C,// w
-	0x44, 0x28, 0x10, 0x28, 0x44,// x
-	0x0C, 0x50, 0x50, 0x50, 0x3C,// y
-	0x44, 0x64, 0x54, 0x4C, 0x44,// z
-	0x00, 0x08, 0x36, 0x41, 0x00,// {
-	0x00, 0x00, 0x7F, 0x00, 0x00,// |
-	0x00, 0x41, 0x36, 0x08, 0x00,// }
-	0x08, 0x08, 0x2A, 0x1C, 0x08,// ->
-	0x08, 0x1C, 0x2A, 0x08, 0x08 // <-
-
-};
 
 /*Nyan Cat
   with Bass
@@ -579,43 +194,10 @@ int noteDurations[] = {
   8,16,16,16,16,16,16,16,16,16,16,8,8,
 };
 
-EFI_STATUS set_timer(EFI_EVENT event, EFI_TIMER_DELAY type, std::size_t time) {
-    return uefi(bs->SetTimer, event, type, time);
-}
-
 EFI_EVENT gui_draw_event;
-EFI_EVENT sound_event;
 
 EFI_GRAPHICS_OUTPUT_BLT_PIXEL fb[800*600];
 
-void fill(std::size_t w, std::size_t h, EFI_GRAPHICS_OUTPUT_BLT_PIXEL color) {
-    for (std::size_t i=0; i < w; ++i) {
-        for (std::size_t j=0; j < h; ++j ) {
-            fb[j*800+i] = color;
-        }
-    }
-}
-
-void putc(char c, std::size_t x, std::size_t y) {
-    for (std::size_t i=0; i < 5; ++i) {
-        char column = System5x7[((int)((int)c-(int)' ')*5) + i];
-        for (std::size_t j=0; j < 8; ++j) {
-            if (column & (1<<j)) {
-                fb[(x + j) * 800 + y + i].Red = 0xff;
-                fb[(x + j) * 800 + y + i].Green = 0xff;
-                fb[(x + j) * 800 + y + i].Blue = 0xff;
-            }         
-        }
-    }    
-}
-
-void print(char* text, std::size_t x, std::size_t y) {
-    while(*text) {
-        putc(*text, x, y);
-        y+=5;
-        text++;
-    }
-}
 
 
 struct DrawCtx {
@@ -626,113 +208,387 @@ void gui_draw(EFI_EVENT event, void* vctx) {
     
 }
 
-void perror(EFI_STATUS error, const wchar_t* msg) {
-    switch (error) {
-        case EFI_SUCCESS             : Print((CHAR16*)L"EFI_SUCCESS: %s\n", msg); break;                
-        case EFI_LOAD_ERROR          : Print((CHAR16*)L"EFI_LOAD_ERROR: %s\n", msg); break;        
-        case EFI_INVALID_PARAMETER   : Print((CHAR16*)L"EFI_INVALID_PARAMETER: %s\n", msg); break;        
-        case EFI_UNSUPPORTED         : Print((CHAR16*)L"EFI_UNSUPPORTED: %s\n", msg); break;        
-        case EFI_BAD_BUFFER_SIZE     : Print((CHAR16*)L"EFI_BAD_BUFFER_SIZE: %s\n", msg); break;        
-        case EFI_BUFFER_TOO_SMALL    : Print((CHAR16*)L"EFI_BUFFER_TOO_SMALL: %s\n", msg); break;        
-        case EFI_NOT_READY           : Print((CHAR16*)L"EFI_NOT_READY: %s\n", msg); break;        
-        case EFI_DEVICE_ERROR        : Print((CHAR16*)L"EFI_DEVICE_ERROR: %s\n", msg); break;        
-        case EFI_WRITE_PROTECTED     : Print((CHAR16*)L"EFI_WRITE_PROTECTED: %s\n", msg); break;        
-        case EFI_OUT_OF_RESOURCES    : Print((CHAR16*)L"EFI_OUT_OF_RESOURCES: %s\n", msg); break;        
-        case EFI_VOLUME_CORRUPTED    : Print((CHAR16*)L"EFI_VOLUME_CORRUPTED: %s\n", msg); break;        
-        case EFI_VOLUME_FULL         : Print((CHAR16*)L"EFI_VOLUME_FULL: %s\n", msg); break;        
-        case EFI_NO_MEDIA            : Print((CHAR16*)L"EFI_NO_MEDIA: %s\n", msg); break;        
-        case EFI_MEDIA_CHANGED       : Print((CHAR16*)L"EFI_MEDIA_CHANGED: %s\n", msg); break;        
-        case EFI_NOT_FOUND           : Print((CHAR16*)L"EFI_NOT_FOUND: %s\n", msg); break;        
-        case EFI_ACCESS_DENIED       : Print((CHAR16*)L"EFI_ACCESS_DENIED: %s\n", msg); break;        
-        case EFI_NO_RESPONSE         : Print((CHAR16*)L"EFI_NO_RESPONSE: %s\n", msg); break;        
-        case EFI_NO_MAPPING          : Print((CHAR16*)L"EFI_NO_MAPPING: %s\n", msg); break;        
-        case EFI_TIMEOUT             : Print((CHAR16*)L"EFI_TIMEOUT: %s\n", msg); break;        
-        case EFI_NOT_STARTED         : Print((CHAR16*)L"EFI_NOT_STARTED: %s\n", msg); break;        
-        case EFI_ALREADY_STARTED     : Print((CHAR16*)L"EFI_ALREADY_STARTED: %s\n", msg); break;        
-        case EFI_ABORTED             : Print((CHAR16*)L"EFI_ABORTED: %s\n", msg); break;        
-        case EFI_ICMP_ERROR          : Print((CHAR16*)L"EFI_ICMP_ERROR: %s\n", msg); break;        
-        case EFI_TFTP_ERROR          : Print((CHAR16*)L"EFI_TFTP_ERROR: %s\n", msg); break;        
-        case EFI_PROTOCOL_ERROR      : Print((CHAR16*)L"EFI_PROTOCOL_ERROR: %s\n", msg); break;        
-        case EFI_INCOMPATIBLE_VERSION: Print((CHAR16*)L"EFI_INCOMPATIBLE_VERSION: %s\n", msg); break;        
-        case EFI_SECURITY_VIOLATION  : Print((CHAR16*)L"EFI_SECURITY_VIOLATION: %s\n", msg); break;        
-        case EFI_CRC_ERROR           : Print((CHAR16*)L"EFI_CRC_ERROR: %s\n", msg); break;        
-        case EFI_END_OF_MEDIA        : Print((CHAR16*)L"EFI_END_OF_MEDIA: %s\n", msg); break;        
-        case EFI_END_OF_FILE         : Print((CHAR16*)L"EFI_END_OF_FILE: %s\n", msg); break;        
-        case EFI_INVALID_LANGUAGE    : Print((CHAR16*)L"EFI_INVALID_LANGUAGE: %s\n", msg); break;        
-        case EFI_COMPROMISED_DATA    : Print((CHAR16*)L"EFI_COMPROMISED_DATA: %s\n", msg); break;        
-        case EFI_WARN_UNKNOWN_GLYPH  : Print((CHAR16*)L"EFI_WARN_UNKNOWN_GLYPH: %s\n", msg); break;        
-        case EFI_WARN_DELETE_FAILURE : Print((CHAR16*)L"EFI_WARN_DELETE_FAILURE: %s\n", msg); break;        
-        case EFI_WARN_WRITE_FAILURE  : Print((CHAR16*)L"EFI_WARN_WRITE_FAILURE: %s\n", msg); break;        
-        case EFI_WARN_BUFFER_TOO_SMALL: Print((CHAR16*)L"EFI_WARN_BUFFER_TOO_SMALL: %s\n", msg); break;       
-        default: Print((CHAR16*)L"Unknown error: %s\n", msg); break;
-    }
-}
-
 enum State {
     PlayingNote,
     PlayNoSound,
     Wait
 }state = PlayingNote;
+std::size_t thisNote = 0;
+
+// Guards state and thisNote, the audio task runs from the scheduler tick.
+LockStats melody_stats("melody");
+TicketLock melody_lock(&melody_stats);
 
-void play_note() {
-    static std::size_t thisNote = 0;
+// Starts or stops the current note, returns how long to wait in us.
+UINT64 play_note() {
+    LockGuard<TicketLock> guard(melody_lock);
     int noteDuration = 1000/noteDurations[thisNote];
-    int pauseBetweenNotes = noteDuration * 1.30;
+    UINT64 wait = 0;
     switch (state) {
         case State::PlayingNote:     
             if (melody[thisNote]){    
                 play_sound(melody[thisNote]);
-                set_timer(sound_event, TimerRelative, noteDuration*10'000*2);
             } 
+                wait = noteDuration*1000*2;
                 state = PlayNoSound;
             break;
         case State::PlayNoSound:
             nosound();
-            set_timer(sound_event, TimerRelative, noteDuration*0.3* 10'000*2);         
+            wait = noteDuration*0.3*1000*2;
             state = PlayingNote;
     }
     thisNote++;
     thisNote%=1000;
+    return wait;
 }
 
-void render_cat(char* buffer, std::size_t& frame) {
-    std::size_t offset = 720 * 480 *3 * frame; 
-    for (std::size_t i=0; i < 720; ++i) {
-        for (std::size_t j=0; j < 480; ++j) {
-           
-            fb[((j + 60)*800)+i + 40].Red = buffer[offset + ((j*720) + i)*3 + 0];
-            fb[((j + 60)*800)+i + 40].Green = buffer[offset + ((j*720) + i)*3 +1];
-            fb[((j + 60)*800)+i + 40].Blue = buffer[offset + ((j*720) + i)*3 +2];
-        }
+// Silences the speaker and rewinds, safe against a tick in between.
+void stop_melody() {
+    TplLockGuard guard(melody_lock);
+    nosound();
+    state = PlayingNote;
+    thisNote = 0;
+}
+
+// The melody, one note or gap per run.
+class AudioTask : public Task {
+public:
+    AudioTask() : Task("audio", 0, 1000) {}
+    void run() override {
+        set_period(play_note());
+    }
+};
+
+// Rows go out to every CPU in the pool, 24 rows a chunk.
+void render_cat(const char* buffer, CpuPool& cpus) {
+    EFI_GRAPHICS_OUTPUT_BLT_PIXEL* origin = fb + 60*800 + 40;
+    cpus.parallel_for(FRAME_HEIGHT, 24, [=](std::size_t first, std::size_t end) {
+        TRACE_SCOPE("convert_rows");
+        convert_frame_rows(buffer, origin, 800, first, end);
+    });
+}
+
+// Top left, above the cat, which starts at row 60.
+constexpr std::size_t HUD_WIDTH = 260;
+constexpr std::size_t HUD_HEIGHT = FrameProfiler::HUD_LINES * 10 + 4;
+
+void draw_hud(FrameProfiler& profiler) {
+    fill(fb, HUD_WIDTH, HUD_HEIGHT, {0x30, 0x10, 0x10, 0});
+    char line[64];
+    for (std::size_t i=0; i < FrameProfiler::HUD_LINES; ++i) {
+        TextWriter out(line, sizeof(line) - 1);
+        profiler.hud_line(i, out);
+        line[out.size()] = 0;
+        print(fb, line, 4 + i * 10, 4);
     }
-    frame += 1;
-    frame %=11;
 }
 
-bool check_event(EFI_EVENT event) {
-    return uefi(bs->CheckEvent, event) == EFI_SUCCESS;
+// Assets are served by tools/tftp_server.sh on the host end of the run-net tap.
+EFI_STATUS open_tftp(TftpClient& tftp) {
+    auto interfaces = get_pxe_interfaces();
+    if (interfaces.empty())
+        return EFI_NOT_FOUND;
+    return tftp.open(interfaces[0], { {192, 168, 100, 2} }, { {255, 255, 255, 0} }, { {192, 168, 100, 1} });
 }
 
-void sound_callback(EFI_EVENT event, void* vctx) {
-    play_note();
+// Frames are served by tools/frame_server.py on the host end of the run-net tap.
+EFI_STATUS open_frame_stream(TcpConnection& connection, NetFrameSource& frames) {
+    auto services = get_tcp4_services();
+    if (services.empty())
+        return EFI_NOT_FOUND;
+    TcpConfig config = TcpConfig::bulk();
+    config.remote({ { {192, 168, 100, 1} }, 4444 });
+    EFI_STATUS status = connection.open(services[0], config);
+    if (EFI_ERROR(status))
+        return status;
+    return frames.open(connection.tcp());
+}
+
+// Telemetry goes to tools/telemetry_recv.py on the host end of the run-net tap.
+EFI_STATUS open_telemetry(Udp4Socket& socket) {
+    auto services = get_udp4_services();
+    if (services.empty())
+        return EFI_NOT_FOUND;
+
+    EFI_UDP4_CONFIG_DATA config {};
+    config.TimeToLive = 64;
+    config.DoNotFragment = TRUE;
+    config.UseDefaultAddress = TRUE;
+    config.RemoteAddress = { {192, 168, 100, 1} };
+    config.RemotePort = 5555;
+    return socket.open(services[0], config);
+}
+
+// Line based remote control on port 4447, e.g. `nc 192.168.100.2 4447`:
+//     stats    frames shown and connection counters
+//     pause    hold the current frame
+//     resume   continue playback
+//     trace start|stop|dump  TRACE_SCOPE recording, dump writes trace.json
+//     binlog dump  BLOG records to binlog.bin
+class ControlHandler : public TcpHandler {
+public:
+    static constexpr std::size_t MAX_CLIENTS = 4;
+    static constexpr std::size_t LINE_SIZE = 64;
+
+    bool paused = false;
+    std::size_t shown = 0;
+    TcpServer* server = nullptr;
+private:
+    char lines[MAX_CLIENTS][LINE_SIZE];
+    EFI_FILE_PROTOCOL* esp = nullptr;
+
+    void dump_trace(TextWriter& out) {
+        if (esp == nullptr)
+            esp = open_fs_with_file(L"BOOTX64.efi").value();
+        std::size_t events = 0;
+        EFI_STATUS status = esp ? trace_dump_file(esp, L"trace.json", &events) : EFI_NOT_FOUND;
+        if (EFI_ERROR(status))
+            out.put("trace dump failed: ").put(status_name(report_error(status, "trace dump"))).put('\n');
+        else
+            out.put("wrote ").put((UINT64)events).put(" events to trace.json\n");
+    }
+    void dump_binlog(TextWriter& out) {
+        if (esp == nullptr)
+            esp = open_fs_with_file(L"BOOTX64.efi").value();
+        std::size_t records = 0;
+        EFI_STATUS status = esp ? binlog_dump_file(esp, L"binlog.bin", &records) : EFI_NOT_FOUND;
+        if (EFI_ERROR(status))
+            out.put("binlog dump failed: ").put(status_name(report_error(status, "binlog dump"))).put('\n');
+        else
+            out.put("wrote ").put((UINT64)records).put(" records to binlog.bin\n");
+    }
+    std::size_t lengths[MAX_CLIENTS] = {};
+
+    void command(TcpClient& client, const char* line, std::size_t n) {
+        char reply[128];
+        TextWriter out(reply, sizeof(reply));
+        if (text_equals(line, n, "stats")) {
+            out.put("shown ").put((UINT64)shown).put(paused ? " paused" : " playing")
+                .put(" clients ").put((UINT64)server->active())
+                .put(" accepted ").put((UINT64)server->accepted())
+                .put(" rejected ").put((UINT64)server->rejected()).put('\n');
+        } else if (text_equals(line, n, "pause")) {
+            paused = true;
+            out.put("ok\n");
+        } else if (text_equals(line, n, "resume")) {
+            paused = false;
+            out.put("ok\n");
+        } else if (text_equals(line, n, "trace start")) {
+            trace_set_enabled(true);
+            out.put(trace_enabled() ? "ok\n" : "tracing not compiled in or not started with -trace\n");
+        } else if (text_equals(line, n, "trace stop")) {
+            trace_set_enabled(false);
+            out.put("ok\n");
+        } else if (text_equals(line, n, "trace dump")) {
+            dump_trace(out);
+        } else if (text_equals(line, n, "binlog dump")) {
+            dump_binlog(out);
+        } else {
+            out.put("unknown command\n");
+        }
+        client.send(out.data(), out.size());
+    }
+public:
+    void on_accept(TcpClient& client) override {
+        lengths[client.id()] = 0;
+    }
+    void on_data(TcpClient& client, const char* data, std::size_t n) override {
+        char* line = lines[client.id()];
+        std::size_t& length = lengths[client.id()];
+        for (std::size_t i=0; i < n; ++i) {
+            if (data[i] == '\r')
+                continue;
+            if (data[i] == '\n') {
+                command(client, line, length);
+                length = 0;
+            } else if (length < LINE_SIZE) {
+                line[length++] = data[i];
+            }
+        }
+    }
+};
+
+EFI_STATUS open_control(TcpServer& server) {
+    auto services = get_tcp4_services();
+    if (services.empty())
+        return EFI_NOT_FOUND;
+    TcpConfig config = TcpConfig::latency();
+    config.passive().local_port(4447);
+    return server.open(services[0], config);
+}
+
+// Frame times in microseconds, buckets around the 60/30/20 fps budgets.
+static const UINT64 FRAME_TIME_BOUNDS[] = { 1'000, 2'000, 5'000, 10'000, 16'667, 20'000, 33'333, 50'000, 100'000, 250'000, 1'000'000 };
+
+// GET /metrics, Prometheus text format.
+class MetricsRoute : public HttpRoute {
+public:
+    Histogram frame_times { FRAME_TIME_BOUNDS, sizeof(FRAME_TIME_BOUNDS) / sizeof(FRAME_TIME_BOUNDS[0]) };
+    std::size_t shown = 0;
+    NetFrameSource* stream = nullptr;
+    Udp4Socket* telemetry = nullptr;
+    HttpServer* http = nullptr;
+    Scheduler* scheduler = nullptr;
+    CpuPool* cpus = nullptr;
+
+    void serve(const HttpRequest&, HttpResponse& response) override {
+        response.set_content_type("text/plain; version=0.0.4");
+        TextWriter& out = response.body();
+        frame_times.write(out, "frame_time_seconds", "Time from frame start to blit.", 1'000'000);
+        write_metric(out, "frames_shown_total", "counter", "Frames rendered.", shown);
+        if (stream) {
+            write_metric(out, "stream_frames_received_total", "counter", "Frames received from the frame server.", stream->received());
+            write_metric(out, "stream_underruns_total", "counter", "Times the stream ran dry.", stream->underruns());
+            write_metric(out, "stream_buffered_frames", "gauge", "Frames waiting to be shown.", stream->buffered());
+        }
+        if (telemetry && telemetry->is_open()) {
+            write_metric(out, "telemetry_sent_total", "counter", "Telemetry datagrams sent.", telemetry->sent());
+            write_metric(out, "telemetry_dropped_total", "counter", "Telemetry datagrams dropped on a full slot pool.", telemetry->dropped());
+        }
+        TcpServer& tcp = http->tcp();
+        write_metric(out, "http_requests_total", "counter", "HTTP requests answered.", http->requests());
+        write_metric(out, "http_pipelined_total", "counter", "Requests answered behind another one from the same buffer.", http->pipelined());
+        write_metric(out, "http_errors_total", "counter", "HTTP responses with status 400 and up.", http->errors());
+        write_metric(out, "http_connections_total", "counter", "Accepted HTTP connections.", tcp.accepted());
+        write_metric(out, "http_connections_rejected_total", "counter", "Connections reset for lack of a client slot.", tcp.rejected());
+        write_metric(out, "http_connections_active", "gauge", "Open HTTP connections.", tcp.active());
+        write_metric(out, "http_received_bytes_total", "counter", "Bytes received by the HTTP server.", tcp.bytes_in());
+        write_metric(out, "http_sent_bytes_total", "counter", "Bytes sent by the HTTP server.", tcp.bytes_out());
+        if (scheduler)
+            write_task_metrics(out, *scheduler);
+        write_lock_metrics(out);
+        write_log_metrics(out);
+        write_error_metrics(out);
+        write_metric(out, "binlog_records_total", "counter", "Binary log records written, overwritten ones included.", binlog_records());
+        if (cpus) {
+            write_metric(out, "mp_cpus", "gauge", "CPUs sharing parallel loops, the BSP included.", cpus->cpus());
+            write_metric(out, "mp_jobs_total", "counter", "Parallel loops run.", cpus->jobs());
+        }
+        write_system_metrics(out);
+    }
+};
+
+// GET /frame, the framebuffer as a top-down 32 bpp BMP. The pixels are copied
+// into a snapshot that is shared by every response still being sent, so a
+// slow client never sees the image change under it.
+class FrameRoute : public HttpRoute {
+    static constexpr UINT32 WIDTH = 800;
+    static constexpr UINT32 HEIGHT = 600;
+    static constexpr std::size_t PIXEL_BYTES = WIDTH * HEIGHT * 4;
+
+    EFI_GRAPHICS_OUTPUT_BLT_PIXEL* source;
+    char* snapshot = nullptr;
+    std::size_t users = 0;
+
+    static void put16(TextWriter& out, UINT16 v) {
+        char b[2] = { (char)v, (char)(v >> 8) };
+        out.put(b, 2);
+    }
+    static void put32(TextWriter& out, UINT32 v) {
+        char b[4] = { (char)v, (char)(v >> 8), (char)(v >> 16), (char)(v >> 24) };
+        out.put(b, 4);
+    }
+public:
+    FrameRoute(EFI_GRAPHICS_OUTPUT_BLT_PIXEL* source) : source(source) {}
+    ~FrameRoute() {
+        free(snapshot);
+    }
+
+    void serve(const HttpRequest&, HttpResponse& response) override {
+        if (snapshot == nullptr)
+            snapshot = (char*)malloc(PIXEL_BYTES);
+        if (snapshot == nullptr) {
+            response.set_status(503);
+            response.body().put("out of memory\n");
+            return;
+        }
+        if (users == 0)
+            memcpy(snapshot, source, PIXEL_BYTES);
+        users += 1;
+
+        TextWriter& out = response.body();
+        response.set_content_type("image/bmp");
+        out.put("BM", 2);
+        put32(out, 54 + PIXEL_BYTES);
+        put32(out, 0);
+        put32(out, 54);
+        put32(out, 40);
+        put32(out, WIDTH);
+        put32(out, (UINT32)-(INT32)HEIGHT); // negative height: rows top to bottom
+        put16(out, 1);
+        put16(out, 32);
+        put32(out, 0); // BI_RGB, BGRX matches EFI_GRAPHICS_OUTPUT_BLT_PIXEL
+        put32(out, PIXEL_BYTES);
+        put32(out, 2835);
+        put32(out, 2835);
+        put32(out, 0);
+        put32(out, 0);
+        response.attach(snapshot, PIXEL_BYTES);
+    }
+    void release() override {
+        users -= 1;
+    }
+};
+
+// GET /trace, the TRACE_SCOPE timeline as Chrome trace JSON for
+// chrome://tracing or ui.perfetto.dev. One dump at a time.
+class TraceRoute : public HttpRoute {
+    char* json = nullptr;
+    std::size_t users = 0;
+public:
+    ~TraceRoute() {
+        free(json);
+    }
+
+    void serve(const HttpRequest&, HttpResponse& response) override {
+        if (users > 0) {
+            response.set_status(503);
+            response.body().put("trace dump in progress\n");
+            return;
+        }
+        free(json);
+        std::size_t capacity = trace_json_bound();
+        json = (char*)malloc(capacity);
+        if (json == nullptr) {
+            response.set_status(503);
+            response.body().put("out of memory\n");
+            return;
+        }
+        TextWriter out(json, capacity);
+        trace_write_json([](void* ctx, const char* data, std::size_t n) {
+            TextWriter* out = (TextWriter*)ctx;
+            return !out->put(data, n).overflowed();
+        }, &out);
+        response.set_content_type("application/json");
+        response.attach(json, out.size());
+        users += 1;
+    }
+    void release() override {
+        users -= 1;
+    }
+};
+
+EFI_STATUS open_http(HttpServer& http) {
+    auto services = get_tcp4_services();
+    if (services.empty())
+        return EFI_NOT_FOUND;
+    return http.open(services[0], 8080);
 }
 
 EFI_STATUS cxx_main(EFI_HANDLE ImageHandle, EFI_SYSTEM_TABLE* SystemTable) {
     st = SystemTable;
     bs = SystemTable->BootServices;
+    clock_init();
+    // Serial log on COM1, `-verbose` includes debug lines.
+    log_init(has_option(ImageHandle, L"-verbose") ? LogDebug : LogInfo);
 
     EFI_LOADED_IMAGE* loaded_image;
     EFI_GUID g = EFI_LOADED_IMAGE_PROTOCOL_GUID;
-    uefi(bs->HandleProtocol, ImageHandle, &LoadedImageProtocol, (void**)&loaded_image);
-    Print((CHAR16*)L"%X\n", loaded_image->ImageBase);
+    if (!EFI_ERROR(check(uefi(bs->HandleProtocol, ImageHandle, &LoadedImageProtocol, (void**)&loaded_image), "loaded image")))
+        Print((CHAR16*)L"%X\n", loaded_image->ImageBase);
 /* bp(); */
-    if (EFI_ERROR(create_event(EVT_TIMER, 0, nullptr, nullptr, &gui_draw_event))) {
-        Print((CHAR16*)L"Failed to create event\n");
-    }
-    if (EFI_ERROR(create_event(EVT_TIMER|EVT_NOTIFY_SIGNAL, TPL_CALLBACK, sound_callback, nullptr, &sound_event))) {
-        Print((CHAR16*)L"Failed to create event\n");
-    }
-    set_timer(gui_draw_event, TimerPeriodic, (1.0/60)*10'000'000);
+    if (!EFI_ERROR(check(create_event(EVT_TIMER, 0, nullptr, nullptr, &gui_draw_event), "gui draw event")))
+        check(set_timer(gui_draw_event, TimerPeriodic, (1.0/60)*10'000'000), "gui draw timer");
     auto screens = open_screens();
     auto screen = Screen(screens[0]);
     draw_ctx.screen = &screen;
@@ -743,27 +599,205 @@ EFI_STATUS cxx_main(EFI_HANDLE ImageHandle, EFI_SYSTEM_TABLE* SystemTable) {
     
 
     /* bp(); */
-    char
-        * ptr = (char*)malloc(12 * 1024 * 1024); 
-    auto fs = open_fs_with_file(L"nyan.bin");
-    auto file = fopen(fs, L"nyan.bin", EFI_FILE_MODE_READ, EFI_FILE_READ_ONLY);
-    fread(file, ptr, 12441600);
-
+    AssetCache assets;
+    EFI_STATUS asset_status = EFI_NOT_FOUND;
+    if (!has_option(ImageHandle, L"-tftp"))
+        asset_status = assets.load_file("nyan.bin");
+    if (EFI_ERROR(asset_status)) {
+        TftpClient tftp;
+        asset_status = open_tftp(tftp);
+        if (!EFI_ERROR(asset_status))
+            asset_status = assets.fetch_tftp(tftp, "nyan.bin");
+    }
+    char* ptr = assets.find("nyan.bin");
     if (ptr == nullptr) {
+        report_error(asset_status, "nyan.bin");
         Print((CHAR16*)L"nope.\n");
     }
 
+    FileFrameSource file_frames(ptr, NYAN_FRAMES);
+    TcpConnection stream;
+    NetFrameSource net_frames(8, 3);
+    FrameSource* frames = &file_frames;
+    if (has_option(ImageHandle, L"-net")) {
+        EFI_STATUS status = open_frame_stream(stream, net_frames);
+        if (EFI_ERROR(status)) {
+            report_error(status, "frame stream, playing nyan.bin");
+        } else {
+            frames = &net_frames;
+        }
+    }
+
+    Udp4Socket telemetry_socket(16);
+    Telemetry telemetry(telemetry_socket);
+    if (has_option(ImageHandle, L"-telemetry")) {
+        EFI_STATUS status = open_telemetry(telemetry_socket);
+        if (EFI_ERROR(status))
+            report_error(status, "telemetry");
+    }
+
+    ControlHandler control;
+    TcpServer control_server(control, 4, ControlHandler::MAX_CLIENTS);
+    control.server = &control_server;
+    if (has_option(ImageHandle, L"-control")) {
+        EFI_STATUS status = open_control(control_server);
+        if (EFI_ERROR(status))
+            report_error(status, "control server");
+    }
+
+    // Scrape with `curl http://192.168.100.2:8080/metrics`, `/frame` returns a BMP.
+    HttpServer http(8);
+    Scheduler scheduler(8);
+    MetricsRoute metrics;
+    FrameRoute frame_route(fb);
+    TraceRoute trace_route;
+    metrics.http = &http;
+    metrics.scheduler = &scheduler;
+    metrics.telemetry = &telemetry_socket;
+    if (frames == &net_frames)
+        metrics.stream = &net_frames;
+    http.route("/metrics", metrics);
+    http.route("/frame", frame_route);
+    http.route("/trace", trace_route);
+    if (has_option(ImageHandle, L"-http")) {
+        EFI_STATUS status = open_http(http);
+        if (EFI_ERROR(status))
+            report_error(status, "http server");
+    }
+
+    // The APs spin while the pool is open, `-nomp` keeps them parked.
+    CpuPool cpus;
+    if (!has_option(ImageHandle, L"-nomp")) {
+        EFI_STATUS status = cpus.open();
+        if (EFI_ERROR(status) && status != EFI_NOT_FOUND)
+            report_error(status, "mp services");
+    }
+    metrics.cpus = &cpus;
+    // Deferred-format records, decoded with tools/binlog_decode.py.
+    if (has_option(ImageHandle, L"-binlog")) {
+        EFI_STATUS status = binlog_init();
+        if (EFI_ERROR(status))
+            report_error(status, "binlog");
+    }
+    if (has_option(ImageHandle, L"-trace")) {
+        EFI_STATUS status = trace_init(cpus.cpus());
+        if (EFI_ERROR(status))
+            report_error(status, "trace");
+    }
+    track_lock(melody_stats);
+
     /* bp(); */
-        /* play_note(); */
-    std::size_t frame = 0;
     /* cat(); */
-    while(1) {
-            
-            render_cat(ptr, frame);
-            print("OKIPOKI", 500, 10);
-            screen.blt(fb, EfiBltBufferToVideo, 0, 0, width/2 - 400, height / 2 - 300, 800, 600, 800*4);
-            sleep(50'000);
+    std::size_t shown = 0;
+    FunctionTask net("net", 1, 5'000, [&] {
+        control_server.poll();
+        http.poll();
+        if (frames == &net_frames)
+            net_frames.pump();
+    });
+    // 'h' toggles the profiler HUD, `-hud` starts with it shown.
+    FrameProfiler profiler;
+    bool hud = has_option(ImageHandle, L"-hud");
+    // For unattended runs: `-frames N` stops after N frames, `-exit` then ends QEMU.
+    std::size_t frame_limit = option_number(ImageHandle, L"-frames", 0);
+    Stopwatch run_time;
+    FunctionTask render("render", 2, 50'000, [&] {
+        Stopwatch frame_time;
+        profiler.begin_frame();
+        const char* frame = nullptr;
+        if (!control.paused) {
+            TRACE_SCOPE("next_frame");
+            frame = frames->next_frame();
+        }
+        if (frame) {
+            TRACE_SCOPE("render_cat");
+            render_cat(frame, cpus);
+        }
+        profiler.end_stage(StageDecode);
+
+        print(fb, "OKIPOKI", 500, 10);
+        if (isKeyPressed(L'h')) {
+            hud = !hud;
+            if (!hud)
+                fill(fb, HUD_WIDTH, HUD_HEIGHT, {0, 0, 0, 0});
+        }
+        if (hud)
+            draw_hud(profiler);
+        profiler.end_stage(StageComposite);
+
+        {
+            TRACE_SCOPE("blit");
+            check(screen.blt(fb, EfiBltBufferToVideo, 0, 0, width/2 - 400, height / 2 - 300, 800, 600, 800*4), "blit");
+        }
+        profiler.end_stage(StageBlit);
+
+        UINT64 frame_us = frame_time.elapsed_us();
+        metrics.frame_times.observe(frame_us);
+        BLOG(LogInfo, "frame %u: %u us, %u shown", (UINT64)profiler.frames(), frame_us, (UINT64)shown);
+        if (frame_us > 20'000)
+            log_line(LogDebug).put("slow frame ").put((UINT64)profiler.frames()).put(": ").put(frame_us).put(" us");
+        if (frame)
+            control.shown = metrics.shown = ++shown;
+        if (frame_limit && profiler.frames() >= frame_limit)
+            scheduler.stop();
+        if (telemetry_socket.is_open()) {
+            telemetry.record(TelemetryFrameCycles, TelemetrySample, frame_time.elapsed_cycles());
+            telemetry.record(TelemetryFramesShown, TelemetryCounter, shown);
+            if (frames == &net_frames) {
+                telemetry.record(TelemetryStreamBuffered, TelemetryGauge, net_frames.buffered());
+                telemetry.record(TelemetryStreamUnderruns, TelemetryCounter, net_frames.underruns());
+            }
+        }
+    });
+    // Records are batched into datagrams, push a partial one out now and then.
+    FunctionTask io("io", 3, 400'000, [&] {
+        if (telemetry_socket.is_open()) {
+            telemetry.flush();
+            telemetry_socket.poll();
+        }
+    });
+    // A FIFO load per run, every tick keeps up with 115200 baud.
+    FunctionTask serial_log("log", 4, 1'000, [] {
+        log_drain();
+    });
+    AudioTask audio;
+    scheduler.add(net);
+    scheduler.add(render);
+    scheduler.add(io);
+    scheduler.add(serial_log);
+    if (has_option(ImageHandle, L"-audio"))
+        scheduler.add(audio);
+
+    log_line(LogInfo).put("running on ").put((UINT64)cpus.cpus()).put(" cpus, tsc ").put(clock_calibration.tsc_per_us).put(" MHz");
+    EFI_STATUS status = scheduler.start(1'000);
+    if (EFI_ERROR(status)) {
+        report_error(status, "scheduler");
+        return status;
     }
-    
-    return EFI_SUCCESS;
+    scheduler.run();
+    stop_melody();
+
+    // Nothing shown means no frame source worked, a failed run.
+    status = shown ? EFI_SUCCESS : EFI_NOT_FOUND;
+    if (frame_limit) {
+        UINT64 us = run_time.elapsed_us();
+        UINT64 fps = profiler.fps_x100();
+        Print((CHAR16*)L"frames: %ld rendered, %ld shown in %ld us, %ld.%02ld fps\n", (INT64)profiler.frames(),
+                (INT64)shown, (INT64)us, (INT64)(fps / 100), (INT64)(fps % 100));
+        char line[64];
+        for (std::size_t i = 1; i < FrameProfiler::HUD_LINES; ++i) {
+            TextWriter out(line, sizeof(line) - 1);
+            profiler.hud_line(i, out);
+            line[out.size()] = 0;
+            Print((CHAR16*)L"frames: %a\n", line);
+        }
+    }
+    log_line(shown ? LogInfo : LogError).put("stopped after ").put((UINT64)profiler.frames()).put(" frames, ")
+            .put((UINT64)shown).put(" shown");
+    if (binlog_ready() && has_option(ImageHandle, L"-exit"))
+        binlog_dump_serial();
+    log_flush();
+    if (has_option(ImageHandle, L"-exit"))
+        qemu_exit(status);
+    return status;
 }
@@ -0,0 +1,152 @@
+#include "metrics.h"
+#include "fs.h"
+#include "net.h"
+#include "clock.h"
+#include "log.h"
+#include "status.h"
+
+Histogram::Histogram(const UINT64* bounds, std::size_t n) : bucket_count(n < MAX_BUCKETS ? n : MAX_BUCKETS) {
+    for (std::size_t i=0; i < bucket_count; ++i)
+        this->bounds[i] = bounds[i];
+}
+
+void Histogram::observe(UINT64 value) {
+    std::size_t i = 0;
+    while (i < bucket_count && value > bounds[i])
+        ++i;
+    counts[i] += 1;
+    sum_ += value;
+    count_ += 1;
+}
+
+void write_scaled(TextWriter& out, UINT64 value, UINT64 scale) {
+    out.put(value / scale);
+    UINT64 rest = value % scale;
+    if (rest == 0)
+        return;
+    out.put('.');
+    for (UINT64 digit = scale / 10; digit > 0 && rest > 0; digit /= 10) {
+        out.put((char)('0' + rest / digit));
+        rest %= digit;
+    }
+}
+
+void Histogram::write(TextWriter& out, const char* name, const char* help, UINT64 scale) {
+    out.put("# HELP ").put(name).put(' ').put(help).put('\n');
+    out.put("# TYPE ").put(name).put(" histogram\n");
+    UINT64 cumulative = 0;
+    for (std::size_t i=0; i <= bucket_count; ++i) {
+        cumulative += counts[i];
+        out.put(name).put("_bucket{le=\"");
+        if (i == bucket_count)
+            out.put("+Inf");
+        else
+            write_scaled(out, bounds[i], scale);
+        out.put("\"} ").put(cumulative).put('\n');
+    }
+    out.put(name).put("_sum ");
+    write_scaled(out, sum_, scale);
+    out.put('\n');
+    out.put(name).put("_count ").put(count_).put('\n');
+}
+
+void write_metric(TextWriter& out, const char* name, const char* type, const char* help, UINT64 value) {
+    out.put("# HELP ").put(name).put(' ').put(help).put('\n');
+    out.put("# TYPE ").put(name).put(' ').put(type).put('\n');
+    out.put(name).put(' ').put(value).put('\n');
+}
+
+void write_system_metrics(TextWriter& out) {
+    write_metric(out, "uptime_microseconds", "counter", "Time since clock_init().", now_us());
+    write_metric(out, "tsc_hertz", "gauge", "TSC frequency measured at startup.", clock_calibration.tsc_hz);
+
+    write_metric(out, "alloc_allocations_total", "counter", "Successful malloc calls.", alloc_stats.allocations);
+    write_metric(out, "alloc_frees_total", "counter", "free calls.", alloc_stats.frees);
+    write_metric(out, "alloc_failures_total", "counter", "malloc calls that returned null.", alloc_stats.failures);
+    write_metric(out, "alloc_requested_bytes_total", "counter", "Bytes requested from malloc.", alloc_stats.bytes_requested);
+    write_metric(out, "alloc_live_blocks", "gauge", "Allocations not freed yet.", alloc_stats.allocations - alloc_stats.frees);
+
+    write_metric(out, "file_reads_total", "counter", "File Read calls.", file_stats.reads);
+    write_metric(out, "file_read_bytes_total", "counter", "Bytes read from files.", file_stats.read_bytes);
+    write_metric(out, "file_writes_total", "counter", "File Write calls.", file_stats.writes);
+    write_metric(out, "file_write_bytes_total", "counter", "Bytes written to files.", file_stats.write_bytes);
+
+    write_metric(out, "tcp_sends_total", "counter", "Completed blocking TCP sends.", tcp_stats.sends);
+    write_metric(out, "tcp_send_bytes_total", "counter", "Bytes sent by blocking TCP sends.", tcp_stats.send_bytes);
+    write_metric(out, "tcp_recvs_total", "counter", "Completed blocking TCP receives.", tcp_stats.recvs);
+    write_metric(out, "tcp_recv_bytes_total", "counter", "Bytes received by blocking TCP receives.", tcp_stats.recv_bytes);
+    write_metric(out, "tcp_errors_total", "counter", "Failed blocking TCP sends and receives.", tcp_stats.errors);
+}
+
+static void write_task_family(TextWriter& out, Scheduler& scheduler, const char* name, const char* type, const char* help,
+        UINT64 (*value)(Scheduler&, Task&)) {
+    out.put("# HELP ").put(name).put(' ').put(help).put('\n');
+    out.put("# TYPE ").put(name).put(' ').put(type).put('\n');
+    for (std::size_t i=0; i < scheduler.task_count(); ++i) {
+        Task& task = scheduler.task(i);
+        out.put(name).put("{task=\"").put(task.name()).put("\"} ").put(value(scheduler, task)).put('\n');
+    }
+}
+
+void write_task_metrics(TextWriter& out, Scheduler& scheduler) {
+    write_task_family(out, scheduler, "task_runs_total", "counter", "Task dispatches.",
+        [](Scheduler&, Task& task) { return (UINT64)task.runs(); });
+    write_task_family(out, scheduler, "task_deadline_misses_total", "counter", "Runs that finished past their deadline.",
+        [](Scheduler&, Task& task) { return (UINT64)task.misses(); });
+    write_task_family(out, scheduler, "task_cpu_permille", "gauge", "Share of time since start spent in the task, in 1/1000.",
+        [](Scheduler& scheduler, Task& task) { return scheduler.share_permille(task); });
+    write_task_family(out, scheduler, "task_max_cycles", "gauge", "Longest single run in TSC cycles.",
+        [](Scheduler&, Task& task) { return task.max_cycles(); });
+    write_metric(out, "scheduler_ticks_total", "counter", "Timer ticks that ran the dispatcher.", scheduler.dispatches());
+}
+
+static void write_lock_family(TextWriter& out, const char* name, const char* type, const char* help,
+        UINT64 (*value)(LockStats&)) {
+    out.put("# HELP ").put(name).put(' ').put(help).put('\n');
+    out.put("# TYPE ").put(name).put(' ').put(type).put('\n');
+    for (LockStats* stats = tracked_locks(); stats; stats = stats->next)
+        out.put(name).put("{lock=\"").put(stats->name).put("\"} ").put(value(*stats)).put('\n');
+}
+
+void write_lock_metrics(TextWriter& out) {
+    if (tracked_locks() == nullptr)
+        return;
+    write_lock_family(out, "lock_acquisitions_total", "counter", "Times the lock was taken.",
+        [](LockStats& stats) { return stats.acquisitions; });
+    write_lock_family(out, "lock_contended_total", "counter", "Acquisitions that had to wait.",
+        [](LockStats& stats) { return stats.contended; });
+    write_lock_family(out, "lock_spin_cycles_total", "counter", "TSC cycles spent waiting for the lock.",
+        [](LockStats& stats) { return stats.spin_cycles; });
+    write_lock_family(out, "lock_hold_cycles_total", "counter", "TSC cycles the lock was held.",
+        [](LockStats& stats) { return stats.hold_cycles; });
+    write_lock_family(out, "lock_max_hold_cycles", "gauge", "Longest hold in TSC cycles.",
+        [](LockStats& stats) { return stats.max_hold_cycles; });
+}
+
+void write_log_metrics(TextWriter& out) {
+    LogStats& stats = log_state.stats;
+    write_metric(out, "log_records_total", "counter", "Log lines at or above the current level.", stats.records.load(std::memory_order_relaxed));
+    write_metric(out, "log_dropped_total", "counter", "Log lines dropped on a full queue.", log_state.queue.full());
+    write_metric(out, "log_truncated_total", "counter", "Log lines cut at LOG_TEXT characters.", stats.truncated.load(std::memory_order_relaxed));
+    write_metric(out, "log_written_bytes_total", "counter", "Bytes sent to COM1.", stats.written);
+}
+
+void write_error_metrics(TextWriter& out) {
+    const char* name = "errors_total";
+    out.put("# HELP ").put(name).put(" Failures reported from each call site.\n");
+    out.put("# TYPE ").put(name).put(" counter\n");
+    for (std::size_t i = 0; i < error_site_count(); ++i) {
+        ErrorSite& site = error_site(i);
+        const char* file = site.file.load(std::memory_order_acquire);
+        if (file == nullptr)
+            continue;
+        for (const char* p = file; *p; ++p) {
+            if (*p == '/')
+                file = p + 1;
+        }
+        out.put(name).put("{site=\"").put(file).put(':').put((UINT64)site.line);
+        out.put("\",what=\"").put(site.what).put("\",status=\"").put(status_name(site.last.load(std::memory_order_relaxed)));
+        out.put("\"} ").put(site.count.load(std::memory_order_relaxed)).put('\n');
+    }
+    write_metric(out, "error_sites_overflowed_total", "counter", "Failures from call sites past the table size.", error_sites_overflowed());
+}
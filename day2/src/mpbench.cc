@@ -0,0 +1,229 @@
+#include "uefi.h"
+#include "frame_source.h"
+#include "parallel.h"
+#include "queue.h"
+#include "sync.h"
+#include "clock.h"
+
+// Scaling of CpuPool::parallel_for: the frame conversion done by render_cat
+// and a compute bound kernel, timed with 1, 2, ... CPUs. With APs around it
+// also pushes items through SpscQueue and MpscQueue across cores, checks
+// that every one of them arrives, and times a contended TicketLock. Run under `qemu -smp 4` (the run targets
+// pass -smp ${QEMU_CPUS}).
+
+EFI_STATUS mpbench_main(EFI_HANDLE, EFI_SYSTEM_TABLE*);
+
+extern "C" {
+
+	EFI_STATUS
+	EFIAPI
+	efi_main (EFI_HANDLE ImageHandle, EFI_SYSTEM_TABLE *SystemTable) {
+        InitializeLib(ImageHandle, SystemTable);
+        SystemTable->BootServices->SetWatchdogTimer(0, 0, 0, nullptr);
+        return mpbench_main(ImageHandle, SystemTable);
+	}
+
+}
+
+static const std::size_t FRAME_REPS = 200;
+static const std::size_t MIX_ITEMS = 1 << 16;
+static const std::size_t MIX_ROUNDS = 256;
+static const std::size_t QUEUE_ITEMS = 1 << 20;
+
+static const std::size_t LOCK_ROUNDS = 1 << 18;
+
+static SpscQueue<UINT64, 1024> spsc_queue;
+static MpscQueue<UINT64, 1024> mpsc_queue;
+
+static UINT64 mix(UINT64 x) {
+    for (std::size_t i = 0; i < MIX_ROUNDS; ++i) {
+        x ^= x >> 33;
+        x *= 0xff51afd7ed558ccdull;
+        x ^= x >> 29;
+    }
+    return x;
+}
+
+static UINT64 bench_frames(CpuPool& cpus, const char* rgb, EFI_GRAPHICS_OUTPUT_BLT_PIXEL* out) {
+    UINT64 start = rdtsc();
+    for (std::size_t rep = 0; rep < FRAME_REPS; ++rep) {
+        cpus.parallel_for(FRAME_HEIGHT, 24, [=](std::size_t first, std::size_t end) {
+            convert_frame_rows(rgb, out, FRAME_WIDTH, first, end);
+        });
+    }
+    return us_since(start);
+}
+
+static UINT64 bench_mix(CpuPool& cpus, UINT64* out) {
+    UINT64 start = rdtsc();
+    cpus.parallel_for(MIX_ITEMS, 256, [=](std::size_t first, std::size_t end) {
+        for (std::size_t i = first; i < end; ++i)
+            out[i] = mix(i);
+    });
+    return us_since(start);
+}
+
+// Task 0 drains while the others push, CpuPool puts each task on its own CPU
+// as long as there are more CPUs than producers. Returns false if an item
+// went missing or arrived twice.
+static bool bench_spsc(CpuPool& cpus, UINT64& us) {
+    UINT64 sum = 0;
+    UINT64 start = rdtsc();
+    cpus.run_tasks(2, [&](std::size_t task) {
+        if (task == 1) {
+            for (UINT64 i = 1; i <= QUEUE_ITEMS; ++i) {
+                while (!spsc_queue.push(i))
+                    __builtin_ia32_pause();
+            }
+            return;
+        }
+        UINT64 expect = 1;
+        UINT64 item;
+        while (expect <= QUEUE_ITEMS) {
+            if (!spsc_queue.pop(item)) {
+                __builtin_ia32_pause();
+                continue;
+            }
+            sum += item == expect ? 1 : 0;
+            expect += 1;
+        }
+    });
+    us = us_since(start);
+    return sum == QUEUE_ITEMS;
+}
+
+static bool bench_mpsc(CpuPool& cpus, UINT64& us) {
+    std::size_t producers = cpus.cpus() - 1;
+    UINT64 sum = 0;
+    UINT64 start = rdtsc();
+    cpus.run_tasks(cpus.cpus(), [&](std::size_t task) {
+        if (task > 0) {
+            for (UINT64 i = 1; i <= QUEUE_ITEMS; ++i) {
+                while (!mpsc_queue.push(i))
+                    __builtin_ia32_pause();
+            }
+            return;
+        }
+        UINT64 item;
+        for (std::size_t left = producers * QUEUE_ITEMS; left > 0;) {
+            if (!mpsc_queue.pop(item)) {
+                __builtin_ia32_pause();
+                continue;
+            }
+            sum += item;
+            left -= 1;
+        }
+    });
+    us = us_since(start);
+    return sum == producers * (QUEUE_ITEMS * (QUEUE_ITEMS + 1) / 2);
+}
+
+// Every CPU bumps one shared counter under the lock.
+static bool bench_lock(CpuPool& cpus, LockStats& stats, UINT64& us) {
+    TicketLock lock(&stats);
+    UINT64 counter = 0;
+    UINT64 start = rdtsc();
+    cpus.parallel_for(LOCK_ROUNDS, 64, [&](std::size_t first, std::size_t end) {
+        for (std::size_t i = first; i < end; ++i) {
+            LockGuard<TicketLock> guard(lock);
+            counter += 1;
+        }
+    });
+    us = us_since(start);
+    return counter == LOCK_ROUNDS;
+}
+
+static void report_queue(const wchar_t* name, std::size_t producers, std::size_t items, UINT64 us, bool ok) {
+    if (us == 0)
+        us = 1;
+    Print((CHAR16*)L"%-7s %ld producers %ld items in %ld us, %ld items/ms%s\n", name, (INT64)producers, (INT64)items,
+            (INT64)us, (INT64)(items * 1000 / us), ok ? L"" : L", LOST ITEMS");
+}
+
+static void report(const wchar_t* name, std::size_t cpus, UINT64 us, UINT64 base_us) {
+    if (us == 0)
+        us = 1;
+    UINT64 speedup = base_us * 100 / us;
+    Print((CHAR16*)L"%-7s %ld cpus %ld us  x%ld.%02ld\n", name, (INT64)cpus, (INT64)us,
+            (INT64)(speedup / 100), (INT64)(speedup % 100));
+}
+
+EFI_STATUS mpbench_main(EFI_HANDLE, EFI_SYSTEM_TABLE* SystemTable) {
+    st = SystemTable;
+    bs = SystemTable->BootServices;
+    clock_init(100'000);
+
+    char* rgb = (char*)malloc(FRAME_BYTES);
+    EFI_GRAPHICS_OUTPUT_BLT_PIXEL* pixels = (EFI_GRAPHICS_OUTPUT_BLT_PIXEL*)malloc(FRAME_WIDTH * FRAME_HEIGHT * sizeof(EFI_GRAPHICS_OUTPUT_BLT_PIXEL));
+    UINT64* mixed = (UINT64*)malloc(MIX_ITEMS * sizeof(UINT64));
+    if (rgb == nullptr || pixels == nullptr || mixed == nullptr) {
+        Print((CHAR16*)L"out of memory\n");
+        return EFI_OUT_OF_RESOURCES;
+    }
+    for (std::size_t i = 0; i < FRAME_BYTES; ++i)
+        rgb[i] = (char)(i * 7);
+
+    CpuPool probe;
+    EFI_STATUS status = probe.open();
+    if (EFI_ERROR(status)) {
+        Print((CHAR16*)L"mp services: %r, timing the BSP only\n", status);
+    }
+    std::size_t aps = probe.cpus() - 1;
+    probe.close();
+    Print((CHAR16*)L"%ld cpus, %ld frames of %ldx%ld, %ld x %ld mix rounds\n", (INT64)(aps + 1), (INT64)FRAME_REPS,
+            (INT64)FRAME_WIDTH, (INT64)FRAME_HEIGHT, (INT64)MIX_ITEMS, (INT64)MIX_ROUNDS);
+
+    UINT64 frame_base = 0;
+    UINT64 mix_base = 0;
+    UINT64 checksum = 0;
+    for (std::size_t n = 0; n <= aps; ++n) {
+        CpuPool cpus;
+        if (n > 0 && EFI_ERROR(cpus.open(n)))
+            break;
+        // One untimed round brings every AP into its spin loop.
+        cpus.parallel_for(cpus.cpus(), 1, [](std::size_t, std::size_t) {});
+        UINT64 frame_us = bench_frames(cpus, rgb, pixels);
+        UINT64 mix_us = bench_mix(cpus, mixed);
+        if (n == 0) {
+            frame_base = frame_us;
+            mix_base = mix_us;
+            for (std::size_t i = 0; i < MIX_ITEMS; ++i)
+                checksum ^= mixed[i];
+        } else {
+            UINT64 check = 0;
+            for (std::size_t i = 0; i < MIX_ITEMS; ++i)
+                check ^= mixed[i];
+            if (check != checksum)
+                Print((CHAR16*)L"mix result differs with %ld cpus\n", (INT64)cpus.cpus());
+        }
+        report(L"frames", cpus.cpus(), frame_us, frame_base);
+        report(L"mix", cpus.cpus(), mix_us, mix_base);
+        Print((CHAR16*)L"        chunks: bsp %ld", (INT64)cpus.bsp_chunks());
+        for (std::size_t i = 0; i < cpus.worker_count(); ++i)
+            Print((CHAR16*)L", ap %ld", (INT64)cpus.worker_chunks(i));
+        Print((CHAR16*)L"\n");
+
+        if (n == 0)
+            continue;
+        UINT64 queue_us = 0;
+        if (n == 1) {
+            bool ok = bench_spsc(cpus, queue_us);
+            report_queue(L"spsc", 1, QUEUE_ITEMS, queue_us, ok);
+        }
+        bool ok = bench_mpsc(cpus, queue_us);
+        report_queue(L"mpsc", n, n * QUEUE_ITEMS, queue_us, ok);
+
+        LockStats stats("bench");
+        UINT64 lock_us = 0;
+        ok = bench_lock(cpus, stats, lock_us);
+        Print((CHAR16*)L"lock    %ld cpus %ld us, %ld of %ld contended, %ld spin / %ld hold cycles per lock%s\n",
+                (INT64)cpus.cpus(), (INT64)lock_us, (INT64)stats.contended, (INT64)stats.acquisitions,
+                (INT64)(stats.spin_cycles / stats.acquisitions), (INT64)(stats.hold_cycles / stats.acquisitions),
+                ok ? L"" : L", LOST UPDATES");
+    }
+
+    free(mixed);
+    free(pixels);
+    free(rgb);
+    return EFI_SUCCESS;
+}
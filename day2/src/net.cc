@@ -0,0 +1,353 @@
+#include "net.h"
+
+TcpStats tcp_stats;
+
+efi::vector<EFI_SERVICE_BINDING*> get_tcp4_services() {
+    return Handles(EFI_TCP4_SERVICE_BINDING_PROTOCOL).collect_interfaces<EFI_SERVICE_BINDING>();
+}
+
+efi::vector<EFI_SERVICE_BINDING*> get_tcp6_services() {
+    return Handles(EFI_TCP6_SERVICE_BINDING_PROTOCOL).collect_interfaces<EFI_SERVICE_BINDING>();
+}
+
+// TCP4 and TCP6 tokens are laid out the same, only the type names and the
+// position of the functions in the protocol differ. The primitives below are
+// written once against these and instantiated for both.
+template<typename Tcp> struct TcpTypes;
+
+template<> struct TcpTypes<EFI_TCP4> {
+    typedef EFI_TCP4_CONFIG_DATA Config;
+    typedef EFI_TCP4_CONNECTION_TOKEN ConnectionToken;
+    typedef EFI_TCP4_IO_TOKEN IoToken;
+    typedef EFI_TCP4_TRANSMIT_DATA TxData;
+    typedef EFI_TCP4_RECEIVE_DATA RxData;
+    typedef EFI_TCP4_CLOSE_TOKEN CloseToken;
+};
+
+template<> struct TcpTypes<EFI_TCP6> {
+    typedef EFI_TCP6_CONFIG_DATA Config;
+    typedef EFI_TCP6_CONNECTION_TOKEN ConnectionToken;
+    typedef EFI_TCP6_IO_TOKEN IoToken;
+    typedef EFI_TCP6_TRANSMIT_DATA TxData;
+    typedef EFI_TCP6_RECEIVE_DATA RxData;
+    typedef EFI_TCP6_CLOSE_TOKEN CloseToken;
+};
+
+template<typename Tcp>
+static EFI_STATUS await_completion_on(Tcp* tcp, EFI_EVENT event, std::size_t spin_budget) {
+    for (std::size_t i=0; i < spin_budget; ++i) {
+        uefi(tcp->Poll, tcp);
+        if (check_event(event))
+            return EFI_SUCCESS;
+    }
+    return wait_for(event);
+}
+
+template<typename Tcp>
+static EFI_STATUS connect_on(Tcp* tcp) {
+    typename TcpTypes<Tcp>::ConnectionToken token;
+    EFI_STATUS status = create_event(0, 0, nullptr, nullptr, &token.CompletionToken.Event);
+    if (EFI_ERROR(status))
+        return status;
+    status = uefi(tcp->Connect, tcp, &token);
+    if (EFI_ERROR(status)) {
+        close_event(token.CompletionToken.Event);
+        return status;
+    }
+    status = wait_for(token.CompletionToken.Event);
+    close_event(token.CompletionToken.Event);
+    if (EFI_ERROR(status)) {
+        return status;
+    }
+    return token.CompletionToken.Status;
+}
+
+template<typename Tcp>
+static Result<std::size_t> send_on(Tcp* tcp, char* buffer, std::size_t n, std::size_t spin_budget) {
+    typename TcpTypes<Tcp>::IoToken token;
+    EFI_STATUS status = create_event(0, 0, nullptr, nullptr, &token.CompletionToken.Event);
+    if (EFI_ERROR(status))
+        return fail(status);
+    typename TcpTypes<Tcp>::TxData mTx;
+    token.Packet.TxData = &mTx;
+    mTx.Push = TRUE;
+    mTx.Urgent = FALSE;
+    mTx.DataLength = n;
+    mTx.FragmentCount = 1;
+    mTx.FragmentTable[0].FragmentLength = n;
+    mTx.FragmentTable[0].FragmentBuffer = (void*)buffer;
+    status = uefi(tcp->Transmit, tcp, &token);
+    if (EFI_ERROR(status)) {
+        close_event(token.CompletionToken.Event);
+        return fail(status);
+    }
+
+    status = await_completion_on(tcp, token.CompletionToken.Event, spin_budget);
+    close_event(token.CompletionToken.Event);
+    if (!EFI_ERROR(status))
+        status = token.CompletionToken.Status;
+    if (EFI_ERROR(status)) {
+        tcp_stats.errors += 1;
+        return fail(status);
+    }
+    tcp_stats.sends += 1;
+    tcp_stats.send_bytes += mTx.DataLength;
+    return mTx.DataLength;
+}
+
+template<typename Tcp>
+static Result<std::size_t> recv_on(Tcp* tcp, char* buffer, std::size_t n, std::size_t spin_budget) {
+    typename TcpTypes<Tcp>::IoToken token;
+    EFI_STATUS status = create_event(0, 0, nullptr, nullptr, &token.CompletionToken.Event);
+    if (EFI_ERROR(status))
+        return fail(status);
+    typename TcpTypes<Tcp>::RxData mRx;
+    token.Packet.RxData = &mRx;
+    mRx.UrgentFlag = FALSE;
+    mRx.DataLength = n;
+    mRx.FragmentCount = 1;
+    mRx.FragmentTable[0].FragmentLength = n;
+    mRx.FragmentTable[0].FragmentBuffer = (void*)buffer;
+    status = uefi(tcp->Receive, tcp, &token);
+    // The driver refuses new receives once the peer's FIN is in.
+    if (status == EFI_CONNECTION_FIN) {
+        close_event(token.CompletionToken.Event);
+        return (std::size_t)0;
+    }
+    if (EFI_ERROR(status)) {
+        close_event(token.CompletionToken.Event);
+        return fail(status);
+    }
+    status = await_completion_on(tcp, token.CompletionToken.Event, spin_budget);
+    close_event(token.CompletionToken.Event);
+    if (!EFI_ERROR(status))
+        status = token.CompletionToken.Status;
+    if (status == EFI_CONNECTION_FIN)
+        return (std::size_t)0;
+    if (EFI_ERROR(status)) {
+        tcp_stats.errors += 1;
+        return fail(status);
+    }
+    tcp_stats.recvs += 1;
+    tcp_stats.recv_bytes += mRx.DataLength;
+    return mRx.DataLength;
+}
+
+template<typename Tcp>
+static void close_on(Tcp* tcp) {
+    typename TcpTypes<Tcp>::CloseToken token;
+    EFI_STATUS status = create_event(0, 0, nullptr, nullptr, &token.CompletionToken.Event);
+    if (EFI_ERROR(status))
+        return;
+    token.AbortOnClose = FALSE;
+    status = uefi(tcp->Close, tcp, &token);
+    if (!EFI_ERROR(status))
+        wait_for(token.CompletionToken.Event);
+    close_event(token.CompletionToken.Event);
+}
+
+EFI_STATUS await_completion(EFI_TCP4* tcp, EFI_EVENT event, std::size_t spin_budget) {
+    return await_completion_on(tcp, event, spin_budget);
+}
+
+EFI_STATUS await_completion(EFI_TCP6* tcp, EFI_EVENT event, std::size_t spin_budget) {
+    return await_completion_on(tcp, event, spin_budget);
+}
+
+EFI_STATUS socket_config(EFI_TCP4* tcp, EFI_TCP4_CONFIG_DATA& config) {
+    return uefi(tcp->Configure, tcp, &config);
+}
+
+EFI_STATUS socket_config(EFI_TCP6* tcp, EFI_TCP6_CONFIG_DATA& config) {
+    return uefi(tcp->Configure, tcp, &config);
+}
+
+EFI_STATUS connect(EFI_TCP4* tcp) {
+    return connect_on(tcp);
+}
+
+EFI_STATUS connect(EFI_TCP6* tcp) {
+    return connect_on(tcp);
+}
+
+Result<std::size_t> send(EFI_TCP4* tcp, char* buffer, std::size_t n, std::size_t spin_budget) {
+    return send_on(tcp, buffer, n, spin_budget);
+}
+
+Result<std::size_t> send(EFI_TCP6* tcp, char* buffer, std::size_t n, std::size_t spin_budget) {
+    return send_on(tcp, buffer, n, spin_budget);
+}
+
+Result<std::size_t> recv(EFI_TCP4* tcp, char* buffer, std::size_t n, std::size_t spin_budget) {
+    return recv_on(tcp, buffer, n, spin_budget);
+}
+
+Result<std::size_t> recv(EFI_TCP6* tcp, char* buffer, std::size_t n, std::size_t spin_budget) {
+    return recv_on(tcp, buffer, n, spin_budget);
+}
+
+void close(EFI_TCP4* tcp) {
+    close_on(tcp);
+}
+
+void close(EFI_TCP6* tcp) {
+    close_on(tcp);
+}
+
+void TcpConfig::to_tcp6(EFI_TCP6_CONFIG_DATA& config, EFI_TCP6_OPTION& control) {
+    EFI_TCP4_CONFIG_DATA& v4 = get();
+    config = {};
+    config.TrafficClass = v4.TypeOfService;
+    config.HopLimit = v4.TimeToLive;
+    // An all-zero station address lets the driver pick one.
+    config.AccessPoint.StationPort = v4.AccessPoint.StationPort;
+    config.AccessPoint.RemotePort = v4.AccessPoint.RemotePort;
+    config.AccessPoint.ActiveFlag = v4.AccessPoint.ActiveFlag;
+    config.ControlOption = nullptr;
+    if (!has_option)
+        return;
+    control = {};
+    control.ReceiveBufferSize = option.ReceiveBufferSize;
+    control.SendBufferSize = option.SendBufferSize;
+    control.MaxSynBackLog = option.MaxSynBackLog;
+    control.ConnectionTimeout = option.ConnectionTimeout;
+    control.DataRetries = option.DataRetries;
+    control.FinTimeout = option.FinTimeout;
+    control.TimeWaitTimeout = option.TimeWaitTimeout;
+    control.KeepAliveProbes = option.KeepAliveProbes;
+    control.KeepAliveTime = option.KeepAliveTime;
+    control.KeepAliveInterval = option.KeepAliveInterval;
+    control.EnableNagle = option.EnableNagle;
+    control.EnableTimeStamp = option.EnableTimeStamp;
+    control.EnableWindbowScaling = option.EnableWindowScaling;
+    control.EnableSelectiveAck = option.EnableSelectiveAck;
+    control.EnablePathMtuDiscovery = option.EnablePAthMtuDiscovery;
+    config.ControlOption = &control;
+}
+
+EFI_STATUS TcpConnection::open(EFI_SERVICE_BINDING* service, TcpConfig& config) {
+    close();
+    EFI_HANDLE handle = nullptr;
+    EFI_STATUS status = uefi(service->CreateChild, service, &handle);
+    if (EFI_ERROR(status))
+        return status;
+    EFI_GUID guid = EFI_TCP4_PROTOCOL;
+    EFI_TCP4* tcp;
+    status = handle_protocol(handle, &guid, tcp);
+    if (!EFI_ERROR(status))
+        status = socket_config(tcp, config.get());
+    if (!EFI_ERROR(status))
+        status = connect(tcp);
+    if (EFI_ERROR(status)) {
+        uefi(service->DestroyChild, service, handle);
+        return status;
+    }
+    this->service = service;
+    this->handle = handle;
+    this->tcp_ = tcp;
+    this->remote_ = config.remote();
+    return EFI_SUCCESS;
+}
+
+void TcpConnection::close() {
+    if (tcp_ == nullptr)
+        return;
+    ::close(tcp_);
+    uefi(tcp_->Configure, tcp_, (EFI_TCP4_CONFIG_DATA*)nullptr);
+    uefi(service->DestroyChild, service, handle);
+    tcp_ = nullptr;
+    handle = nullptr;
+}
+
+bool TcpConnection::send_all(const void* buffer, std::size_t n) {
+    char* ptr = (char*)buffer;
+    while (n) {
+        auto sent = send(ptr, n);
+        if (EFI_ERROR(check(sent.status(), "tcp send")) || *sent == 0)
+            return false;
+        ptr += *sent;
+        n -= *sent;
+    }
+    return true;
+}
+
+bool TcpConnection::recv_all(void* buffer, std::size_t n) {
+    char* ptr = (char*)buffer;
+    while (n) {
+        auto got = recv(ptr, n);
+        if (EFI_ERROR(check(got.status(), "tcp recv")) || *got == 0)
+            return false;
+        ptr += *got;
+        n -= *got;
+    }
+    return true;
+}
+
+bool TcpConnection::established() {
+    if (tcp_ == nullptr)
+        return false;
+    EFI_TCP4_CONNECTION_STATE state;
+    EFI_STATUS status = uefi(tcp_->GetModeData, tcp_, &state, (EFI_TCP4_CONFIG_DATA*)nullptr,
+            (EFI_IP4_MODE_DATA*)nullptr, (EFI_MANAGED_NETWORK_CONFIG_DATA*)nullptr, (EFI_SIMPLE_NETWORK_MODE*)nullptr);
+    return !EFI_ERROR(status) && state == Tcp4StateEstablished;
+}
+
+Result<TcpConnection*> ConnectionPool::acquire(const Endpoint& remote) {
+    Entry* empty = nullptr;
+    Entry* oldest_idle = nullptr;
+    for (auto& entry : entries) {
+        if (entry.in_use)
+            continue;
+        if (!entry.connection.is_open()) {
+            if (empty == nullptr)
+                empty = &entry;
+            continue;
+        }
+        if (entry.connection.remote() == remote) {
+            if (entry.connection.established()) {
+                entry.in_use = true;
+                entry.last_used = ++clock;
+                reused_ += 1;
+                return &entry.connection;
+            }
+            // Peer went away while the connection sat in the pool.
+            entry.connection.close();
+            if (empty == nullptr)
+                empty = &entry;
+            continue;
+        }
+        if (oldest_idle == nullptr || entry.last_used < oldest_idle->last_used)
+            oldest_idle = &entry;
+    }
+
+    Entry* slot = empty ? empty : oldest_idle;
+    if (slot == nullptr)
+        return fail(EFI_OUT_OF_RESOURCES);
+    TcpConfig config = base;
+    config.remote(remote);
+    EFI_STATUS status = slot->connection.open(service, config);
+    if (EFI_ERROR(status))
+        return fail(status);
+    opened_ += 1;
+    slot->in_use = true;
+    slot->last_used = ++clock;
+    return &slot->connection;
+}
+
+void ConnectionPool::release(TcpConnection* connection, bool reusable) {
+    for (auto& entry : entries) {
+        if (&entry.connection != connection)
+            continue;
+        entry.in_use = false;
+        if (!reusable)
+            entry.connection.close();
+        return;
+    }
+}
+
+void ConnectionPool::close_all() {
+    for (auto& entry : entries) {
+        entry.connection.close();
+        entry.in_use = false;
+    }
+}
@@ -0,0 +1,491 @@
+#include "uefi.h"
+#include "net.h"
+#include "rawnet.h"
+#include "socket.h"
+#include "rx_pool.h"
+#include "fiber.h"
+#include "coro.h"
+#include "clock.h"
+
+// Bulk transfer benchmark: firmware TCP4 with each TcpConfig preset, IPv4
+// against IPv6 through the same StreamSocket/DatagramSocket code, then RawNet
+// (UDP over SNP). TCP runs also measure ping-pong RTT, one connection at a
+// time and from many fibers or coroutines at once.
+// Needs tools/net_bench_server.py on 192.168.100.1, see its header for the protocol.
+
+EFI_STATUS netbench_main(EFI_HANDLE, EFI_SYSTEM_TABLE*);
+
+extern "C" {
+
+	EFI_STATUS
+	EFIAPI
+	efi_main (EFI_HANDLE ImageHandle, EFI_SYSTEM_TABLE *SystemTable) {
+        InitializeLib(ImageHandle, SystemTable);
+        SystemTable->BootServices->SetWatchdogTimer(0, 0, 0, nullptr);
+        return netbench_main(ImageHandle, SystemTable);
+	}
+
+}
+
+static const EFI_IPv4_ADDRESS LOCAL_IP = { {192, 168, 100, 2} };
+static const EFI_IPv4_ADDRESS NETMASK = { {255, 255, 255, 0} };
+static const EFI_IPv4_ADDRESS SERVER_IP = { {192, 168, 100, 1} };
+static const EFI_IPv6_ADDRESS SERVER_IP6 = { {0xfd, 0x00, 0x01, 0x00, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x01} }; // fd00:100::1
+static const UINT16 SERVER_TCP_PORT = 4445;
+static const UINT16 SERVER_UDP_PORT = 4446;
+
+static const std::size_t BENCH_BYTES = 32 * 1024 * 1024;
+static const std::size_t CHUNK = 64 * 1024;
+static const std::size_t PING_ROUNDS = 1000;
+static const std::size_t PING_SPIN_BUDGET = 100'000;
+static const std::size_t FIBER_CLIENTS = 32;
+static const std::size_t FIBER_ROUNDS = 100;
+
+enum BenchOp : UINT32 {
+    BenchSink = 1,
+    BenchSource = 2,
+    BenchDone = 3,
+    BenchPing = 4,
+};
+
+struct BenchCommand {
+    UINT32 magic;
+    UINT32 op;
+    UINT64 size;
+};
+static const UINT32 BENCH_MAGIC = 0x4e45424e; // "NBEN"
+
+static void report(const wchar_t* name, std::size_t bytes, UINT64 us) {
+    if (us == 0)
+        us = 1;
+    UINT64 kib_s = (UINT64)bytes * 1'000'000 / 1024 / us;
+    Print((CHAR16*)L"%-10s %ld bytes in %ld us: %ld.%02ld MiB/s\n", name, (INT64)bytes, (INT64)us,
+            (INT64)(kib_s / 1024), (INT64)((kib_s % 1024) * 100 / 1024));
+}
+
+static const Endpoint SERVER_TCP = { SERVER_IP, SERVER_TCP_PORT };
+
+static void bench_tcp_tx(ConnectionPool& pool, char* buffer) {
+    auto acquired = pool.acquire(SERVER_TCP);
+    if (!acquired) {
+        Print((CHAR16*)L"tcp4 tx: connect failed: %a\n", status_name(acquired.status()));
+        return;
+    }
+    TcpConnection* connection = *acquired;
+    BenchCommand cmd { BENCH_MAGIC, BenchSink, BENCH_BYTES };
+    UINT64 start = rdtsc();
+    bool ok = connection->send_all(&cmd, sizeof(cmd));
+    for (std::size_t done = 0; ok && done < BENCH_BYTES; done += CHUNK)
+        ok = connection->send_all(buffer, CHUNK);
+    // The server acknowledges with the byte count once everything arrived.
+    UINT64 acked = 0;
+    ok = ok && connection->recv_all(&acked, sizeof(acked));
+    UINT64 us = us_since(start);
+    pool.release(connection, ok);
+    if (!ok) {
+        Print((CHAR16*)L"tcp4 tx: transfer failed\n");
+        return;
+    }
+    report(L"tcp4 tx", acked, us);
+}
+
+static void bench_tcp_rx(ConnectionPool& pool, char* buffer) {
+    auto acquired = pool.acquire(SERVER_TCP);
+    if (!acquired) {
+        Print((CHAR16*)L"tcp4 rx: connect failed: %a\n", status_name(acquired.status()));
+        return;
+    }
+    TcpConnection* connection = *acquired;
+    BenchCommand cmd { BENCH_MAGIC, BenchSource, BENCH_BYTES };
+    UINT64 start = rdtsc();
+    bool ok = connection->send_all(&cmd, sizeof(cmd));
+    std::size_t done = 0;
+    while (ok && done < BENCH_BYTES) {
+        auto got = connection->recv(buffer, BENCH_BYTES - done < CHUNK ? BENCH_BYTES - done : CHUNK);
+        ok = !EFI_ERROR(check(got.status(), "tcp4 rx")) && *got != 0;
+        done += got.value();
+    }
+    UINT64 us = us_since(start);
+    pool.release(connection, ok);
+    if (!ok) {
+        Print((CHAR16*)L"tcp4 rx: transfer failed\n");
+        return;
+    }
+    report(L"tcp4 rx", done, us);
+}
+
+// Same transfer as bench_tcp_rx, but the driver fills pool buffers that stay
+// posted back to back and the data is read in place.
+static void bench_tcp_rx_lent(ConnectionPool& pool) {
+    auto acquired = pool.acquire(SERVER_TCP);
+    if (!acquired) {
+        Print((CHAR16*)L"tcp4 rx lent: connect failed: %a\n", status_name(acquired.status()));
+        return;
+    }
+    TcpConnection* connection = *acquired;
+    BenchCommand cmd { BENCH_MAGIC, BenchSource, BENCH_BYTES };
+    UINT64 start = rdtsc();
+    bool ok = connection->send_all(&cmd, sizeof(cmd));
+    std::size_t done = 0;
+    UINT8 sum = 0;
+    {
+        // Posting more than the transfer would swallow the next command's reply.
+        RxPool rx(8, CHUNK);
+        ok = ok && !EFI_ERROR(check(rx.open(connection->tcp()), "tcp4 rx lent pool"));
+        RxBuffer buffer;
+        while (ok && done < BENCH_BYTES && rx.wait(buffer)) {
+            for (std::size_t i=0; i < buffer.size; i += 4096)
+                sum ^= (UINT8)buffer.data[i];
+            done += buffer.size;
+            rx.release(buffer.id);
+        }
+    }
+    UINT64 us = us_since(start);
+    // Receives still posted when the pool went away were cancelled, the
+    // connection is in an unknown state.
+    pool.release(connection, false);
+    if (done < BENCH_BYTES) {
+        Print((CHAR16*)L"tcp4 rx lent: transfer failed\n");
+        return;
+    }
+    report(L"tcp4 rx lent", done, us);
+    (void)sum;
+}
+
+// The server answers every BenchPing with the same command, so one round is
+// 16 bytes each way on an already established connection.
+static void bench_tcp_ping(ConnectionPool& pool, const wchar_t* name, std::size_t spin_budget) {
+    auto acquired = pool.acquire(SERVER_TCP);
+    if (!acquired) {
+        Print((CHAR16*)L"%s: connect failed: %a\n", name, status_name(acquired.status()));
+        return;
+    }
+    TcpConnection* connection = *acquired;
+    connection->busy_poll(spin_budget);
+    UINT64 min = ~0ULL, max = 0, total = 0;
+    std::size_t rounds = 0;
+    bool ok = true;
+    for (; ok && rounds < PING_ROUNDS; ++rounds) {
+        BenchCommand ping { BENCH_MAGIC, BenchPing, rounds };
+        BenchCommand pong {};
+        UINT64 start = rdtsc();
+        ok = connection->send_all(&ping, sizeof(ping)) && connection->recv_all(&pong, sizeof(pong))
+            && pong.op == BenchPing && pong.size == rounds;
+        UINT64 us = us_since(start);
+        min = us < min ? us : min;
+        max = us > max ? us : max;
+        total += us;
+    }
+    connection->busy_poll(0);
+    pool.release(connection, ok);
+    if (!ok) {
+        Print((CHAR16*)L"%s: failed after %ld rounds\n", name, (INT64)rounds);
+        return;
+    }
+    Print((CHAR16*)L"%-10s %ld rounds, rtt min %ld us avg %ld us max %ld us\n", name, (INT64)rounds,
+            (INT64)min, (INT64)(total / rounds), (INT64)max);
+}
+
+// Each fiber runs connect, then ping-pong rounds, written as plain blocking
+// code; the waits inside park the fiber and let the others go on.
+static void bench_fibers(EFI_SERVICE_BINDING* service) {
+    FiberRuntime fibers;
+    std::size_t rounds = 0;
+    std::size_t failed = 0;
+    for (std::size_t i=0; i < FIBER_CLIENTS; ++i) {
+        fibers.spawn([service, &rounds, &failed] {
+            TcpConnection connection;
+            TcpConfig config = TcpConfig::latency();
+            config.remote(SERVER_TCP);
+            if (EFI_ERROR(connection.open(service, config))) {
+                failed += 1;
+                return;
+            }
+            for (std::size_t n=0; n < FIBER_ROUNDS; ++n) {
+                BenchCommand ping { BENCH_MAGIC, BenchPing, n };
+                BenchCommand pong {};
+                if (!connection.send_all(&ping, sizeof(ping)) || !connection.recv_all(&pong, sizeof(pong))
+                        || pong.size != n) {
+                    failed += 1;
+                    return;
+                }
+                rounds += 1;
+            }
+        });
+    }
+    UINT64 start = rdtsc();
+    fibers.run();
+    UINT64 us = us_since(start);
+    if (us == 0)
+        us = 1;
+    Print((CHAR16*)L"%-10s %ld fibers, %ld rounds in %ld us: %ld rounds/s, %ld failed, %ld switches, %ld stacks\n",
+            L"fibers", (INT64)FIBER_CLIENTS, (INT64)rounds, (INT64)us, (INT64)(rounds * 1'000'000 / us),
+            (INT64)failed, (INT64)fibers.switches(), (INT64)fibers.stacks());
+}
+
+static Async<> coro_pinger(EFI_TCP4* tcp, std::size_t& rounds, std::size_t& failed) {
+    AsyncTcp sock(tcp);
+    for (std::size_t n=0; n < FIBER_ROUNDS; ++n) {
+        BenchCommand ping { BENCH_MAGIC, BenchPing, n };
+        BenchCommand pong {};
+        if (!co_await sock.send_all(&ping, sizeof(ping)) || !co_await sock.recv_all(&pong, sizeof(pong))
+                || pong.size != n) {
+            failed += 1;
+            co_return;
+        }
+        rounds += 1;
+    }
+}
+
+// The same load as bench_fibers with C++20 coroutines on one CoroLoop;
+// connections are set up first, only the rounds are concurrent.
+static void bench_coroutines(EFI_SERVICE_BINDING* service) {
+    TcpConnection connections[FIBER_CLIENTS];
+    std::size_t rounds = 0;
+    std::size_t failed = 0;
+    for (auto& connection : connections) {
+        TcpConfig config = TcpConfig::latency();
+        config.remote(SERVER_TCP);
+        if (EFI_ERROR(connection.open(service, config)))
+            failed += 1;
+    }
+    CoroLoop loop;
+    UINT64 start = rdtsc();
+    for (auto& connection : connections) {
+        if (connection.is_open() && !coro_pinger(connection.tcp(), rounds, failed).spawn(loop))
+            failed += 1;
+    }
+    loop.run();
+    UINT64 us = us_since(start);
+    if (us == 0)
+        us = 1;
+    Print((CHAR16*)L"%-10s %ld coroutines, %ld rounds in %ld us: %ld rounds/s, %ld failed, %ld frames from %ld slabs\n",
+            L"coroutines", (INT64)FIBER_CLIENTS, (INT64)rounds, (INT64)us, (INT64)(rounds * 1'000'000 / us),
+            (INT64)failed, (INT64)coro_frames.allocations(), (INT64)coro_frames.slabs());
+}
+
+struct Rtt {
+    UINT64 min = ~0ULL;
+    UINT64 max = 0;
+    UINT64 total = 0;
+    std::size_t rounds = 0;
+
+    void add(UINT64 us) {
+        min = us < min ? us : min;
+        max = us > max ? us : max;
+        total += us;
+        rounds += 1;
+    }
+    void print(const wchar_t* name, std::size_t lost) {
+        if (rounds == 0) {
+            Print((CHAR16*)L"%-10s no replies\n", name);
+            return;
+        }
+        Print((CHAR16*)L"%-10s %ld rounds, rtt min %ld us avg %ld us max %ld us, %ld lost\n", name, (INT64)rounds,
+                (INT64)min, (INT64)(total / rounds), (INT64)max, (INT64)lost);
+    }
+};
+
+// Identical runs per address family, so the only difference is TCP4/UDP4 vs TCP6/UDP6.
+static void bench_family(const wchar_t* const names[3], const SocketAddress& tcp_server, const SocketAddress& udp_server, char* buffer) {
+    StreamSocket stream;
+    TcpConfig config = TcpConfig::bulk();
+    EFI_STATUS status = stream.open(tcp_server, config);
+    if (EFI_ERROR(status)) {
+        Print((CHAR16*)L"%s: connect failed %r\n", names[0], status);
+        return;
+    }
+    BenchCommand cmd { BENCH_MAGIC, BenchSink, BENCH_BYTES };
+    UINT64 start = rdtsc();
+    bool ok = stream.send_all(&cmd, sizeof(cmd));
+    for (std::size_t done = 0; ok && done < BENCH_BYTES; done += CHUNK)
+        ok = stream.send_all(buffer, CHUNK);
+    UINT64 acked = 0;
+    ok = ok && stream.recv_all(&acked, sizeof(acked));
+    if (ok)
+        report(names[0], acked, us_since(start));
+    else
+        Print((CHAR16*)L"%s: transfer failed\n", names[0]);
+
+    Rtt tcp_rtt;
+    for (std::size_t i=0; ok && i < PING_ROUNDS; ++i) {
+        BenchCommand ping { BENCH_MAGIC, BenchPing, i };
+        BenchCommand pong {};
+        start = rdtsc();
+        ok = stream.send_all(&ping, sizeof(ping)) && stream.recv_all(&pong, sizeof(pong)) && pong.size == i;
+        if (ok)
+            tcp_rtt.add(us_since(start));
+    }
+    tcp_rtt.print(names[1], PING_ROUNDS - tcp_rtt.rounds);
+    stream.close();
+
+    // The UDP side of the server answers every BenchDone, which makes it an echo.
+    DatagramSocket datagram;
+    status = datagram.open(udp_server, 0);
+    if (EFI_ERROR(status)) {
+        Print((CHAR16*)L"%s: open failed %r\n", names[2], status);
+        return;
+    }
+    Rtt udp_rtt;
+    for (std::size_t i=0; i < PING_ROUNDS; ++i) {
+        BenchCommand ping { BENCH_MAGIC, BenchDone, 0 };
+        BenchCommand pong {};
+        start = rdtsc();
+        if (datagram.send(&ping, sizeof(ping)) && datagram.recv(&pong, sizeof(pong), 100'000) == sizeof(pong))
+            udp_rtt.add(us_since(start));
+    }
+    udp_rtt.print(names[2], PING_ROUNDS - udp_rtt.rounds);
+}
+
+static bool raw_send(RawNet& net, const void* data, std::size_t size) {
+    while (true) {
+        EFI_STATUS status = net.send_udp(SERVER_IP, SERVER_UDP_PORT, SERVER_UDP_PORT, data, size);
+        if (status != EFI_NOT_READY)
+            return !EFI_ERROR(status);
+        net.poll();
+    }
+}
+
+// Waits for the server's BenchDone datagram carrying the byte count it saw.
+static bool raw_wait_done(RawNet& net, const BenchCommand& resend, UINT64& bytes) {
+    for (std::size_t tries = 0; tries < 50; ++tries) {
+        raw_send(net, &resend, sizeof(resend));
+        for (std::size_t waited = 0; waited < 100; ++waited) {
+            net.poll();
+            RawDatagram d;
+            while (net.peek(d)) {
+                const BenchCommand* reply = (const BenchCommand*)d.data;
+                bool done = d.size >= sizeof(BenchCommand) && reply->magic == BENCH_MAGIC && reply->op == BenchDone;
+                if (done)
+                    bytes = reply->size;
+                net.release();
+                if (done)
+                    return true;
+            }
+            sleep(1000);
+        }
+    }
+    return false;
+}
+
+static void bench_raw_tx(RawNet& net, char* buffer) {
+    BenchCommand cmd { BENCH_MAGIC, BenchSink, BENCH_BYTES };
+    UINT64 start = rdtsc();
+    bool ok = raw_send(net, &cmd, sizeof(cmd));
+    std::size_t sent = 0;
+    while (ok && sent < BENCH_BYTES) {
+        std::size_t n = BENCH_BYTES - sent < RAWNET_UDP_PAYLOAD ? BENCH_BYTES - sent : RAWNET_UDP_PAYLOAD;
+        ok = raw_send(net, buffer + (sent % CHUNK), n);
+        sent += n;
+    }
+    net.flush();
+    UINT64 us = us_since(start);
+    BenchCommand done { BENCH_MAGIC, BenchDone, sent };
+    UINT64 received = 0;
+    if (!ok || !raw_wait_done(net, done, received)) {
+        Print((CHAR16*)L"raw tx: transfer failed\n");
+        return;
+    }
+    report(L"raw tx", sent, us);
+    Print((CHAR16*)L"           server got %ld of %ld bytes\n", (INT64)received, (INT64)sent);
+}
+
+static void bench_raw_rx(RawNet& net) {
+    BenchCommand cmd { BENCH_MAGIC, BenchSource, BENCH_BYTES };
+    UINT64 start = rdtsc();
+    UINT64 last = start;
+    std::size_t received = 0;
+    bool finished = false;
+    if (!raw_send(net, &cmd, sizeof(cmd))) {
+        Print((CHAR16*)L"raw rx: request failed\n");
+        return;
+    }
+    // Ends on the server's BenchDone or after 500 ms without traffic.
+    while (!finished && us_since(last) < 500'000) {
+        net.poll();
+        RawDatagram d;
+        while (net.peek(d)) {
+            const BenchCommand* c = (const BenchCommand*)d.data;
+            if (d.size == sizeof(BenchCommand) && c->magic == BENCH_MAGIC && c->op == BenchDone)
+                finished = true;
+            else
+                received += d.size;
+            net.release();
+            last = rdtsc();
+        }
+    }
+    report(L"raw rx", received, cycles_to_us(last - start));
+    Print((CHAR16*)L"           %ld of %ld bytes, %ld ring stalls\n", (INT64)received, (INT64)BENCH_BYTES, (INT64)net.rx_stalls());
+}
+
+EFI_STATUS netbench_main(EFI_HANDLE, EFI_SYSTEM_TABLE* SystemTable) {
+    st = SystemTable;
+    bs = SystemTable->BootServices;
+
+    clock_init(100'000);
+    Print((CHAR16*)L"netbench: %ld MiB per run, tsc %ld MHz\n", (INT64)(BENCH_BYTES >> 20), (INT64)clock_calibration.tsc_per_us);
+
+    char* buffer = (char*)malloc(CHUNK);
+    if (buffer == nullptr)
+        return EFI_OUT_OF_RESOURCES;
+    for (std::size_t i=0; i < CHUNK; ++i)
+        buffer[i] = (char)i;
+
+    auto services = get_tcp4_services();
+    if (services.empty()) {
+        Print((CHAR16*)L"tcp4: no service binding\n");
+    } else {
+        struct {
+            const wchar_t* name;
+            TcpConfig config;
+        } presets[] = {
+            // No ControlOption at all, the driver's own defaults.
+            { L"default", TcpConfig() },
+            { L"bulk", TcpConfig::bulk().keep_alive(5, 30, 5) },
+            { L"latency", TcpConfig::latency().keep_alive(5, 30, 5) },
+        };
+        for (auto& preset : presets) {
+            Print((CHAR16*)L"tcp4 preset %s\n", preset.name);
+            ConnectionPool pool(services[0], preset.config, 2);
+            bench_tcp_tx(pool, buffer);
+            bench_tcp_rx(pool, buffer);
+            bench_tcp_rx_lent(pool);
+            bench_tcp_ping(pool, L"tcp4 ping", 0);
+            Print((CHAR16*)L"tcp4: %ld connections opened, %ld reused\n", (INT64)pool.opened(), (INT64)pool.reused());
+        }
+
+        // Same connection, blocking WaitForEvent against Poll/CheckEvent spinning.
+        TcpConfig config = TcpConfig::latency();
+        ConnectionPool pool(services[0], config.keep_alive(5, 30, 5), 1);
+        bench_tcp_ping(pool, L"blocking", 0);
+        bench_tcp_ping(pool, L"busy-poll", PING_SPIN_BUDGET);
+        pool.close_all();
+
+        bench_fibers(services[0]);
+        bench_coroutines(services[0]);
+    }
+
+    static const wchar_t* const IPV4_NAMES[] = { L"ipv4 tx", L"ipv4 ping", L"udp4 ping" };
+    static const wchar_t* const IPV6_NAMES[] = { L"ipv6 tx", L"ipv6 ping", L"udp6 ping" };
+    bench_family(IPV4_NAMES, SocketAddress::ipv4(SERVER_IP, SERVER_TCP_PORT), SocketAddress::ipv4(SERVER_IP, SERVER_UDP_PORT), buffer);
+    bench_family(IPV6_NAMES, SocketAddress::ipv6(SERVER_IP6, SERVER_TCP_PORT), SocketAddress::ipv6(SERVER_IP6, SERVER_UDP_PORT), buffer);
+
+    auto snps = get_snp_interfaces();
+    if (snps.empty()) {
+        Print((CHAR16*)L"raw: no simple network protocol\n");
+    } else {
+        RawNet net(64, 256);
+        EFI_STATUS status = net.open(snps[0], LOCAL_IP, NETMASK, SERVER_IP);
+        if (!EFI_ERROR(status))
+            status = net.resolve(SERVER_IP, 1'000'000);
+        if (EFI_ERROR(status)) {
+            Print((CHAR16*)L"raw: setup failed %r\n", status);
+        } else {
+            bench_raw_tx(net, buffer);
+            bench_raw_rx(net);
+        }
+    }
+
+    free(buffer);
+    return EFI_SUCCESS;
+}
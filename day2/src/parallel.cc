@@ -0,0 +1,118 @@
+#include "parallel.h"
+#include "trace.h"
+
+void MSABI CpuPool::worker_main(void* arg) {
+    Worker* worker = (Worker*)arg;
+    CpuPool* pool = worker->pool;
+    trace_register_cpu((UINT32)(worker - pool->workers.data()) + 1);
+    // Jobs start at generation 1, one published before this AP came up is
+    // still picked up.
+    UINT32 seen = 0;
+    while (true) {
+        UINT32 current;
+        while ((current = pool->generation.load(std::memory_order_acquire)) == seen) {
+            if (pool->quit.load(std::memory_order_relaxed))
+                return;
+            __builtin_ia32_pause();
+        }
+        seen = current;
+        worker->chunks += pool->run_chunks();
+        pool->pending.fetch_sub(1, std::memory_order_release);
+    }
+}
+
+std::size_t CpuPool::run_chunks() {
+    std::size_t taken = 0;
+    std::size_t begin;
+    while ((begin = next.fetch_add(grain, std::memory_order_relaxed)) < count) {
+        std::size_t end = begin + grain < count ? begin + grain : count;
+        fn(ctx, begin, end);
+        taken += 1;
+    }
+    return taken;
+}
+
+void CpuPool::dispatch(std::size_t n, std::size_t grain, RangeFn fn, void* ctx) {
+    jobs_ += 1;
+    this->fn = fn;
+    this->ctx = ctx;
+    this->count = n;
+    this->grain = grain ? grain : 1;
+    next.store(0, std::memory_order_relaxed);
+    if (running == 0) {
+        inline_chunks_ += run_chunks();
+        return;
+    }
+    pending.store(running, std::memory_order_relaxed);
+    generation.fetch_add(1, std::memory_order_release);
+    inline_chunks_ += run_chunks();
+    while (pending.load(std::memory_order_acquire) != 0)
+        __builtin_ia32_pause();
+}
+
+EFI_STATUS CpuPool::open(std::size_t max_aps) {
+    if (mp)
+        return EFI_ALREADY_STARTED;
+    EFI_GUID guid = EFI_MP_SERVICES_PROTOCOL_GUID;
+    EFI_STATUS status = uefi(bs->LocateProtocol, &guid, (void*)nullptr, (void**)&mp);
+    if (EFI_ERROR(status)) {
+        mp = nullptr;
+        return status;
+    }
+    UINTN total = 0;
+    UINTN enabled = 0;
+    UINTN bsp = 0;
+    status = uefi(mp->GetNumberOfProcessors, mp, &total, &enabled);
+    if (!EFI_ERROR(status))
+        status = uefi(mp->WhoAmI, mp, &bsp);
+    if (EFI_ERROR(status)) {
+        mp = nullptr;
+        return status;
+    }
+
+    // All workers are listed before any AP starts, the APs keep pointers
+    // into the vector.
+    workers.clear();
+    for (UINTN i = 0; i < total && workers.size() < max_aps; ++i) {
+        EFI_PROCESSOR_INFORMATION info;
+        if (i == bsp || EFI_ERROR(uefi(mp->GetProcessorInfo, mp, i, &info)))
+            continue;
+        if (!(info.StatusFlag & PROCESSOR_ENABLED_BIT) || !(info.StatusFlag & PROCESSOR_HEALTH_STATUS_BIT))
+            continue;
+        workers.push_back({ this, i, nullptr, 0 });
+    }
+
+    quit.store(false, std::memory_order_relaxed);
+    generation.store(0, std::memory_order_relaxed);
+    running = 0;
+    for (Worker& worker : workers) {
+        if (EFI_ERROR(create_event(0, 0, nullptr, nullptr, &worker.stopped))) {
+            worker.stopped = nullptr;
+            continue;
+        }
+        status = uefi(mp->StartupThisAP, mp, reinterpret_cast<EFI_AP_PROCEDURE>(&worker_main), worker.processor,
+                      worker.stopped, (UINTN)0, (void*)&worker, (BOOLEAN*)nullptr);
+        if (EFI_ERROR(status)) {
+            close_event(worker.stopped);
+            worker.stopped = nullptr;
+            continue;
+        }
+        running += 1;
+    }
+    return EFI_SUCCESS;
+}
+
+void CpuPool::close() {
+    if (mp == nullptr)
+        return;
+    quit.store(true, std::memory_order_relaxed);
+    for (Worker& worker : workers) {
+        if (worker.stopped == nullptr)
+            continue;
+        wait_for(worker.stopped);
+        close_event(worker.stopped);
+        worker.stopped = nullptr;
+    }
+    running = 0;
+    mp = nullptr;
+}
@@ -0,0 +1,74 @@
+#include "profiler.h"
+#include "clock.h"
+
+const char* stage_name(FrameStage stage) {
+    switch (stage) {
+        case StageDecode: return "decode";
+        case StageComposite: return "composite";
+        case StageBlit: return "blit";
+    }
+    return "?";
+}
+
+void SampleRing::add(UINT32 us) {
+    samples[next] = us;
+    next = (next + 1) % SIZE;
+    if (count < SIZE)
+        count += 1;
+}
+
+SampleRing::Summary SampleRing::summary() {
+    Summary s = {};
+    s.count = count;
+    if (count == 0)
+        return s;
+    // Insertion sort, the window is small and mostly similar values.
+    UINT32 sorted[SIZE];
+    UINT64 sum = 0;
+    for (std::size_t i = 0; i < count; ++i) {
+        UINT32 v = samples[i];
+        sum += v;
+        std::size_t j = i;
+        for (; j > 0 && sorted[j - 1] > v; --j)
+            sorted[j] = sorted[j - 1];
+        sorted[j] = v;
+    }
+    s.min = sorted[0];
+    s.max = sorted[count - 1];
+    s.avg = sum / count;
+    s.p99 = sorted[(count * 99 + 99) / 100 - 1];
+    return s;
+}
+
+void FrameProfiler::begin_frame() {
+    UINT64 now = rdtsc();
+    if (frame_tsc)
+        intervals.add(cycles_to_us(now - frame_tsc));
+    frame_tsc = now;
+    stage_tsc = now;
+    frames_ += 1;
+}
+
+void FrameProfiler::end_stage(FrameStage stage) {
+    UINT64 now = rdtsc();
+    stages[stage].add(cycles_to_us(now - stage_tsc));
+    stage_tsc = now;
+}
+
+UINT64 FrameProfiler::fps_x100() {
+    SampleRing::Summary s = intervals.summary();
+    return s.avg ? 100'000'000 / s.avg : 0;
+}
+
+void FrameProfiler::hud_line(std::size_t i, TextWriter& out) {
+    if (i == 0) {
+        UINT64 fps = fps_x100();
+        out.put("fps ").put(fps / 100).put('.').put((fps % 100) / 10).put((fps % 10));
+        out.put("  frames ").put((UINT64)frames_);
+        return;
+    }
+    FrameStage stage = (FrameStage)(i - 1);
+    SampleRing::Summary s = stages[stage].summary();
+    out.put(stage_name(stage)).put(" min ").put((UINT64)s.min).put(" avg ").put((UINT64)s.avg);
+    out.put(" p99 ").put((UINT64)s.p99).put(" max ").put((UINT64)s.max).put(" us");
+}
@@ -0,0 +1,17 @@
+#include "qemu.h"
+#include "port_io.h"
+#include "log.h"
+
+UINT32 qemu_exit_code(EFI_STATUS status) {
+    if (status == EFI_SUCCESS)
+        return 0;
+    UINT32 code = (UINT32)(status & 0x7f);
+    return code ? code : 0x7f;
+}
+
+void qemu_exit(EFI_STATUS status) {
+    Print((CHAR16*)L"exit: status %r, code %ld\n", status, (INT64)qemu_exit_code(status));
+    log_flush();
+    outl(QEMU_DEBUG_EXIT_PORT, qemu_exit_code(status));
+    uefi(st->RuntimeServices->ResetSystem, EfiResetShutdown, status, (UINTN)0, (CHAR16*)nullptr);
+}
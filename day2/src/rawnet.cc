@@ -0,0 +1,310 @@
+#include "rawnet.h"
+
+static constexpr UINT16 ETHERTYPE_IP = 0x0800;
+static constexpr UINT16 ETHERTYPE_ARP = 0x0806;
+static constexpr UINT8 IP_PROTO_UDP = 17;
+static constexpr UINT16 ARP_REQUEST = 1;
+static constexpr UINT16 ARP_REPLY = 2;
+
+efi::vector<EFI_SIMPLE_NETWORK*> get_snp_interfaces() {
+    return Handles(EFI_SIMPLE_NETWORK_PROTOCOL_GUID).collect_interfaces<EFI_SIMPLE_NETWORK>();
+}
+
+static bool same_ip(const EFI_IPv4_ADDRESS& a, const EFI_IPv4_ADDRESS& b) {
+    return a.Addr[0] == b.Addr[0] && a.Addr[1] == b.Addr[1] && a.Addr[2] == b.Addr[2] && a.Addr[3] == b.Addr[3];
+}
+
+static UINT16 get16(const UINT8* p) {
+    return (UINT16)((p[0] << 8) | p[1]);
+}
+
+static void put16(UINT8* p, UINT16 v) {
+    p[0] = v >> 8;
+    p[1] = v & 0xff;
+}
+
+static UINT16 ip_checksum(const UINT8* header, std::size_t length) {
+    UINT32 sum = 0;
+    for (std::size_t i=0; i < length; i += 2)
+        sum += get16(header + i);
+    while (sum >> 16)
+        sum = (sum & 0xffff) + (sum >> 16);
+    return (UINT16)~sum;
+}
+
+RawNet::~RawNet() {
+    if (snp == nullptr)
+        return;
+    flush();
+    free(tx);
+    free(tx_busy);
+    free(rx);
+}
+
+EFI_STATUS RawNet::open(EFI_SIMPLE_NETWORK* snp, const EFI_IPv4_ADDRESS& ip, const EFI_IPv4_ADDRESS& netmask, const EFI_IPv4_ADDRESS& gateway) {
+    EFI_STATUS status;
+    if (snp->Mode->State == EfiSimpleNetworkStopped) {
+        status = uefi(snp->Start, snp);
+        if (EFI_ERROR(status))
+            return status;
+    }
+    if (snp->Mode->State == EfiSimpleNetworkStarted) {
+        status = uefi(snp->Initialize, snp, (UINTN)0, (UINTN)0);
+        if (EFI_ERROR(status))
+            return status;
+    }
+    UINT32 filters = EFI_SIMPLE_NETWORK_RECEIVE_UNICAST | EFI_SIMPLE_NETWORK_RECEIVE_BROADCAST;
+    status = uefi(snp->ReceiveFilters, snp, filters, (UINT32)0, (BOOLEAN)FALSE, (UINTN)0, (EFI_MAC_ADDRESS*)nullptr);
+    if (EFI_ERROR(status))
+        return status;
+
+    tx = (Buffer*)malloc(tx_count * sizeof(Buffer));
+    tx_busy = (bool*)malloc(tx_count * sizeof(bool));
+    rx = (Buffer*)malloc(rx_count * sizeof(Buffer));
+    if (tx == nullptr || tx_busy == nullptr || rx == nullptr) {
+        free(tx);
+        free(tx_busy);
+        free(rx);
+        return EFI_OUT_OF_RESOURCES;
+    }
+    for (std::size_t i=0; i < tx_count; ++i)
+        tx_busy[i] = false;
+
+    this->snp = snp;
+    this->mac = snp->Mode->CurrentAddress;
+    this->ip = ip;
+    this->netmask = netmask;
+    this->gateway = gateway;
+    return EFI_SUCCESS;
+}
+
+const EFI_IPv4_ADDRESS& RawNet::next_hop(const EFI_IPv4_ADDRESS& dst) {
+    for (std::size_t i=0; i < 4; ++i) {
+        if ((dst.Addr[i] & netmask.Addr[i]) != (ip.Addr[i] & netmask.Addr[i]))
+            return gateway;
+    }
+    return dst;
+}
+
+RawNet::Buffer* RawNet::tx_acquire() {
+    for (std::size_t i=0; i < tx_count; ++i) {
+        std::size_t n = (tx_next + i) % tx_count;
+        if (!tx_busy[n]) {
+            tx_next = (n + 1) % tx_count;
+            tx_busy[n] = true;
+            return &tx[n];
+        }
+    }
+    return nullptr;
+}
+
+EFI_STATUS RawNet::transmit(Buffer* buffer) {
+    EFI_STATUS status = uefi(snp->Transmit, snp, (UINTN)0, (UINTN)buffer->length, (void*)buffer->frame,
+            (EFI_MAC_ADDRESS*)nullptr, (EFI_MAC_ADDRESS*)nullptr, (UINT16*)nullptr);
+    if (EFI_ERROR(status)) {
+        tx_busy[buffer - tx] = false;
+        return status;
+    }
+    tx_frames_ += 1;
+    return EFI_SUCCESS;
+}
+
+void RawNet::reclaim() {
+    while (true) {
+        UINT32 interrupts;
+        void* done = nullptr;
+        EFI_STATUS status = uefi(snp->GetStatus, snp, &interrupts, &done);
+        if (EFI_ERROR(status) || done == nullptr)
+            return;
+        Buffer* buffer = (Buffer*)done;
+        if (buffer >= tx && buffer < tx + tx_count)
+            tx_busy[buffer - tx] = false;
+    }
+}
+
+EFI_STATUS RawNet::send_arp(UINT16 op, const EFI_MAC_ADDRESS& target_mac, const EFI_IPv4_ADDRESS& target_ip) {
+    Buffer* buffer = tx_acquire();
+    if (buffer == nullptr)
+        return EFI_NOT_READY;
+    UINT8* f = buffer->frame;
+    static const UINT8 broadcast[6] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+    memcpy(f, op == ARP_REQUEST ? broadcast : target_mac.Addr, 6);
+    memcpy(f + 6, mac.Addr, 6);
+    put16(f + 12, ETHERTYPE_ARP);
+    UINT8* a = f + RAWNET_ETH_HEADER;
+    put16(a + 0, 1);
+    put16(a + 2, ETHERTYPE_IP);
+    a[4] = 6;
+    a[5] = 4;
+    put16(a + 6, op);
+    memcpy(a + 8, mac.Addr, 6);
+    memcpy(a + 14, ip.Addr, 4);
+    memcpy(a + 18, target_mac.Addr, 6);
+    memcpy(a + 24, target_ip.Addr, 4);
+    // Pad to the 60 byte Ethernet minimum.
+    memset(f + RAWNET_ETH_HEADER + 28, 0, 60 - RAWNET_ETH_HEADER - 28);
+    buffer->length = 60;
+    return transmit(buffer);
+}
+
+void RawNet::handle_arp(const UINT8* frame, std::size_t length) {
+    if (length < RAWNET_ETH_HEADER + 28)
+        return;
+    const UINT8* a = frame + RAWNET_ETH_HEADER;
+    if (get16(a) != 1 || get16(a + 2) != ETHERTYPE_IP || a[4] != 6 || a[5] != 4)
+        return;
+    EFI_MAC_ADDRESS sender_mac {};
+    EFI_IPv4_ADDRESS sender_ip;
+    EFI_IPv4_ADDRESS target_ip;
+    memcpy(sender_mac.Addr, a + 8, 6);
+    memcpy(sender_ip.Addr, a + 14, 4);
+    memcpy(target_ip.Addr, a + 24, 4);
+    if (same_ip(sender_ip, arp_ip)) {
+        arp_mac = sender_mac;
+        arp_valid = true;
+    }
+    if (get16(a + 6) == ARP_REQUEST && same_ip(target_ip, ip))
+        send_arp(ARP_REPLY, sender_mac, sender_ip);
+}
+
+bool RawNet::accept_udp(const UINT8* frame, std::size_t length) {
+    if (length < RAWNET_ETH_HEADER + RAWNET_IP_HEADER + RAWNET_UDP_HEADER)
+        return false;
+    const UINT8* h = frame + RAWNET_ETH_HEADER;
+    std::size_t ihl = (h[0] & 0x0f) * 4;
+    if ((h[0] >> 4) != 4 || ihl < RAWNET_IP_HEADER || h[9] != IP_PROTO_UDP)
+        return false;
+    // No reassembly: drop anything with MF set or a fragment offset.
+    if (get16(h + 6) & 0x3fff)
+        return false;
+    EFI_IPv4_ADDRESS dst;
+    memcpy(dst.Addr, h + 16, 4);
+    if (!same_ip(dst, ip))
+        return false;
+    std::size_t total = get16(h + 2);
+    if (total < ihl + RAWNET_UDP_HEADER || RAWNET_ETH_HEADER + total > length)
+        return false;
+    // peek() takes the payload size from the UDP length, which covers its
+    // own header.
+    std::size_t udp_length = get16(h + ihl + 4);
+    return udp_length >= RAWNET_UDP_HEADER && udp_length <= total - ihl;
+}
+
+void RawNet::poll() {
+    reclaim();
+    while (true) {
+        if (rx_ready == rx_count) {
+            // Ring full: leave the rest in the NIC until the caller catches up.
+            rx_stalls_ += 1;
+            return;
+        }
+        Buffer* buffer = &rx[(rx_head + rx_ready) % rx_count];
+        UINTN size = RAWNET_FRAME_SIZE;
+        EFI_STATUS status = uefi(snp->Receive, snp, (UINTN*)nullptr, &size, (void*)buffer->frame,
+                (EFI_MAC_ADDRESS*)nullptr, (EFI_MAC_ADDRESS*)nullptr, (UINT16*)nullptr);
+        if (EFI_ERROR(status))
+            return;
+        rx_frames_ += 1;
+        buffer->length = size;
+        if (size < RAWNET_ETH_HEADER)
+            continue;
+        UINT16 type = get16(buffer->frame + 12);
+        if (type == ETHERTYPE_ARP)
+            handle_arp(buffer->frame, size);
+        else if (type == ETHERTYPE_IP && accept_udp(buffer->frame, size))
+            rx_ready += 1;
+    }
+}
+
+EFI_STATUS RawNet::resolve(const EFI_IPv4_ADDRESS& dst, std::size_t timeout_us) {
+    const EFI_IPv4_ADDRESS& hop = next_hop(dst);
+    if (arp_valid && same_ip(arp_ip, hop))
+        return EFI_SUCCESS;
+    arp_ip = hop;
+    arp_valid = false;
+    EFI_MAC_ADDRESS unknown {};
+    for (std::size_t waited = 0; waited < timeout_us; waited += 1000) {
+        if (waited % 100'000 == 0)
+            send_arp(ARP_REQUEST, unknown, hop);
+        poll();
+        if (arp_valid)
+            return EFI_SUCCESS;
+        sleep(1000);
+    }
+    return EFI_TIMEOUT;
+}
+
+EFI_STATUS RawNet::send_udp(const EFI_IPv4_ADDRESS& dst, UINT16 dst_port, UINT16 src_port, const void* data, std::size_t size) {
+    if (size > RAWNET_UDP_PAYLOAD)
+        return EFI_BAD_BUFFER_SIZE;
+    if (!arp_valid || !same_ip(arp_ip, next_hop(dst)))
+        return EFI_NO_MAPPING;
+    Buffer* buffer = tx_acquire();
+    if (buffer == nullptr) {
+        reclaim();
+        buffer = tx_acquire();
+        if (buffer == nullptr)
+            return EFI_NOT_READY;
+    }
+
+    UINT8* f = buffer->frame;
+    memcpy(f, arp_mac.Addr, 6);
+    memcpy(f + 6, mac.Addr, 6);
+    put16(f + 12, ETHERTYPE_IP);
+
+    UINT8* h = f + RAWNET_ETH_HEADER;
+    std::size_t total = RAWNET_IP_HEADER + RAWNET_UDP_HEADER + size;
+    h[0] = 0x45;
+    h[1] = 0;
+    put16(h + 2, total);
+    put16(h + 4, ip_id++);
+    put16(h + 6, 0x4000); // don't fragment
+    h[8] = 64;
+    h[9] = IP_PROTO_UDP;
+    put16(h + 10, 0);
+    memcpy(h + 12, ip.Addr, 4);
+    memcpy(h + 16, dst.Addr, 4);
+    put16(h + 10, ip_checksum(h, RAWNET_IP_HEADER));
+
+    UINT8* u = h + RAWNET_IP_HEADER;
+    put16(u + 0, src_port);
+    put16(u + 2, dst_port);
+    put16(u + 4, RAWNET_UDP_HEADER + size);
+    put16(u + 6, 0); // checksum is optional over IPv4
+    memcpy(u + RAWNET_UDP_HEADER, data, size);
+
+    buffer->length = RAWNET_ETH_HEADER + total;
+    if (buffer->length < 60) {
+        memset(f + buffer->length, 0, 60 - buffer->length);
+        buffer->length = 60;
+    }
+    return transmit(buffer);
+}
+
+bool RawNet::peek(RawDatagram& datagram) {
+    if (rx_ready == 0)
+        return false;
+    const UINT8* h = rx[rx_head].frame + RAWNET_ETH_HEADER;
+    std::size_t ihl = (h[0] & 0x0f) * 4;
+    const UINT8* u = h + ihl;
+    memcpy(datagram.source.Addr, h + 12, 4);
+    datagram.source_port = get16(u);
+    datagram.port = get16(u + 2);
+    datagram.data = u + RAWNET_UDP_HEADER;
+    datagram.size = get16(u + 4) - RAWNET_UDP_HEADER;
+    return true;
+}
+
+void RawNet::release() {
+    if (rx_ready == 0)
+        return;
+    rx_head = (rx_head + 1) % rx_count;
+    rx_ready -= 1;
+}
+
+void RawNet::flush() {
+    for (std::size_t i=0; i < tx_count; ++i) {
+        while (tx_busy[i])
+            reclaim();
+    }
+}
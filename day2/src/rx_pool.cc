@@ -0,0 +1,127 @@
+#include "rx_pool.h"
+
+RxPool::~RxPool() {
+    if (tcp != nullptr) {
+        uefi(tcp->Cancel, tcp, (EFI_TCP4_COMPLETION_TOKEN*)nullptr);
+        for (std::size_t i=0; i < count; ++i) {
+            if (slots[i].state == Posted)
+                wait_for(slots[i].token.CompletionToken.Event);
+        }
+    }
+    if (slots != nullptr) {
+        for (std::size_t i=0; i < count; ++i)
+            close_event(slots[i].token.CompletionToken.Event);
+    }
+    free(slots);
+    free(memory);
+    free(posted);
+    free(ready);
+}
+
+EFI_STATUS RxPool::open(EFI_TCP4* tcp) {
+    slots = (Slot*)malloc(count * sizeof(Slot));
+    memory = (char*)malloc(count * buffer_size);
+    posted = (std::size_t*)malloc(count * sizeof(std::size_t));
+    ready = (std::size_t*)malloc(count * sizeof(std::size_t));
+    if (slots == nullptr || memory == nullptr || posted == nullptr || ready == nullptr)
+        return EFI_OUT_OF_RESOURCES;
+    for (std::size_t i=0; i < count; ++i) {
+        slots[i].data = memory + i * buffer_size;
+        slots[i].state = Idle;
+        slots[i].token.CompletionToken.Event = nullptr;
+    }
+    for (std::size_t i=0; i < count; ++i) {
+        EFI_STATUS status = create_event(0, 0, nullptr, nullptr, &slots[i].token.CompletionToken.Event);
+        if (EFI_ERROR(status))
+            return status;
+    }
+    this->tcp = tcp;
+    for (std::size_t i=0; i < count; ++i) {
+        EFI_STATUS status = post(i);
+        if (EFI_ERROR(status))
+            return status;
+    }
+    return EFI_SUCCESS;
+}
+
+EFI_STATUS RxPool::post(std::size_t index) {
+    Slot& slot = slots[index];
+    slot.token.Packet.RxData = &slot.rx;
+    slot.rx.UrgentFlag = FALSE;
+    slot.rx.DataLength = buffer_size;
+    slot.rx.FragmentCount = 1;
+    slot.rx.FragmentTable[0].FragmentLength = buffer_size;
+    slot.rx.FragmentTable[0].FragmentBuffer = (void*)slot.data;
+    EFI_STATUS status = uefi(tcp->Receive, tcp, &slot.token);
+    if (EFI_ERROR(status)) {
+        slot.state = Idle;
+        status_ = check(status, "rx pool receive");
+        return status;
+    }
+    slot.state = Posted;
+    posted[(posted_head + posted_count) % count] = index;
+    posted_count += 1;
+    return EFI_SUCCESS;
+}
+
+void RxPool::complete_head() {
+    std::size_t index = posted[posted_head];
+    Slot& slot = slots[index];
+    posted_head = (posted_head + 1) % count;
+    posted_count -= 1;
+    if (EFI_ERROR(slot.token.CompletionToken.Status)) {
+        // The peer closing ends the stream, it is no failure.
+        EFI_STATUS status = slot.token.CompletionToken.Status;
+        if (!EFI_ERROR(status_))
+            status_ = status == EFI_CONNECTION_FIN ? status : check(status, "rx pool completion");
+        slot.state = Idle;
+        return;
+    }
+    slot.state = Ready;
+    ready[(ready_head + ready_count) % count] = index;
+    ready_count += 1;
+}
+
+void RxPool::pump() {
+    // TCP completes receive tokens in the order they were posted.
+    while (posted_count > 0 && check_event(slots[posted[posted_head]].token.CompletionToken.Event))
+        complete_head();
+}
+
+bool RxPool::lend(RxBuffer& buffer) {
+    pump();
+    if (ready_count == 0)
+        return false;
+    std::size_t index = ready[ready_head];
+    ready_head = (ready_head + 1) % count;
+    ready_count -= 1;
+    Slot& slot = slots[index];
+    slot.state = Lent;
+    buffer = { slot.data, slot.rx.DataLength, index };
+    lent_ += 1;
+    bytes_ += slot.rx.DataLength;
+    return true;
+}
+
+bool RxPool::wait(RxBuffer& buffer, std::size_t spin_budget) {
+    while (!lend(buffer)) {
+        if (posted_count == 0)
+            return false;
+        EFI_STATUS status = await_completion(tcp, slots[posted[posted_head]].token.CompletionToken.Event, spin_budget);
+        if (EFI_ERROR(status)) {
+            status_ = check(status, "rx pool wait");
+            return false;
+        }
+        // Waiting consumed the signal, so take the completion here.
+        complete_head();
+    }
+    return true;
+}
+
+void RxPool::release(std::size_t id) {
+    if (id >= count || slots[id].state != Lent)
+        return;
+    slots[id].state = Idle;
+    if (!EFI_ERROR(status_))
+        post(id);
+}
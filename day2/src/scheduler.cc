@@ -0,0 +1,188 @@
+#include "scheduler.h"
+#include "clock.h"
+#include "sync.h"
+#include "trace.h"
+
+bool TaskHeap::push(Task* task) {
+    if (size_ == items.size())
+        return false;
+    std::size_t i = size_++;
+    while (i > 0) {
+        std::size_t parent = (i - 1) / 2;
+        if (!before(task, items[parent]))
+            break;
+        items[i] = items[parent];
+        i = parent;
+    }
+    items[i] = task;
+    return true;
+}
+
+Task* TaskHeap::pop() {
+    if (size_ == 0)
+        return nullptr;
+    Task* top = items[0];
+    Task* last = items[--size_];
+    std::size_t i = 0;
+    while (true) {
+        std::size_t child = 2 * i + 1;
+        if (child >= size_)
+            break;
+        if (child + 1 < size_ && before(items[child + 1], items[child]))
+            child += 1;
+        if (!before(items[child], last))
+            break;
+        items[i] = items[child];
+        i = child;
+    }
+    items[i] = last;
+    return top;
+}
+
+bool Scheduler::released_before(const Task* a, const Task* b) {
+    return a->release < b->release;
+}
+
+bool Scheduler::runs_before(const Task* a, const Task* b) {
+    if (a->priority_ != b->priority_)
+        return a->priority_ < b->priority_;
+    return a->release + a->deadline_us_ < b->release + b->deadline_us_;
+}
+
+Scheduler::Scheduler(std::size_t capacity)
+    : tasks(capacity), timers(capacity, released_before), ready(capacity, runs_before) {}
+
+Scheduler::~Scheduler() {
+    stop();
+    close_event(stopped);
+}
+
+bool Scheduler::add(Task& task, UINT64 delay_us) {
+    if (task.queued)
+        return false;
+    // Keep the tick out while the heap is half updated.
+    TplGuard guard(TPL_CALLBACK);
+    std::size_t i = 0;
+    while (i < task_count_ && tasks[i] != &task)
+        ++i;
+    if (i == tasks.size())
+        return false;
+    // One-shot tasks come back through here, they are listed once.
+    if (i == task_count_)
+        tasks[task_count_++] = &task;
+    task.release = (tick ? now_us() : 0) + delay_us;
+    task.queued = true;
+    timers.push(&task);
+    return true;
+}
+
+UINT64 Scheduler::now_us() {
+    return cycles_to_us(rdtsc() - start_tsc);
+}
+
+UINT64 Scheduler::elapsed_cycles() {
+    return start_tsc ? rdtsc() - start_tsc : 0;
+}
+
+UINT64 Scheduler::share_permille(Task& task) {
+    UINT64 elapsed = elapsed_cycles();
+    return elapsed ? task.cycles_ * 1000 / elapsed : 0;
+}
+
+EFI_STATUS Scheduler::start(UINT64 tick_us) {
+    if (tick)
+        return EFI_ALREADY_STARTED;
+    EFI_STATUS status = EFI_SUCCESS;
+    if (stopped == nullptr) {
+        status = create_event(0, 0, nullptr, nullptr, &stopped);
+        if (EFI_ERROR(status))
+            return status;
+    }
+    status = create_notify_event(EVT_TIMER | EVT_NOTIFY_SIGNAL, TPL_CALLBACK, on_tick, this, &tick);
+    if (EFI_ERROR(status)) {
+        tick = nullptr;
+        return status;
+    }
+
+    EFI_GUID guid = EFI_TIMER_ARCH_PROTOCOL_GUID;
+    UINT64 period = tick_us * 10;
+    if (!EFI_ERROR(uefi(bs->LocateProtocol, &guid, (void*)nullptr, (void**)&timer_arch))
+            && !EFI_ERROR(uefi(timer_arch->GetTimerPeriod, timer_arch, &saved_period))
+            && period < saved_period) {
+        if (EFI_ERROR(uefi(timer_arch->SetTimerPeriod, timer_arch, period)))
+            saved_period = 0;
+    } else {
+        saved_period = 0;
+    }
+
+    // Releases are relative to start, tasks added before it begin at 0.
+    start_tsc = rdtsc();
+    busy_cycles_ = 0;
+    status = set_timer(tick, TimerPeriodic, period);
+    if (EFI_ERROR(status))
+        stop();
+    return status;
+}
+
+void Scheduler::run() {
+    if (tick)
+        wait_for(stopped);
+}
+
+void Scheduler::stop() {
+    if (tick == nullptr)
+        return;
+    set_timer(tick, TimerCancel, 0);
+    close_event(tick);
+    tick = nullptr;
+    if (saved_period)
+        uefi(timer_arch->SetTimerPeriod, timer_arch, saved_period);
+    saved_period = 0;
+    uefi(bs->SignalEvent, stopped);
+}
+
+void MSABI Scheduler::on_tick(EFI_EVENT, void* ctx) {
+    ((Scheduler*)ctx)->dispatch();
+}
+
+void Scheduler::schedule(Task& task, UINT64 now) {
+    if (task.period_us_ == 0) {
+        task.queued = false;
+        return;
+    }
+    task.release += task.period_us_;
+    if (task.release < now)
+        task.release += ((now - task.release) / task.period_us_ + 1) * task.period_us_;
+    timers.push(&task);
+}
+
+void Scheduler::dispatch() {
+    dispatches_ += 1;
+    UINT64 now = now_us();
+    while (true) {
+        while (!timers.empty() && timers.top()->release <= now)
+            ready.push(timers.pop());
+        Task* task = ready.pop();
+        if (task == nullptr)
+            return;
+
+        UINT64 begin = rdtsc();
+        {
+            TRACE_SCOPE(task->name());
+            task->run();
+        }
+        UINT64 spent = rdtsc() - begin;
+        task->runs_ += 1;
+        task->cycles_ += spent;
+        if (spent > task->max_cycles_)
+            task->max_cycles_ = spent;
+        busy_cycles_ += spent;
+
+        now = now_us();
+        if (now > task->release + task->deadline_us_)
+            task->misses_ += 1;
+        if (tick == nullptr)
+            return;
+        schedule(*task, now);
+    }
+}
@@ -0,0 +1,253 @@
+#include "socket.h"
+
+// A fresh IPv6 address is unusable until duplicate address detection is
+// done, Configure reports EFI_NO_MAPPING until then.
+template<typename Fn>
+static EFI_STATUS retry_unmapped(Fn configure) {
+    EFI_STATUS status = configure();
+    for (std::size_t i=0; status == EFI_NO_MAPPING && i < 30; ++i) {
+        sleep(100'000);
+        status = configure();
+    }
+    return status;
+}
+
+static EFI_STATUS create_child(const efi::vector<EFI_SERVICE_BINDING*>& services, EFI_SERVICE_BINDING*& service, EFI_HANDLE& handle) {
+    if (services.empty())
+        return EFI_UNSUPPORTED;
+    service = services[0];
+    handle = nullptr;
+    return uefi(service->CreateChild, service, &handle);
+}
+
+EFI_STATUS StreamSocket::open(const SocketAddress& remote, TcpConfig& config) {
+    close();
+    EFI_SERVICE_BINDING* service;
+    EFI_HANDLE handle;
+    EFI_STATUS status = create_child(remote.family == SocketIPv4 ? get_tcp4_services() : get_tcp6_services(), service, handle);
+    if (EFI_ERROR(status))
+        return status;
+
+    EFI_TCP4* tcp4 = nullptr;
+    EFI_TCP6* tcp6 = nullptr;
+    if (remote.family == SocketIPv4) {
+        EFI_GUID guid = EFI_TCP4_PROTOCOL;
+        status = handle_protocol(handle, &guid, tcp4);
+        if (!EFI_ERROR(status)) {
+            config.remote({ remote.v4, remote.port });
+            status = retry_unmapped([&] { return socket_config(tcp4, config.get()); });
+        }
+        if (!EFI_ERROR(status))
+            status = connect(tcp4);
+    } else {
+        EFI_GUID guid = EFI_TCP6_PROTOCOL;
+        status = handle_protocol(handle, &guid, tcp6);
+        if (!EFI_ERROR(status)) {
+            EFI_TCP6_CONFIG_DATA data;
+            EFI_TCP6_OPTION option;
+            config.to_tcp6(data, option);
+            data.AccessPoint.RemoteAddress = remote.v6;
+            data.AccessPoint.RemotePort = remote.port;
+            status = retry_unmapped([&] { return socket_config(tcp6, data); });
+        }
+        if (!EFI_ERROR(status))
+            status = connect(tcp6);
+    }
+    if (EFI_ERROR(status)) {
+        uefi(service->DestroyChild, service, handle);
+        return status;
+    }
+    this->family_ = remote.family;
+    this->service = service;
+    this->handle = handle;
+    this->tcp4 = tcp4;
+    this->tcp6 = tcp6;
+    return EFI_SUCCESS;
+}
+
+void StreamSocket::close() {
+    if (tcp4) {
+        ::close(tcp4);
+        uefi(tcp4->Configure, tcp4, (EFI_TCP4_CONFIG_DATA*)nullptr);
+    } else if (tcp6) {
+        ::close(tcp6);
+        uefi(tcp6->Configure, tcp6, (EFI_TCP6_CONFIG_DATA*)nullptr);
+    } else {
+        return;
+    }
+    uefi(service->DestroyChild, service, handle);
+    tcp4 = nullptr;
+    tcp6 = nullptr;
+    handle = nullptr;
+}
+
+Result<std::size_t> StreamSocket::send(char* buffer, std::size_t n) {
+    return tcp4 ? ::send(tcp4, buffer, n, spin_budget) : ::send(tcp6, buffer, n, spin_budget);
+}
+
+Result<std::size_t> StreamSocket::recv(char* buffer, std::size_t n) {
+    return tcp4 ? ::recv(tcp4, buffer, n, spin_budget) : ::recv(tcp6, buffer, n, spin_budget);
+}
+
+bool StreamSocket::send_all(const void* buffer, std::size_t n) {
+    char* ptr = (char*)buffer;
+    while (n) {
+        auto sent = send(ptr, n);
+        if (EFI_ERROR(check(sent.status(), "stream send")) || *sent == 0)
+            return false;
+        ptr += *sent;
+        n -= *sent;
+    }
+    return true;
+}
+
+bool StreamSocket::recv_all(void* buffer, std::size_t n) {
+    char* ptr = (char*)buffer;
+    while (n) {
+        auto got = recv(ptr, n);
+        if (EFI_ERROR(check(got.status(), "stream recv")) || *got == 0)
+            return false;
+        ptr += *got;
+        n -= *got;
+    }
+    return true;
+}
+
+template<typename Udp> struct UdpTypes;
+
+template<> struct UdpTypes<EFI_UDP4> {
+    typedef EFI_UDP4_COMPLETION_TOKEN Token;
+    typedef EFI_UDP4_TRANSMIT_DATA TxData;
+    typedef EFI_UDP4_RECEIVE_DATA RxData;
+};
+
+template<> struct UdpTypes<EFI_UDP6> {
+    typedef EFI_UDP6_COMPLETION_TOKEN Token;
+    typedef EFI_UDP6_TRANSMIT_DATA TxData;
+    typedef EFI_UDP6_RECEIVE_DATA RxData;
+};
+
+template<typename Udp>
+static bool udp_send(Udp* udp, const void* data, std::size_t size) {
+    typename UdpTypes<Udp>::Token token {};
+    typename UdpTypes<Udp>::TxData tx {};
+    if (EFI_ERROR(create_event(0, 0, nullptr, nullptr, &token.Event)))
+        return false;
+    token.Packet.TxData = &tx;
+    tx.DataLength = size;
+    tx.FragmentCount = 1;
+    tx.FragmentTable[0].FragmentLength = size;
+    tx.FragmentTable[0].FragmentBuffer = (void*)data;
+    EFI_STATUS status = uefi(udp->Transmit, udp, &token);
+    if (!EFI_ERROR(status))
+        status = wait_for(token.Event);
+    close_event(token.Event);
+    return !EFI_ERROR(status) && !EFI_ERROR(token.Status);
+}
+
+template<typename Udp>
+static std::size_t udp_recv(Udp* udp, void* buffer, std::size_t n, std::size_t timeout_us) {
+    typename UdpTypes<Udp>::Token token {};
+    EFI_EVENT events[2];
+    if (EFI_ERROR(create_event(0, 0, nullptr, nullptr, &token.Event)))
+        return 0;
+    if (EFI_ERROR(create_event(EVT_TIMER, 0, nullptr, nullptr, &events[1]))) {
+        close_event(token.Event);
+        return 0;
+    }
+    events[0] = token.Event;
+    std::size_t copied = 0;
+    if (!EFI_ERROR(uefi(udp->Receive, udp, &token))) {
+        set_timer(events[1], TimerRelative, timeout_us * 10);
+        UINTN index = 0;
+        uefi(bs->WaitForEvent, 2UL, events, &index);
+        if (index == 1) {
+            uefi(udp->Cancel, udp, &token);
+            wait_for(token.Event);
+        }
+        if (!EFI_ERROR(token.Status) && token.Packet.RxData != nullptr) {
+            typename UdpTypes<Udp>::RxData* rx = token.Packet.RxData;
+            for (UINT32 i=0; i < rx->FragmentCount && copied < n; ++i) {
+                std::size_t chunk = rx->FragmentTable[i].FragmentLength;
+                if (chunk > n - copied)
+                    chunk = n - copied;
+                memcpy((char*)buffer + copied, rx->FragmentTable[i].FragmentBuffer, chunk);
+                copied += chunk;
+            }
+            uefi(bs->SignalEvent, rx->RecycleSignal);
+        }
+    }
+    close_event(events[1]);
+    close_event(token.Event);
+    return copied;
+}
+
+EFI_STATUS DatagramSocket::open(const SocketAddress& remote, UINT16 local_port) {
+    close();
+    EFI_SERVICE_BINDING* service;
+    EFI_HANDLE handle;
+    EFI_STATUS status = create_child(remote.family == SocketIPv4 ? get_udp4_services() : get_udp6_services(), service, handle);
+    if (EFI_ERROR(status))
+        return status;
+
+    EFI_UDP4* udp4 = nullptr;
+    EFI_UDP6* udp6 = nullptr;
+    if (remote.family == SocketIPv4) {
+        EFI_GUID guid = EFI_UDP4_PROTOCOL;
+        status = handle_protocol(handle, &guid, udp4);
+        if (!EFI_ERROR(status)) {
+            EFI_UDP4_CONFIG_DATA config {};
+            config.TimeToLive = 64;
+            config.UseDefaultAddress = TRUE;
+            config.StationPort = local_port;
+            config.RemoteAddress = remote.v4;
+            config.RemotePort = remote.port;
+            status = retry_unmapped([&] { return uefi(udp4->Configure, udp4, &config); });
+        }
+    } else {
+        EFI_GUID guid = EFI_UDP6_PROTOCOL;
+        status = handle_protocol(handle, &guid, udp6);
+        if (!EFI_ERROR(status)) {
+            EFI_UDP6_CONFIG_DATA config {};
+            config.HopLimit = 64;
+            config.StationPort = local_port;
+            config.RemoteAddress = remote.v6;
+            config.RemotePort = remote.port;
+            status = retry_unmapped([&] { return uefi(udp6->Configure, udp6, &config); });
+        }
+    }
+    if (EFI_ERROR(status)) {
+        uefi(service->DestroyChild, service, handle);
+        return status;
+    }
+    this->family_ = remote.family;
+    this->service = service;
+    this->handle = handle;
+    this->udp4 = udp4;
+    this->udp6 = udp6;
+    return EFI_SUCCESS;
+}
+
+void DatagramSocket::close() {
+    if (udp4) {
+        uefi(udp4->Cancel, udp4, (EFI_UDP4_COMPLETION_TOKEN*)nullptr);
+        uefi(udp4->Configure, udp4, (EFI_UDP4_CONFIG_DATA*)nullptr);
+    } else if (udp6) {
+        uefi(udp6->Cancel, udp6, (EFI_UDP6_COMPLETION_TOKEN*)nullptr);
+        uefi(udp6->Configure, udp6, (EFI_UDP6_CONFIG_DATA*)nullptr);
+    } else {
+        return;
+    }
+    uefi(service->DestroyChild, service, handle);
+    udp4 = nullptr;
+    udp6 = nullptr;
+    handle = nullptr;
+}
+
+bool DatagramSocket::send(const void* data, std::size_t size) {
+    return udp4 ? udp_send(udp4, data, size) : udp_send(udp6, data, size);
+}
+
+std::size_t DatagramSocket::recv(void* buffer, std::size_t n, std::size_t timeout_us) {
+    return udp4 ? udp_recv(udp4, buffer, n, timeout_us) : udp_recv(udp6, buffer, n, timeout_us);
+}
@@ -0,0 +1,72 @@
+#include "status.h"
+#include "log.h"
+
+static ErrorSite sites[MAX_ERROR_SITES];
+static std::atomic<std::size_t> sites_used {0};
+static std::atomic<UINT64> overflowed {0};
+
+static bool same_file(const char* a, const char* b) {
+    if (a == b)
+        return true;
+    while (*a && *a == *b) {
+        ++a;
+        ++b;
+    }
+    return *a == *b;
+}
+
+static const char* base_name(const char* path) {
+    const char* name = path;
+    for (const char* p = path; *p; ++p) {
+        if (*p == '/' || *p == '\\')
+            name = p + 1;
+    }
+    return name;
+}
+
+// Two CPUs failing at a new line at the same moment may both add it, the
+// counts then split over two rows.
+static ErrorSite* find_site(const std::source_location& where, const char* what) {
+    std::size_t used = sites_used.load(std::memory_order_acquire);
+    if (used > MAX_ERROR_SITES)
+        used = MAX_ERROR_SITES;
+    for (std::size_t i = 0; i < used; ++i) {
+        const char* file = sites[i].file.load(std::memory_order_acquire);
+        if (file && sites[i].line == where.line() && same_file(file, where.file_name()))
+            return &sites[i];
+    }
+    std::size_t i = sites_used.fetch_add(1, std::memory_order_relaxed);
+    if (i >= MAX_ERROR_SITES)
+        return nullptr;
+    sites[i].line = where.line();
+    sites[i].what = what;
+    sites[i].file.store(where.file_name(), std::memory_order_release);
+    return &sites[i];
+}
+
+EFI_STATUS report_error(EFI_STATUS status, const char* what, std::source_location where) {
+    ErrorSite* site = find_site(where, what);
+    if (site == nullptr) {
+        overflowed.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        site->last.store(status, std::memory_order_relaxed);
+        // Only a site's first failure goes to the slow firmware console.
+        if (site->count.fetch_add(1, std::memory_order_relaxed) == 0)
+            Print((CHAR16*)L"%a: %a (%a:%ld)\n", what, status_name(status), base_name(where.file_name()), (INT64)where.line());
+    }
+    log_line(LogError).put(what).put(": ").put(status_name(status));
+    return status;
+}
+
+std::size_t error_site_count() {
+    std::size_t used = sites_used.load(std::memory_order_acquire);
+    return used < MAX_ERROR_SITES ? used : MAX_ERROR_SITES;
+}
+
+ErrorSite& error_site(std::size_t i) {
+    return sites[i];
+}
+
+UINT64 error_sites_overflowed() {
+    return overflowed.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,72 @@
+#include "sync.h"
+#include "clock.h"
+
+static LockStats* lock_list = nullptr;
+
+void track_lock(LockStats& stats) {
+    for (LockStats* s = lock_list; s; s = s->next) {
+        if (s == &stats)
+            return;
+    }
+    stats.next = lock_list;
+    lock_list = &stats;
+}
+
+LockStats* tracked_locks() {
+    return lock_list;
+}
+
+TplGuard::TplGuard(EFI_TPL tpl, LockStats* stats) : stats(stats) {
+    old = uefi(bs->RaiseTPL, tpl);
+    if (stats) {
+        stats->acquisitions += 1;
+        entered = rdtsc();
+    }
+}
+
+TplGuard::~TplGuard() {
+    if (stats)
+        stats->held(rdtsc() - entered);
+    uefi(bs->RestoreTPL, old);
+}
+
+void TicketLock::lock() {
+    UINT32 ticket = next.fetch_add(1, std::memory_order_relaxed);
+    UINT32 now = serving.load(std::memory_order_acquire);
+    if (now != ticket) {
+        UINT64 start = stats ? rdtsc() : 0;
+        // Back off in proportion to the queue ahead, every release is a
+        // write to the line all waiters read.
+        do {
+            for (UINT32 i = ticket - now; i > 0; --i)
+                __builtin_ia32_pause();
+            now = serving.load(std::memory_order_acquire);
+        } while (now != ticket);
+        if (stats) {
+            stats->contended += 1;
+            stats->spin_cycles += rdtsc() - start;
+        }
+    }
+    if (stats) {
+        stats->acquisitions += 1;
+        acquired = rdtsc();
+    }
+}
+
+bool TicketLock::try_lock() {
+    UINT32 now = serving.load(std::memory_order_acquire);
+    UINT32 ticket = now;
+    if (!next.compare_exchange_strong(ticket, now + 1, std::memory_order_acquire, std::memory_order_relaxed))
+        return false;
+    if (stats) {
+        stats->acquisitions += 1;
+        acquired = rdtsc();
+    }
+    return true;
+}
+
+void TicketLock::unlock() {
+    if (stats)
+        stats->held(rdtsc() - acquired);
+    serving.store(serving.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
@@ -0,0 +1,285 @@
+#include "tcp_server.h"
+
+EFI_STATUS TcpClient::post_receive() {
+    rx_token.Packet.RxData = &rx;
+    rx.UrgentFlag = FALSE;
+    rx.DataLength = server->rx_size;
+    rx.FragmentCount = 1;
+    rx.FragmentTable[0].FragmentLength = server->rx_size;
+    rx.FragmentTable[0].FragmentBuffer = (void*)rx_buffer;
+    EFI_STATUS status = uefi(tcp->Receive, tcp, &rx_token);
+    rx_pending = !EFI_ERROR(status);
+    return status;
+}
+
+EFI_STATUS TcpClient::post_transmit() {
+    Segment& segment = segments[seg_head];
+    tx_token.Packet.TxData = &tx;
+    tx.Push = TRUE;
+    tx.Urgent = FALSE;
+    tx.DataLength = segment.size;
+    tx.FragmentCount = 1;
+    tx.FragmentTable[0].FragmentLength = segment.size;
+    tx.FragmentTable[0].FragmentBuffer = (void*)segment.data;
+    EFI_STATUS status = uefi(tcp->Transmit, tcp, &tx_token);
+    tx_pending = !EFI_ERROR(status);
+    return status;
+}
+
+std::size_t TcpClient::tx_space() {
+    if (seg_count == MAX_SEGMENTS)
+        return 0;
+    return server->tx_size - arena_used;
+}
+
+bool TcpClient::send(const void* data, std::size_t n) {
+    if (!is_open() || n > server->tx_size - arena_used)
+        return false;
+    char* dst = arena + arena_used;
+    // Grow the last segment when it ends where this one starts and is not the
+    // one the driver is currently reading.
+    bool in_flight = tx_pending && seg_count == 1;
+    if (seg_count > 0 && !in_flight) {
+        Segment& last = segments[(seg_head + seg_count - 1) % MAX_SEGMENTS];
+        if (last.data + last.size == dst) {
+            memcpy(dst, data, n);
+            arena_used += n;
+            last.size += n;
+            return true;
+        }
+    }
+    if (seg_count == MAX_SEGMENTS)
+        return false;
+    memcpy(dst, data, n);
+    arena_used += n;
+    segments[(seg_head + seg_count) % MAX_SEGMENTS] = { dst, n };
+    seg_count += 1;
+    return true;
+}
+
+bool TcpClient::send_ref(const void* data, std::size_t n) {
+    if (!is_open() || seg_count == MAX_SEGMENTS)
+        return false;
+    segments[(seg_head + seg_count) % MAX_SEGMENTS] = { (const char*)data, n };
+    seg_count += 1;
+    return true;
+}
+
+EFI_STATUS TcpServer::open(EFI_SERVICE_BINDING* service, TcpConfig& config) {
+    EFI_HANDLE handle = nullptr;
+    EFI_STATUS status = uefi(service->CreateChild, service, &handle);
+    if (EFI_ERROR(status))
+        return status;
+    EFI_GUID guid = EFI_TCP4_PROTOCOL;
+    EFI_TCP4* tcp;
+    status = handle_protocol(handle, &guid, tcp);
+    if (!EFI_ERROR(status))
+        status = socket_config(tcp, config.get());
+    if (EFI_ERROR(status)) {
+        uefi(service->DestroyChild, service, handle);
+        return status;
+    }
+    this->service = service;
+    this->handle = handle;
+    this->tcp = tcp;
+
+    for (auto& slot : listeners) {
+        slot.pending = false;
+        status = create_event(0, 0, nullptr, nullptr, &slot.token.CompletionToken.Event);
+        if (EFI_ERROR(status)) {
+            shutdown();
+            return status;
+        }
+    }
+    for (std::size_t i=0; i < clients.size(); ++i) {
+        TcpClient& client = clients[i];
+        client.server = this;
+        client.id_ = i;
+        client.rx_buffer = (char*)malloc(rx_size);
+        client.arena = (char*)malloc(tx_size);
+        if (client.rx_buffer == nullptr || client.arena == nullptr) {
+            shutdown();
+            return EFI_OUT_OF_RESOURCES;
+        }
+        status = create_event(0, 0, nullptr, nullptr, &client.rx_token.CompletionToken.Event);
+        if (!EFI_ERROR(status))
+            status = create_event(0, 0, nullptr, nullptr, &client.tx_token.CompletionToken.Event);
+        if (!EFI_ERROR(status))
+            status = create_event(0, 0, nullptr, nullptr, &client.close_token.CompletionToken.Event);
+        if (EFI_ERROR(status)) {
+            shutdown();
+            return status;
+        }
+    }
+    for (auto& slot : listeners) {
+        status = post_accept(slot);
+        if (EFI_ERROR(status)) {
+            shutdown();
+            return status;
+        }
+    }
+    return EFI_SUCCESS;
+}
+
+EFI_STATUS TcpServer::post_accept(ListenSlot& slot) {
+    slot.token.NewChildHandle = nullptr;
+    EFI_STATUS status = uefi(tcp->Accept, tcp, &slot.token);
+    slot.pending = !EFI_ERROR(status);
+    return status;
+}
+
+void TcpServer::accept(EFI_HANDLE child) {
+    TcpClient* client = nullptr;
+    for (auto& c : clients) {
+        if (c.state == TcpClient::Free) {
+            client = &c;
+            break;
+        }
+    }
+    EFI_GUID guid = EFI_TCP4_PROTOCOL;
+    EFI_TCP4* tcp;
+    if (client == nullptr || EFI_ERROR(handle_protocol(child, &guid, tcp))) {
+        // Destroying the child resets the connection.
+        rejected_ += 1;
+        uefi(service->DestroyChild, service, child);
+        return;
+    }
+    client->state = TcpClient::Open;
+    client->handle = child;
+    client->tcp = tcp;
+    client->close_requested = false;
+    client->arena_used = 0;
+    client->seg_head = 0;
+    client->seg_count = 0;
+    client->context_ = nullptr;
+    accepted_ += 1;
+    active_ += 1;
+    handler.on_accept(*client);
+}
+
+void TcpServer::service_client(TcpClient& client) {
+    if (client.state == TcpClient::Closing) {
+        if (check_event(client.close_token.CompletionToken.Event))
+            release(client);
+        return;
+    }
+
+    if (client.rx_pending && check_event(client.rx_token.CompletionToken.Event)) {
+        client.rx_pending = false;
+        EFI_STATUS status = client.rx_token.CompletionToken.Status;
+        if (status == EFI_CONNECTION_FIN) {
+            // Peer is done sending, finish what is queued and close.
+            client.close_requested = true;
+        } else if (EFI_ERROR(status)) {
+            begin_close(client, true);
+            return;
+        } else {
+            bytes_in_ += client.rx.DataLength;
+            handler.on_data(client, client.rx_buffer, client.rx.DataLength);
+        }
+    }
+
+    if (client.tx_pending && check_event(client.tx_token.CompletionToken.Event)) {
+        client.tx_pending = false;
+        if (EFI_ERROR(client.tx_token.CompletionToken.Status)) {
+            begin_close(client, true);
+            return;
+        }
+        bytes_out_ += client.tx.DataLength;
+        client.seg_head = (client.seg_head + 1) % TcpClient::MAX_SEGMENTS;
+        client.seg_count -= 1;
+        if (client.seg_count == 0)
+            client.arena_used = 0;
+        handler.on_sent(client);
+    }
+
+    if (!client.tx_pending && client.seg_count > 0 && EFI_ERROR(client.post_transmit())) {
+        begin_close(client, true);
+        return;
+    }
+    if (client.close_requested) {
+        if (client.tx_idle())
+            begin_close(client, false);
+        return;
+    }
+    if (!client.rx_pending && EFI_ERROR(client.post_receive()))
+        begin_close(client, true);
+}
+
+void TcpServer::begin_close(TcpClient& client, bool abort) {
+    client.close_token.AbortOnClose = abort ? TRUE : FALSE;
+    EFI_STATUS status = uefi(client.tcp->Close, client.tcp, &client.close_token);
+    if (EFI_ERROR(status)) {
+        release(client);
+        return;
+    }
+    client.state = TcpClient::Closing;
+}
+
+void TcpServer::release(TcpClient& client) {
+    handler.on_close(client);
+    // Close flushes outstanding tokens; clear their signals before the slot is reused.
+    check_event(client.rx_token.CompletionToken.Event);
+    check_event(client.tx_token.CompletionToken.Event);
+    client.rx_pending = false;
+    client.tx_pending = false;
+    uefi(service->DestroyChild, service, client.handle);
+    client.state = TcpClient::Free;
+    client.handle = nullptr;
+    client.tcp = nullptr;
+    client.context_ = nullptr;
+    active_ -= 1;
+}
+
+void TcpServer::poll() {
+    if (tcp == nullptr)
+        return;
+    uefi(tcp->Poll, tcp);
+    for (auto& slot : listeners) {
+        if (slot.pending) {
+            if (!check_event(slot.token.CompletionToken.Event))
+                continue;
+            slot.pending = false;
+            if (!EFI_ERROR(slot.token.CompletionToken.Status))
+                accept(slot.token.NewChildHandle);
+        }
+        // A failed post is retried on the next poll.
+        post_accept(slot);
+    }
+    for (auto& client : clients) {
+        if (client.state != TcpClient::Free)
+            service_client(client);
+    }
+}
+
+void TcpServer::shutdown() {
+    for (auto& client : clients) {
+        if (client.state != TcpClient::Free) {
+            uefi(client.tcp->Cancel, client.tcp, (EFI_TCP4_COMPLETION_TOKEN*)nullptr);
+            uefi(service->DestroyChild, service, client.handle);
+            client.state = TcpClient::Free;
+        }
+        close_event(client.rx_token.CompletionToken.Event);
+        close_event(client.tx_token.CompletionToken.Event);
+        close_event(client.close_token.CompletionToken.Event);
+        free(client.rx_buffer);
+        free(client.arena);
+        client.rx_token.CompletionToken.Event = nullptr;
+        client.tx_token.CompletionToken.Event = nullptr;
+        client.close_token.CompletionToken.Event = nullptr;
+        client.rx_buffer = nullptr;
+        client.arena = nullptr;
+    }
+    if (tcp != nullptr) {
+        uefi(tcp->Cancel, tcp, (EFI_TCP4_COMPLETION_TOKEN*)nullptr);
+        uefi(tcp->Configure, tcp, (EFI_TCP4_CONFIG_DATA*)nullptr);
+        uefi(service->DestroyChild, service, handle);
+        tcp = nullptr;
+    }
+    for (auto& slot : listeners) {
+        close_event(slot.token.CompletionToken.Event);
+        slot.token.CompletionToken.Event = nullptr;
+        slot.pending = false;
+    }
+    active_ = 0;
+}
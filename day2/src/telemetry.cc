@@ -0,0 +1,15 @@
+#include "telemetry.h"
+
+void Telemetry::flush() {
+    if (packet.header.count == 0)
+        return;
+    packet.header.magic = TELEMETRY_MAGIC;
+    packet.header.sequence = sequence++;
+    packet.header.record_size = sizeof(TelemetryRecord);
+    packet.header.reserved = 0;
+    std::size_t size = sizeof(TelemetryPacketHeader) + packet.header.count * sizeof(TelemetryRecord);
+    // A full slot pool drops the packet; the receiver sees the gap in `sequence`.
+    socket.send(&packet, size);
+    socket.poll();
+    packet.header.count = 0;
+}
@@ -0,0 +1,36 @@
+#include "text.h"
+
+TextWriter& TextWriter::put(const char* text, std::size_t n) {
+    if (n > capacity - size_) {
+        overflowed_ = true;
+        n = capacity - size_;
+    }
+    memcpy(buffer + size_, text, n);
+    size_ += n;
+    return *this;
+}
+
+TextWriter& TextWriter::put(const char* text) {
+    std::size_t n = 0;
+    while (text[n])
+        ++n;
+    return put(text, n);
+}
+
+TextWriter& TextWriter::put(UINT64 value) {
+    char digits[20];
+    std::size_t n = 0;
+    do {
+        digits[sizeof(digits) - ++n] = '0' + value % 10;
+        value /= 10;
+    } while (value);
+    return put(digits + sizeof(digits) - n, n);
+}
+
+bool text_equals(const char* text, std::size_t n, const char* literal) {
+    for (std::size_t i=0; i < n; ++i) {
+        if (literal[i] != text[i])
+            return false;
+    }
+    return literal[n] == '\0';
+}
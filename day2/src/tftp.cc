@@ -0,0 +1,63 @@
+#include "tftp.h"
+
+efi::vector<EFI_PXE_BASE_CODE_PROTOCOL*> get_pxe_interfaces() {
+    return Handles(EFI_PXE_BASE_CODE_PROTOCOL_GUID).collect_interfaces<EFI_PXE_BASE_CODE_PROTOCOL>();
+}
+
+TftpClient::~TftpClient() {
+    if (started)
+        uefi(pxe->Stop, pxe);
+}
+
+EFI_STATUS TftpClient::open(EFI_PXE_BASE_CODE_PROTOCOL* pxe, const EFI_IPv4_ADDRESS& station, const EFI_IPv4_ADDRESS& netmask,
+        const EFI_IPv4_ADDRESS& server, UINTN block_size) {
+    EFI_STATUS status = EFI_SUCCESS;
+    if (!pxe->Mode->Started) {
+        status = uefi(pxe->Start, pxe, (BOOLEAN)FALSE);
+        if (EFI_ERROR(status))
+            return status;
+        started = true;
+    }
+    EFI_IP_ADDRESS ip {};
+    EFI_IP_ADDRESS mask {};
+    ip.v4 = station;
+    mask.v4 = netmask;
+    status = uefi(pxe->SetStationIp, pxe, &ip, &mask);
+    if (EFI_ERROR(status)) {
+        if (started)
+            uefi(pxe->Stop, pxe);
+        started = false;
+        return status;
+    }
+    this->pxe = pxe;
+    this->server = {};
+    this->server.v4 = server;
+    this->block_size_ = block_size;
+    return EFI_SUCCESS;
+}
+
+EFI_STATUS TftpClient::mtftp(EFI_PXE_BASE_CODE_TFTP_OPCODE op, void* buffer, UINT64& size, const char* name) {
+    EFI_STATUS status = uefi(pxe->Mtftp, pxe, op, buffer, (BOOLEAN)FALSE, &size, &block_size_, &server,
+            (UINT8*)name, (EFI_PXE_BASE_CODE_MTFTP_INFO*)nullptr, (BOOLEAN)FALSE);
+    // Servers that do not know blksize answer with an error packet; retry plain.
+    if (status == EFI_TFTP_ERROR && block_size_ != 512) {
+        block_size_ = 512;
+        status = uefi(pxe->Mtftp, pxe, op, buffer, (BOOLEAN)FALSE, &size, (UINTN*)nullptr, &server,
+                (UINT8*)name, (EFI_PXE_BASE_CODE_MTFTP_INFO*)nullptr, (BOOLEAN)FALSE);
+    }
+    return status;
+}
+
+EFI_STATUS TftpClient::size(const char* name, UINT64& size) {
+    size = 0;
+    return mtftp(EFI_PXE_BASE_CODE_TFTP_GET_FILE_SIZE, nullptr, size, name);
+}
+
+EFI_STATUS TftpClient::read(const char* name, void* buffer, UINT64& size) {
+    EFI_STATUS status = mtftp(EFI_PXE_BASE_CODE_TFTP_READ_FILE, buffer, size, name);
+    if (!EFI_ERROR(status)) {
+        files_ += 1;
+        bytes_ += size;
+    }
+    return status;
+}
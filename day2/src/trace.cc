@@ -0,0 +1,138 @@
+#include <cpuid.h>
+
+#include "trace.h"
+#include "fs.h"
+#include "metrics.h"
+#include "text.h"
+
+TraceState trace_state;
+
+// Longest line trace_write_json() emits, names included.
+static constexpr std::size_t MAX_EVENT_JSON = 192;
+
+#ifdef TRACE_ENABLED
+static constexpr UINT32 MSR_TSC_AUX = 0xC0000103;
+
+static bool has_rdtscp() {
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(0x80000001, &eax, &ebx, &ecx, &edx))
+        return false;
+    return edx & (1u << 27);
+}
+
+static void write_tsc_aux(UINT32 cpu) {
+    asm volatile("wrmsr" : : "c"(MSR_TSC_AUX), "a"(cpu), "d"(0));
+}
+#endif
+
+EFI_STATUS trace_init(std::size_t cpus, std::size_t events_per_cpu) {
+#ifndef TRACE_ENABLED
+    (void)cpus;
+    (void)events_per_cpu;
+    return EFI_UNSUPPORTED;
+#else
+    std::size_t size = 1;
+    while (size < events_per_cpu)
+        size <<= 1;
+    if (cpus > MAX_TRACE_CPUS)
+        cpus = MAX_TRACE_CPUS;
+    for (std::size_t i = 0; i < cpus; ++i) {
+        TraceRing& ring = trace_state.rings[i];
+        if (ring.events)
+            continue;
+        TraceEvent* events = (TraceEvent*)malloc(size * sizeof(TraceEvent));
+        if (events == nullptr)
+            return i == 0 ? EFI_OUT_OF_RESOURCES : EFI_SUCCESS;
+        // The reader skips slots with no name, which on the first lap are
+        // the ones claimed but not written yet.
+        memset((void*)events, 0, size * sizeof(TraceEvent));
+        // APs may already be recording, they skip a ring until `events` is set.
+        ring.mask = size - 1;
+        ring.head.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        ring.events = events;
+    }
+    // Without rdtscp every CPU records into ring 0, still safe but with the
+    // CPUs mixed up on one timeline row.
+    trace_state.rdtscp = has_rdtscp();
+    trace_register_cpu(0);
+    trace_set_enabled(true);
+    return EFI_SUCCESS;
+#endif
+}
+
+void trace_register_cpu(UINT32 cpu) {
+#ifdef TRACE_ENABLED
+    if (has_rdtscp())
+        write_tsc_aux(cpu);
+#else
+    (void)cpu;
+#endif
+}
+
+void trace_set_enabled(bool enabled) {
+    trace_state.enabled.store(enabled && trace_state.rings[0].events, std::memory_order_relaxed);
+}
+
+std::size_t trace_json_bound() {
+    std::size_t events = 0;
+    for (TraceRing& ring : trace_state.rings) {
+        if (ring.events)
+            events += ring.mask + 1;
+    }
+    return (events + MAX_TRACE_CPUS) * MAX_EVENT_JSON + 64;
+}
+
+std::size_t trace_write_json(StreamSink sink, void* ctx) {
+    bool was_enabled = trace_enabled();
+    trace_set_enabled(false);
+
+    SinkWriter json(sink, ctx);
+    json.reserve(MAX_EVENT_JSON).put("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    bool first = true;
+    std::size_t written = 0;
+    UINT64 base = clock_calibration.base_tsc;
+    for (std::size_t cpu = 0; cpu < MAX_TRACE_CPUS && !json.failed(); ++cpu) {
+        TraceRing& ring = trace_state.rings[cpu];
+        if (ring.events == nullptr)
+            continue;
+        UINT64 head = ring.head.load(std::memory_order_acquire);
+        UINT64 size = ring.mask + 1;
+        UINT64 start = head > size ? head - size : 0;
+        if (start == head)
+            continue;
+
+        TextWriter& meta = json.reserve(MAX_EVENT_JSON);
+        meta.put(first ? "" : ",\n");
+        meta.put("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":").put((UINT64)cpu);
+        meta.put(",\"args\":{\"name\":\"").put(cpu == 0 ? "BSP" : "AP ");
+        if (cpu)
+            meta.put((UINT64)cpu);
+        meta.put("\"}}");
+        first = false;
+
+        for (UINT64 i = start; i < head && !json.failed(); ++i) {
+            TraceEvent event = ring.events[i & ring.mask];
+            if (event.name == nullptr || event.begin < base || event.end < event.begin)
+                continue;
+            // Names come from TRACE_SCOPE literals and are not escaped.
+            TextWriter& out = json.reserve(MAX_EVENT_JSON);
+            out.put(",\n{\"name\":\"").put(event.name).put("\",\"ph\":\"X\",\"pid\":0,\"tid\":").put((UINT64)cpu);
+            out.put(",\"ts\":");
+            write_scaled(out, cycles_to_ns(event.begin - base), 1000);
+            out.put(",\"dur\":");
+            write_scaled(out, cycles_to_ns(event.end - event.begin), 1000);
+            out.put('}');
+            written += 1;
+        }
+    }
+    json.reserve(MAX_EVENT_JSON).put("\n]}\n");
+    json.flush();
+
+    trace_set_enabled(was_enabled);
+    return written;
+}
+
+EFI_STATUS trace_dump_file(EFI_FILE_PROTOCOL* root, const wchar_t* name, std::size_t* events) {
+    return fwrite_stream(root, name, trace_write_json, events);
+}
@@ -0,0 +1,133 @@
+#include "udp.h"
+
+efi::vector<EFI_SERVICE_BINDING*> get_udp4_services() {
+    return Handles(EFI_UDP4_SERVICE_BINDING_PROTOCOL).collect_interfaces<EFI_SERVICE_BINDING>();
+}
+
+efi::vector<EFI_SERVICE_BINDING*> get_udp6_services() {
+    return Handles(EFI_UDP6_SERVICE_BINDING_PROTOCOL).collect_interfaces<EFI_SERVICE_BINDING>();
+}
+
+Udp4Socket::~Udp4Socket() {
+    if (udp == nullptr)
+        return;
+    uefi(udp->Cancel, udp, (EFI_UDP4_COMPLETION_TOKEN*)nullptr);
+    for (std::size_t i=0; i < slot_count; ++i)
+        close_event(slots[i].token.Event);
+    uefi(udp->Configure, udp, (EFI_UDP4_CONFIG_DATA*)nullptr);
+    uefi(service->DestroyChild, service, handle);
+    free(slots);
+}
+
+EFI_STATUS Udp4Socket::open(EFI_SERVICE_BINDING* service, EFI_UDP4_CONFIG_DATA& config) {
+    EFI_HANDLE handle = nullptr;
+    EFI_STATUS status = uefi(service->CreateChild, service, &handle);
+    if (EFI_ERROR(status))
+        return status;
+    EFI_GUID guid = EFI_UDP4_PROTOCOL;
+    EFI_UDP4* udp;
+    status = handle_protocol(handle, &guid, udp);
+    if (EFI_ERROR(status)) {
+        uefi(service->DestroyChild, service, handle);
+        return status;
+    }
+    status = uefi(udp->Configure, udp, &config);
+    if (EFI_ERROR(status)) {
+        uefi(service->DestroyChild, service, handle);
+        return status;
+    }
+
+    slots = (TxSlot*)malloc(slot_count * sizeof(TxSlot));
+    if (slots == nullptr) {
+        uefi(service->DestroyChild, service, handle);
+        return EFI_OUT_OF_RESOURCES;
+    }
+    for (std::size_t i=0; i < slot_count; ++i) {
+        TxSlot& slot = slots[i];
+        slot.owner = this;
+        slot.busy = false;
+        slot.token.Packet.TxData = &slot.data;
+        slot.data.UdpSessionData = nullptr;
+        slot.data.GatewayAddress = nullptr;
+        slot.data.FragmentCount = 1;
+        slot.data.FragmentTable[0].FragmentBuffer = slot.payload;
+        status = create_notify_event(EVT_NOTIFY_SIGNAL, TPL_CALLBACK, tx_complete, &slot, &slot.token.Event);
+        if (EFI_ERROR(status)) {
+            for (std::size_t j=0; j < i; ++j)
+                close_event(slots[j].token.Event);
+            free(slots);
+            slots = nullptr;
+            uefi(service->DestroyChild, service, handle);
+            return status;
+        }
+    }
+    this->service = service;
+    this->handle = handle;
+    this->udp = udp;
+    return EFI_SUCCESS;
+}
+
+void MSABI Udp4Socket::tx_complete(EFI_EVENT, void* ctx) {
+    TxSlot* slot = (TxSlot*)ctx;
+    Udp4Socket* self = slot->owner;
+    if (EFI_ERROR(slot->token.Status))
+        self->errors_ += 1;
+    else
+        self->sent_ += 1;
+    self->in_flight_ -= 1;
+    slot->busy = false;
+}
+
+Udp4Socket::TxSlot* Udp4Socket::acquire() {
+    for (std::size_t i=0; i < slot_count; ++i) {
+        TxSlot* slot = &slots[(next + i) % slot_count];
+        if (!slot->busy) {
+            next = (next + i + 1) % slot_count;
+            return slot;
+        }
+    }
+    return nullptr;
+}
+
+bool Udp4Socket::send(const void* data, std::size_t size) {
+    if (udp == nullptr || size > UDP4_MAX_PAYLOAD)
+        return false;
+    TxSlot* slot = acquire();
+    if (slot == nullptr) {
+        dropped_ += 1;
+        return false;
+    }
+    memcpy(slot->payload, data, size);
+    slot->data.DataLength = size;
+    slot->data.FragmentTable[0].FragmentLength = size;
+    slot->busy = true;
+    in_flight_ += 1;
+    EFI_STATUS status = uefi(udp->Transmit, udp, &slot->token);
+    if (EFI_ERROR(status)) {
+        in_flight_ -= 1;
+        errors_ += 1;
+        slot->busy = false;
+        return false;
+    }
+    return true;
+}
+
+std::size_t Udp4Socket::send_batch(const Datagram* datagrams, std::size_t n) {
+    std::size_t queued = 0;
+    for (; queued < n; ++queued) {
+        if (!send(datagrams[queued].data, datagrams[queued].size))
+            break;
+    }
+    poll();
+    return queued;
+}
+
+void Udp4Socket::poll() {
+    if (udp)
+        uefi(udp->Poll, udp);
+}
+
+void Udp4Socket::flush() {
+    while (in_flight_ != 0)
+        poll();
+}
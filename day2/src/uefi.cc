@@ -0,0 +1,100 @@
+#include "uefi.h"
+#include "fiber.h"
+
+EFI_SYSTEM_TABLE* st;
+EFI_BOOT_SERVICES* bs;
+
+AllocStats alloc_stats;
+
+extern "C" {
+    void * malloc(std::size_t n) {
+        void* ptr = AllocatePool(n);
+        if (ptr == nullptr) {
+            alloc_stats.failures += 1;
+            return nullptr;
+        }
+        alloc_stats.allocations += 1;
+        alloc_stats.bytes_requested += n;
+        return ptr;
+    }
+
+    void free(void* ptr) {
+        if (ptr == nullptr)
+            return;
+        alloc_stats.frees += 1;
+        FreePool(ptr);
+    }
+
+    // Referenced from the vtables of abstract classes, never actually called.
+    void __cxa_pure_virtual() {
+        bp();
+    }
+}
+
+void* operator new(std::size_t n) {
+    return malloc(n);
+}
+
+void operator delete(void* ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+    free(ptr);
+}
+
+EFI_STATUS create_event(UINT32 type, EFI_TPL tpl, EFI_EVENT_NOTIFY func, void* ctx, EFI_EVENT* event) {
+    return uefi(bs->CreateEvent, type, tpl, func, ctx, event);
+}
+
+EFI_STATUS create_notify_event(UINT32 type, EFI_TPL tpl, NotifyFn func, void* ctx, EFI_EVENT* event) {
+    return create_event(type, tpl, reinterpret_cast<EFI_EVENT_NOTIFY>(func), ctx, event);
+}
+
+EFI_STATUS close_event(EFI_EVENT event) {
+    return uefi(bs->CloseEvent, event);
+}
+
+EFI_STATUS wait_for(EFI_EVENT event) {
+    // Inside a fiber only that fiber waits, the others keep running.
+    FiberRuntime* fibers = FiberRuntime::current();
+    if (fibers && fibers->in_fiber())
+        return fibers->wait(event);
+    UINTN tmp;
+    return uefi(bs->WaitForEvent, 1UL, &event, &tmp);
+}
+
+bool check_event(EFI_EVENT event) {
+    return uefi(bs->CheckEvent, event) == EFI_SUCCESS;
+}
+
+EFI_STATUS set_timer(EFI_EVENT event, EFI_TIMER_DELAY type, std::size_t time) {
+    return uefi(bs->SetTimer, event, type, time);
+}
+
+EFI_STATUS sleep(std::size_t us) {
+    FiberRuntime* fibers = FiberRuntime::current();
+    if (fibers && fibers->in_fiber())
+        return fiber_sleep(us);
+    return uefi(bs->Stall, us);
+}
+
+bool has_option(EFI_HANDLE image, const wchar_t* option) {
+    CHAR16** argv;
+    INTN argc = GetShellArgcArgv(image, &argv);
+    for (INTN i=1; i < argc; ++i) {
+        if (StrCmp(argv[i], (CHAR16*)option) == 0)
+            return true;
+    }
+    return false;
+}
+
+UINTN option_number(EFI_HANDLE image, const wchar_t* option, UINTN fallback) {
+    CHAR16** argv;
+    INTN argc = GetShellArgcArgv(image, &argv);
+    for (INTN i=1; i + 1 < argc; ++i) {
+        if (StrCmp(argv[i], (CHAR16*)option) == 0)
+            return Atoi(argv[i + 1]);
+    }
+    return fallback;
+}
@@ -0,0 +1,115 @@
+#!/usr/bin/env python3
+"""Decoder for the deferred-format binary log (inc/binlog.h).
+
+Reads a stream written by binlog_write_stream(): binlog.bin from the ESP
+(`binlog dump` on the control port), or a serial console capture such as
+run_headless.py --log output, where binlog_dump_serial() left the stream as
+"blog <hex>" lines. Prints one line per record, oldest first:
+
+    [   12.345678] I main.cc:812 frame 42: 16384 us, 41 shown
+
+    ./tools/binlog_decode.py binlog.bin
+    ./tools/binlog_decode.py --formats headless.log
+"""
+
+import argparse
+import re
+import struct
+import sys
+
+MAGIC = 0x474F4C42
+LEVELS = "DIWE"
+HEADER = struct.Struct("<IHHQQ")
+FORMAT = struct.Struct("<BBHIHH")
+EVENT = struct.Struct("<BHQ")
+SPEC = re.compile(r"%([-+ #0]*\d*(?:\.\d+)?)(hh|h|ll|l|z|j|t)?([diuxXocfeEgGp%])")
+SERIAL = re.compile(r"\bblog ([0-9a-f]+)\s*$")
+
+
+def load(path):
+    """Returns the raw stream, unpacked from "blog <hex>" lines if needed."""
+    with open(path, "rb") as f:
+        data = f.read()
+    if data[:4] == struct.pack("<I", MAGIC):
+        return data
+    # The last dump in the capture wins.
+    chunks = []
+    for line in data.decode("latin-1").splitlines():
+        if line.rstrip().endswith("blog begin"):
+            chunks = []
+        match = SERIAL.search(line)
+        if match:
+            chunks.append(match.group(1))
+    return bytes.fromhex("".join(chunks))
+
+
+def render(fmt, args):
+    """Applies a printf-style format to the raw 64-bit arguments."""
+    values = iter(args)
+
+    def convert(match):
+        flags, _, kind = match.groups()
+        if kind == "%":
+            return "%"
+        raw = next(values, 0)
+        if kind in "di":
+            return ("%" + flags + "d") % (raw - (1 << 64) if raw >> 63 else raw)
+        if kind == "u":
+            return ("%" + flags + "d") % raw
+        if kind in "feEgG":
+            return ("%" + flags + kind) % struct.unpack("<d", struct.pack("<Q", raw))[0]
+        if kind == "p":
+            return "0x%x" % raw
+        if kind == "c":
+            return chr(raw & 0xFF)
+        return ("%" + flags + kind) % raw
+
+    return SPEC.sub(convert, fmt)
+
+
+def decode(data, show_formats):
+    if len(data) < HEADER.size:
+        sys.exit("no binlog stream found")
+    magic, version, _, tsc_hz, base_tsc = HEADER.unpack_from(data)
+    if magic != MAGIC or version != 1:
+        sys.exit("not a binlog stream, or an unknown version")
+    formats = {}
+    pos = HEADER.size
+    while pos < len(data):
+        tag = data[pos:pos + 1]
+        pos += 1
+        if tag == b"D":
+            level, nargs, fid, line, flen, filelen = FORMAT.unpack_from(data, pos)
+            pos += FORMAT.size
+            fmt = data[pos:pos + flen].decode("latin-1")
+            path = data[pos + flen:pos + flen + filelen].decode("latin-1")
+            pos += flen + filelen
+            formats[fid] = (level, fmt, "%s:%d" % (path.rsplit("/", 1)[-1], line))
+            if show_formats:
+                print("format %d: %s %s %r" % (fid, LEVELS[level & 3], formats[fid][2], fmt))
+        elif tag == b"E":
+            nargs, fid, tsc = EVENT.unpack_from(data, pos)
+            pos += EVENT.size
+            args = struct.unpack_from("<%dQ" % nargs, data, pos)
+            pos += 8 * nargs
+            level, fmt, where = formats.get(fid, (0, "<format %d>" % fid, "?"))
+            seconds = (tsc - base_tsc) / tsc_hz if tsc_hz and tsc >= base_tsc else 0.0
+            print("[%11.6f] %s %s %s" % (seconds, LEVELS[level & 3], where, render(fmt, args)))
+        elif tag == b"L":
+            (lost,) = struct.unpack_from("<Q", data, pos)
+            pos += 8
+            print("%d records lost to the ring wrapping" % lost, file=sys.stderr)
+        else:
+            sys.exit("corrupt stream at byte %d" % (pos - 1))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    parser.add_argument("input", help="binlog.bin or a serial capture")
+    parser.add_argument("--formats", action="store_true", help="list the dictionary too")
+    args = parser.parse_args()
+    decode(load(args.input), args.formats)
+
+
+if __name__ == "__main__":
+    main()
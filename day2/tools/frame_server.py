@@ -0,0 +1,82 @@
+#!/usr/bin/env python3
+"""Reference frame server for NetFrameSource (BOOTX64.efi -net).
+
+Streams the frames of nyan.bin to every client that connects, looping forever.
+Run it on the host side of the run-net tap interface:
+
+    sudo ip addr add 192.168.100.1/24 dev tap0
+    ./tools/frame_server.py src/nyan.bin --fps 20 --jitter 30
+"""
+
+import argparse
+import random
+import socket
+import struct
+import threading
+import time
+
+FRAME_WIDTH = 720
+FRAME_HEIGHT = 480
+FRAME_BYTES = FRAME_WIDTH * FRAME_HEIGHT * 3
+FRAME_STREAM_MAGIC = 0x4e41594e  # "NYAN"
+
+
+def load_frames(path):
+    with open(path, "rb") as f:
+        data = f.read()
+    count = len(data) // FRAME_BYTES
+    if count == 0:
+        raise SystemExit(f"{path}: smaller than a single {FRAME_WIDTH}x{FRAME_HEIGHT} frame")
+    return [data[i * FRAME_BYTES:(i + 1) * FRAME_BYTES] for i in range(count)]
+
+
+def serve(conn, addr, frames, fps, jitter_ms):
+    print(f"{addr[0]}:{addr[1]} connected")
+    header = struct.pack("<IHHII", FRAME_STREAM_MAGIC, FRAME_WIDTH, FRAME_HEIGHT, FRAME_BYTES, len(frames))
+    period = 1.0 / fps if fps > 0 else 0.0
+    sent = 0
+    start = time.monotonic()
+    try:
+        conn.sendall(header)
+        deadline = time.monotonic()
+        while True:
+            conn.sendall(frames[sent % len(frames)])
+            sent += 1
+            if period:
+                deadline += period
+                delay = deadline - time.monotonic()
+                if jitter_ms:
+                    delay += random.uniform(-jitter_ms, jitter_ms) / 1000.0
+                if delay > 0:
+                    time.sleep(delay)
+    except (BrokenPipeError, ConnectionResetError):
+        pass
+    finally:
+        elapsed = time.monotonic() - start
+        rate = sent / elapsed if elapsed else 0.0
+        print(f"{addr[0]}:{addr[1]} gone after {sent} frames ({rate:.1f} fps)")
+        conn.close()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("file", help="raw 720x480 RGB frames, e.g. src/nyan.bin")
+    parser.add_argument("--bind", default="0.0.0.0")
+    parser.add_argument("--port", type=int, default=4444)
+    parser.add_argument("--fps", type=float, default=20.0, help="pacing, 0 sends as fast as TCP allows")
+    parser.add_argument("--jitter", type=float, default=0.0, help="random +/- delay per frame in ms")
+    args = parser.parse_args()
+
+    frames = load_frames(args.file)
+    srv = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    srv.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    srv.bind((args.bind, args.port))
+    srv.listen()
+    print(f"serving {len(frames)} frames on {args.bind}:{args.port}")
+    while True:
+        conn, addr = srv.accept()
+        threading.Thread(target=serve, args=(conn, addr, frames, args.fps, args.jitter), daemon=True).start()
+
+
+if __name__ == "__main__":
+    main()
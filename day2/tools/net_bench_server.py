@@ -0,0 +1,150 @@
+#!/usr/bin/env python3
+"""Host side of NETBENCH.efi.
+
+Every session starts with a 16 byte command, little endian:
+    u32 magic "NBEN", u32 op, u64 size
+
+TCP (default port 4445), commands repeat on one connection until it closes:
+    op 1 sink    read `size` bytes, answer with the u64 byte count
+    op 2 source  send `size` bytes
+    op 4 ping    echo the command back unchanged (RTT measurement)
+
+UDP (default port 4446), the app talks from its raw SNP stack:
+    op 1 sink    count the datagrams that follow until an op 3 done,
+                 answer the done with op 3 carrying the bytes received
+    op 2 source  blast `size` bytes back in 1472 byte datagrams, then op 3
+
+Both listen dual-stack by default so the IPv6 runs reach the same server.
+
+    sudo ip addr add 192.168.100.1/24 dev tap0
+    sudo ip -6 addr add fd00:100::1/64 dev tap0
+    ./tools/net_bench_server.py
+"""
+
+import argparse
+import socket
+import struct
+import threading
+import time
+
+MAGIC = 0x4e45424e  # "NBEN"
+COMMAND = struct.Struct("<IIQ")
+OP_SINK, OP_SOURCE, OP_DONE, OP_PING = 1, 2, 3, 4
+UDP_PAYLOAD = 1472
+
+
+def rate(nbytes, seconds):
+    return f"{nbytes / max(seconds, 1e-9) / (1 << 20):.2f} MiB/s"
+
+
+def tcp_command(conn, addr, op, size):
+    start = time.monotonic()
+    if op == OP_SINK:
+        left = size
+        while left:
+            chunk = conn.recv(min(left, 1 << 20))
+            if not chunk:
+                raise ConnectionError("peer closed")
+            left -= len(chunk)
+        conn.sendall(struct.pack("<Q", size))
+        print(f"tcp sink   {addr[0]}: {size} bytes, {rate(size, time.monotonic() - start)}")
+    elif op == OP_SOURCE:
+        block = bytes(range(256)) * 256
+        left = size
+        while left:
+            n = min(left, len(block))
+            conn.sendall(block[:n])
+            left -= n
+        print(f"tcp source {addr[0]}: {size} bytes, {rate(size, time.monotonic() - start)}")
+
+
+def tcp_session(conn, addr):
+    # Pings are 16 byte writes, do not let Nagle hold back the answers.
+    conn.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+    commands = 0
+    try:
+        while True:
+            header = conn.recv(COMMAND.size, socket.MSG_WAITALL)
+            if len(header) < COMMAND.size:
+                break
+            magic, op, size = COMMAND.unpack(header)
+            if magic != MAGIC:
+                break
+            if op == OP_PING:
+                conn.sendall(header)
+            else:
+                tcp_command(conn, addr, op, size)
+            commands += 1
+    except ConnectionError as e:
+        print(f"tcp {addr[0]}: {e}")
+    finally:
+        print(f"tcp {addr[0]}: closed after {commands} commands")
+        conn.close()
+
+
+def open_socket(bind, kind):
+    family = socket.AF_INET6 if ":" in bind else socket.AF_INET
+    sock = socket.socket(family, kind)
+    if family == socket.AF_INET6:
+        sock.setsockopt(socket.IPPROTO_IPV6, socket.IPV6_V6ONLY, 0)
+    return sock
+
+
+def tcp_server(bind, port):
+    srv = open_socket(bind, socket.SOCK_STREAM)
+    srv.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    srv.bind((bind, port))
+    srv.listen()
+    while True:
+        conn, addr = srv.accept()
+        threading.Thread(target=tcp_session, args=(conn, addr), daemon=True).start()
+
+
+def udp_server(bind, port):
+    sock = open_socket(bind, socket.SOCK_DGRAM)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 16 << 20)
+    sock.bind((bind, port))
+    received = 0
+    start = None
+    while True:
+        data, addr = sock.recvfrom(65535)
+        if len(data) == COMMAND.size:
+            magic, op, size = COMMAND.unpack(data)
+            if magic == MAGIC:
+                if op == OP_SINK:
+                    received = 0
+                    start = time.monotonic()
+                elif op == OP_DONE:
+                    sock.sendto(COMMAND.pack(MAGIC, OP_DONE, received), addr)
+                    if start is not None:
+                        print(f"udp sink   {addr[0]}: {received} of {size} bytes, "
+                              f"{rate(received, time.monotonic() - start)}")
+                        start = None
+                elif op == OP_SOURCE:
+                    t0 = time.monotonic()
+                    payload = bytes(UDP_PAYLOAD)
+                    left = size
+                    while left:
+                        n = min(left, UDP_PAYLOAD)
+                        sock.sendto(payload[:n], addr)
+                        left -= n
+                    sock.sendto(COMMAND.pack(MAGIC, OP_DONE, size), addr)
+                    print(f"udp source {addr[0]}: {size} bytes, {rate(size, time.monotonic() - t0)}")
+                continue
+        received += len(data)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--bind", default="::")
+    parser.add_argument("--tcp-port", type=int, default=4445)
+    parser.add_argument("--udp-port", type=int, default=4446)
+    args = parser.parse_args()
+
+    threading.Thread(target=tcp_server, args=(args.bind, args.tcp_port), daemon=True).start()
+    print(f"tcp on {args.bind}:{args.tcp_port}, udp on {args.bind}:{args.udp_port}")
+    udp_server(args.bind, args.udp_port)
+
+
+if __name__ == "__main__":
+    main()
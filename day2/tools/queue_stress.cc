@@ -0,0 +1,128 @@
+// Host stress test for inc/queue.h, built with QUEUE_STRESS_FLAGS
+// (ThreadSanitizer by default) and run by the `queue-stress` target:
+//
+//     cmake --build build --target queue-stress
+//
+// Or by hand, with an item count per producer:
+//
+//     g++ -std=c++20 -O2 -pthread -Iinc tools/queue_stress.cc -o queue_stress
+//     ./queue_stress 1000000
+//
+// Producers tag every item with their index and a running count, so the
+// consumer can tell lost, duplicated and reordered items apart. Small
+// capacities keep the queues wrapping and running full.
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include "queue.h"
+
+static int failures = 0;
+
+static void expect(bool ok, const char* what) {
+    if (!ok) {
+        std::printf("FAIL %s\n", what);
+        failures += 1;
+    }
+}
+
+static constexpr int PRODUCER_SHIFT = 40;
+
+static std::uint64_t tag(std::uint64_t producer, std::uint64_t i) {
+    return producer << PRODUCER_SHIFT | i;
+}
+
+// Full and empty have to be reported, not waited out.
+static void test_bounds() {
+    static SpscQueue<std::uint64_t, 8> spsc;
+    static MpscQueue<std::uint64_t, 8> mpsc;
+    std::uint64_t item = 0;
+    expect(!spsc.pop(item) && !mpsc.pop(item), "pop from an empty queue");
+    for (std::uint64_t lap = 0; lap < 3; ++lap) {
+        for (std::uint64_t i = 0; i < 8; ++i)
+            expect(spsc.push(lap * 8 + i) && mpsc.push(lap * 8 + i), "push below capacity");
+        expect(!spsc.push(99) && !mpsc.push(99), "push into a full queue");
+        expect(spsc.size() == 8, "spsc size when full");
+        for (std::uint64_t i = 0; i < 8; ++i) {
+            expect(spsc.pop(item) && item == lap * 8 + i, "spsc order across laps");
+            expect(mpsc.pop(item) && item == lap * 8 + i, "mpsc order across laps");
+        }
+        expect(!spsc.pop(item) && !mpsc.pop(item), "pop after draining");
+    }
+    expect(mpsc.full() == 3, "mpsc counts pushes turned away");
+}
+
+static void test_spsc(std::uint64_t count) {
+    static SpscQueue<std::uint64_t, 64> queue;
+    std::thread producer([count] {
+        for (std::uint64_t i = 0; i < count; ++i) {
+            while (!queue.push(i))
+                std::this_thread::yield();
+        }
+    });
+    std::uint64_t next = 0, out_of_order = 0, item;
+    while (next < count) {
+        if (!queue.pop(item)) {
+            std::this_thread::yield();
+            continue;
+        }
+        if (item != next)
+            out_of_order += 1;
+        next += 1;
+    }
+    producer.join();
+    std::printf("spsc: %llu items, %llu out of order\n", (unsigned long long)count, (unsigned long long)out_of_order);
+    expect(out_of_order == 0, "spsc delivers in order");
+    expect(!queue.pop(item), "spsc empty at the end");
+}
+
+static void test_mpsc(unsigned producers, std::uint64_t count) {
+    static MpscQueue<std::uint64_t, 256> queue;
+    std::vector<std::thread> threads;
+    for (unsigned p = 0; p < producers; ++p) {
+        threads.emplace_back([p, count] {
+            for (std::uint64_t i = 0; i < count; ++i) {
+                while (!queue.push(tag(p, i)))
+                    std::this_thread::yield();
+            }
+        });
+    }
+    // Each producer's items must arrive in the order it pushed them, so the
+    // next expected count per producer catches loss and duplicates too.
+    std::vector<std::uint64_t> next(producers, 0);
+    std::uint64_t received = 0, bad = 0, item;
+    while (received < producers * count) {
+        if (!queue.pop(item)) {
+            std::this_thread::yield();
+            continue;
+        }
+        std::uint64_t p = item >> PRODUCER_SHIFT;
+        std::uint64_t i = item & ((1ull << PRODUCER_SHIFT) - 1);
+        if (p >= producers || i != next[p])
+            bad += 1;
+        else
+            next[p] += 1;
+        received += 1;
+    }
+    for (auto& thread : threads)
+        thread.join();
+    std::printf("mpsc: %u producers x %llu items, %llu bad, %llu pushes found it full\n", producers,
+                (unsigned long long)count, (unsigned long long)bad, (unsigned long long)queue.full());
+    expect(bad == 0, "mpsc delivers every item once, in order per producer");
+    expect(!queue.pop(item), "mpsc empty at the end");
+}
+
+int main(int argc, char** argv) {
+    std::uint64_t count = argc > 1 ? std::strtoull(argv[1], nullptr, 0) : 1'000'000;
+    unsigned cpus = std::thread::hardware_concurrency();
+    unsigned producers = cpus > 3 ? cpus - 1 : 3;
+
+    test_bounds();
+    test_spsc(count * producers);
+    test_mpsc(producers, count);
+    std::printf(failures ? "queue_stress: %d failures\n" : "queue_stress: ok\n", failures);
+    return failures ? 1 : 0;
+}
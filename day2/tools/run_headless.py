@@ -0,0 +1,105 @@
+#!/usr/bin/env python3
+"""Runs an EFI disk image in QEMU without a display and reports the result.
+
+The firmware console goes to the serial port, which -nographic puts on
+stdout; every line is echoed, stripped of terminal escapes, and saved to
+`--log`. The app ends the run through isa-debug-exit (BOOTX64.efi -exit,
+BENCH.efi -exit), QEMU then exits with code * 2 + 1. Exit status 1 is a
+PASS; any other code, a plain power off, a QEMU error or the timeout is a
+FAIL. `--expect` adds patterns the log must contain.
+
+    ./tools/run_headless.py --log headless.log --expect '^frames:' build/headless.img
+    ./tools/run_headless.py build/bench.img -- -net none
+"""
+
+import argparse
+import re
+import subprocess
+import sys
+import threading
+import time
+
+ESCAPES = re.compile(r"\x1b\[[0-9;?]*[A-Za-z]|\x1b[()][A-Za-z0-9]")
+DEBUG_EXIT = "isa-debug-exit,iobase=0xf4,iosize=0x04"
+SUMMARY = re.compile(r"^(frames|bench|exit):")
+
+
+def clean(raw):
+    """Decodes a console line and drops colour and cursor sequences."""
+    return ESCAPES.sub("", raw.decode("latin-1")).replace("\r", "")
+
+
+def pump(stream, log, lines):
+    for raw in iter(stream.readline, b""):
+        line = clean(raw).rstrip("\n")
+        if not line.strip():
+            continue
+        lines.append(line)
+        print(line, flush=True)
+        if log:
+            log.write(line + "\n")
+            log.flush()
+
+
+def verdict(returncode):
+    """Returns (passed, reason) for a QEMU exit status."""
+    if returncode == 1:
+        return True, "exit code 0"
+    if returncode == 0:
+        return False, "powered off without isa-debug-exit"
+    if returncode > 1 and returncode % 2 == 1:
+        return False, "exit code %d" % ((returncode - 1) // 2)
+    return False, "qemu failed with status %d" % returncode
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    parser.add_argument("image", help="raw FAT image with a startup.nsh")
+    parser.add_argument("qemu_args", nargs="*", help="extra QEMU arguments, after --")
+    parser.add_argument("--qemu", default="qemu-system-x86_64")
+    parser.add_argument("--bios", default="bios/OVMF.fd")
+    parser.add_argument("--smp", type=int, default=4)
+    parser.add_argument("--timeout", type=float, default=300, help="seconds")
+    parser.add_argument("--log", help="file for the cleaned console output")
+    parser.add_argument("--expect", action="append", default=[], help="regex the log has to match")
+    args = parser.parse_args()
+
+    command = [args.qemu, "-nographic", "-no-reboot",
+               "-bios", args.bios,
+               "-smp", str(args.smp),
+               "-drive", "file=%s,format=raw" % args.image,
+               "-device", DEBUG_EXIT] + args.qemu_args
+    log = open(args.log, "w") if args.log else None
+    lines = []
+    start = time.monotonic()
+    qemu = subprocess.Popen(command, stdin=subprocess.DEVNULL, stdout=subprocess.PIPE, stderr=subprocess.STDOUT)
+    reader = threading.Thread(target=pump, args=(qemu.stdout, log, lines), daemon=True)
+    reader.start()
+    try:
+        qemu.wait(timeout=args.timeout)
+        passed, reason = verdict(qemu.returncode)
+    except subprocess.TimeoutExpired:
+        qemu.kill()
+        qemu.wait()
+        passed, reason = False, "timed out after %g s" % args.timeout
+    reader.join(timeout=5)
+    elapsed = time.monotonic() - start
+    if log:
+        log.close()
+
+    for pattern in args.expect:
+        if not any(re.search(pattern, line) for line in lines):
+            passed = False
+            reason += ", no line matches %r" % pattern
+
+    print("---")
+    for line in lines:
+        if SUMMARY.match(line):
+            print(line)
+    print("%s: %s in %.1f s%s" % ("PASS" if passed else "FAIL", reason, elapsed,
+                                   ", log in " + args.log if args.log else ""))
+    return 0 if passed else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
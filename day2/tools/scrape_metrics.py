@@ -0,0 +1,102 @@
+#!/usr/bin/env python3
+"""Scraper for the embedded HTTP server (BOOTX64.efi -http).
+
+Polls /metrics over one keep-alive connection, sending `--pipeline` requests
+back to back each round, and prints frame time percentiles estimated from the
+histogram plus the request rate. `--frame out.bmp` saves one /frame first.
+
+    ./tools/scrape_metrics.py --interval 1 --pipeline 4
+"""
+
+import argparse
+import socket
+import time
+
+
+def read_response(sock, pending):
+    """Reads one response, returns (status, body, leftover bytes)."""
+    data = pending
+    while b"\r\n\r\n" not in data:
+        chunk = sock.recv(65536)
+        if not chunk:
+            raise ConnectionError("server closed")
+        data += chunk
+    head, _, rest = data.partition(b"\r\n\r\n")
+    lines = head.decode("latin-1").split("\r\n")
+    status = int(lines[0].split()[1])
+    length = 0
+    for line in lines[1:]:
+        name, _, value = line.partition(":")
+        if name.strip().lower() == "content-length":
+            length = int(value)
+    while len(rest) < length:
+        chunk = sock.recv(65536)
+        if not chunk:
+            raise ConnectionError("server closed")
+        rest += chunk
+    return status, rest[:length], rest[length:]
+
+
+def parse(text):
+    samples = {}
+    for line in text.splitlines():
+        if not line or line.startswith("#"):
+            continue
+        name, _, value = line.rpartition(" ")
+        samples[name] = float(value)
+    return samples
+
+
+def percentile(samples, name, q):
+    buckets = sorted(
+        (float("inf") if k.split('le="')[1][:-2] == "+Inf" else float(k.split('le="')[1][:-2]), v)
+        for k, v in samples.items() if k.startswith(name + "_bucket")
+    )
+    total = samples.get(name + "_count", 0)
+    if not total:
+        return None
+    for bound, count in buckets:
+        if count >= q * total:
+            return bound
+    return None
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--host", default="192.168.100.2")
+    parser.add_argument("--port", type=int, default=8080)
+    parser.add_argument("--interval", type=float, default=1.0)
+    parser.add_argument("--pipeline", type=int, default=1)
+    parser.add_argument("--frame", help="save /frame to this file and continue")
+    args = parser.parse_args()
+
+    sock = socket.create_connection((args.host, args.port))
+    pending = b""
+    if args.frame:
+        sock.sendall(b"GET /frame HTTP/1.1\r\nHost: app\r\n\r\n")
+        status, body, pending = read_response(sock, pending)
+        with open(args.frame, "wb") as f:
+            f.write(body)
+        print(f"/frame {status}: {len(body)} bytes to {args.frame}")
+
+    request = b"GET /metrics HTTP/1.1\r\nHost: app\r\n\r\n"
+    last = None
+    while True:
+        start = time.monotonic()
+        sock.sendall(request * args.pipeline)
+        for _ in range(args.pipeline):
+            status, body, pending = read_response(sock, pending)
+        rtt = (time.monotonic() - start) * 1000
+        samples = parse(body.decode())
+        p50 = percentile(samples, "frame_time_seconds", 0.5)
+        p99 = percentile(samples, "frame_time_seconds", 0.99)
+        requests = samples.get("http_requests_total", 0)
+        rate = "" if last is None else f" {(requests - last[0]) / (time.monotonic() - last[1]):.1f} req/s"
+        last = (requests, time.monotonic())
+        print(f"{status} frames {samples.get('frames_shown_total', 0):.0f} "
+              f"frame p50 <= {p50}s p99 <= {p99}s, {args.pipeline} requests in {rtt:.1f} ms{rate}")
+        time.sleep(args.interval)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,103 @@
+#!/usr/bin/env python3
+"""Receiver for the UDP telemetry stream (BOOTX64.efi -telemetry).
+
+Decodes the packets described in inc/telemetry.h, prints a per-second summary
+per record id and reports lost packets from gaps in the sequence numbers.
+
+    ./tools/telemetry_recv.py --csv telemetry.csv
+"""
+
+import argparse
+import socket
+import struct
+import sys
+import time
+
+TELEMETRY_MAGIC = 0x4d4c4554  # "TELM"
+HEADER = struct.Struct("<IIHHI")
+RECORD = struct.Struct("<QIHH")
+
+KINDS = {1: "sample", 2: "counter", 3: "gauge"}
+NAMES = {
+    1: "frame_cycles",
+    2: "frames_shown",
+    3: "stream_buffered",
+    4: "stream_underruns",
+}
+
+
+def decode(packet):
+    magic, sequence, count, record_size, _ = HEADER.unpack_from(packet)
+    if magic != TELEMETRY_MAGIC or record_size < RECORD.size:
+        return None, []
+    records = []
+    offset = HEADER.size
+    for _ in range(count):
+        if offset + RECORD.size > len(packet):
+            break
+        records.append(RECORD.unpack_from(packet, offset))
+        offset += record_size
+    return sequence, records
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--bind", default="0.0.0.0")
+    parser.add_argument("--port", type=int, default=5555)
+    parser.add_argument("--csv", help="append every record as tsc,id,name,kind,value")
+    args = parser.parse_args()
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 4 << 20)
+    sock.bind((args.bind, args.port))
+    sock.settimeout(1.0)
+    csv = open(args.csv, "a") if args.csv else None
+
+    expected = None
+    lost = 0
+    window = {}
+    window_records = 0
+    window_start = time.monotonic()
+    print(f"listening on {args.bind}:{args.port}")
+    while True:
+        try:
+            packet, _ = sock.recvfrom(65535)
+            sequence, records = decode(packet)
+            if sequence is None:
+                continue
+            if expected is not None and sequence != expected:
+                lost += (sequence - expected) & 0xffffffff
+            expected = (sequence + 1) & 0xffffffff
+            for tsc, value, rid, kind in records:
+                stats = window.setdefault(rid, [kind, 0, 0, None, None, 0])
+                stats[1] += 1
+                stats[2] += value
+                stats[3] = value if stats[3] is None else min(stats[3], value)
+                stats[4] = value if stats[4] is None else max(stats[4], value)
+                stats[5] = value
+                if csv:
+                    csv.write(f"{tsc},{rid},{NAMES.get(rid, rid)},{KINDS.get(kind, kind)},{value}\n")
+            window_records += len(records)
+        except socket.timeout:
+            pass
+
+        now = time.monotonic()
+        if now - window_start >= 1.0:
+            rate = window_records / (now - window_start)
+            print(f"{rate:9.0f} records/s, {lost} packets lost")
+            for rid, (kind, n, total, lo, hi, last) in sorted(window.items()):
+                name = NAMES.get(rid, f"id{rid}")
+                if kind == 1:
+                    print(f"  {name:18} n={n:<6} min={lo} avg={total // n} max={hi}")
+                else:
+                    print(f"  {name:18} {last}")
+            sys.stdout.flush()
+            if csv:
+                csv.flush()
+            window = {}
+            window_records = 0
+            window_start = now
+
+
+if __name__ == "__main__":
+    main()
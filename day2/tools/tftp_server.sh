@@ -0,0 +1,33 @@
+#!/bin/sh
+# TFTP server for AssetCache::fetch_tftp (BOOTX64.efi -tftp, or any run
+# without nyan.bin on the disk, see -DASSETS_ON_DISK=OFF).
+#
+# Serves the given files from a scratch root on the host end of the run-net
+# tap with dnsmasq, DNS off. dnsmasq answers the blksize and tsize options
+# the app asks for. Pass --dhcp to also hand out 192.168.100.2, the app
+# itself uses a static address.
+#
+#     sudo ip addr add 192.168.100.1/24 dev tap0
+#     sudo ./tools/tftp_server.sh src/nyan.bin
+set -e
+
+INTERFACE=${INTERFACE:-tap0}
+DHCP=""
+if [ "$1" = "--dhcp" ]; then
+    DHCP="--dhcp-range=192.168.100.2,192.168.100.2,255.255.255.0,1h"
+    shift
+fi
+if [ $# -eq 0 ]; then
+    echo "usage: $0 [--dhcp] file..." >&2
+    exit 1
+fi
+
+ROOT=$(mktemp -d)
+trap 'rm -rf "$ROOT"' EXIT
+cp "$@" "$ROOT"
+
+dnsmasq --no-daemon --log-facility=- \
+    --port=0 \
+    --interface="$INTERFACE" --bind-interfaces \
+    --enable-tftp --tftp-root="$ROOT" --tftp-no-fail \
+    $DHCP